@@ -0,0 +1,141 @@
+#pragma once
+#include <cstdint>
+#include <hndlr_cache_t.hpp>
+#include <pe_image_t.hpp>
+#include <rtn_file_t.hpp>
+#include <string>
+#include <thread_pool_t.hpp>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// on disk layout of profiled vm handlers... addresses are rva's so that the
+/// profiles stay valid wherever the image is loaded:
+///
+/// hndlr_hdr_t
+/// hndlr_t[hndlr_cnt]
+/// per handler: u32 trace[trace_cnt]
+/// </summary>
+namespace file {
+constexpr std::uint32_t hndlr_magic = 'V' | 'H' << 8 | 'N' << 16 | 'D' << 24;
+constexpr std::uint16_t hndlr_version = 1;
+
+struct hndlr_hdr_t {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint16_t hdr_size;
+  std::uint32_t hndlr_cnt;
+  std::uint32_t reserved;
+  std::uint64_t hndlr_tbl;
+};
+
+struct hndlr_t {
+  std::uint32_t rva;
+  std::uint16_t vip, vsp;
+  std::uint32_t imm_rva;
+  std::int32_t imm_reg;
+  std::uint64_t trace_tbl;
+  std::uint32_t trace_cnt;
+  std::uint8_t mnemonic;
+  std::uint8_t imm_size;
+  std::uint8_t has_imm;
+  std::uint8_t imm_sext;
+};
+
+static_assert(sizeof(hndlr_hdr_t) == 24 && sizeof(hndlr_t) == 32,
+              "vm::file structures must not change size...");
+}  // namespace file
+
+/// <summary>
+/// content addressed cache of analysis results... results live in a directory
+/// per binary named after a hash of the file, so a changed binary never sees
+/// stale results:
+///
+/// dir/hash/rtn_rva.vrtn   emulated routine of a vm entry (rtn_writer_t)
+/// dir/hash/hndlrs.vhnd    profiles of every trusted vm handler
+///
+/// files are read by mapping them and are validated by magic and format
+/// version, a file which fails validation is a cache miss... files are
+/// written under a temporary name and renamed once complete so concurrent
+/// writers and readers never see a partial file...
+///
+/// vmprofiler has no notion of a vm handler table, handlers are keyed by
+/// their address and vip/vsp registers instead (see hndlr_key_t) which also
+/// tells the vm's of a binary apart...
+/// </summary>
+class analysis_cache_t {
+ public:
+  /// <summary>
+  /// hash the binary and create its directory...
+  /// </summary>
+  /// <param name="dir">root directory of the cache...</param>
+  /// <param name="image">loaded binary...</param>
+  /// <param name="pool">optional pool to hash the binary on...</param>
+  /// <returns>returns true if the directory could be created...</returns>
+  bool open(const std::string& dir, const pe_image_t& image,
+            thread_pool_t* pool = nullptr);
+
+  /// <summary>
+  /// hash of the binary...
+  /// </summary>
+  std::uint64_t hash() const { return m_hash; }
+
+  /// <summary>
+  /// load the routine of a vm entry...
+  /// </summary>
+  /// <param name="rva">rva of the vm entry...</param>
+  /// <param name="vrtn">routine to fill...</param>
+  /// <returns>returns false on a cache miss...</returns>
+  bool load_rtn(std::uint32_t rva, vm::instrs::vrtn_t& vrtn) const;
+
+  /// <summary>
+  /// open a writer for the routine of a vm entry... blocks are added to it as
+  /// they are emulated, see commit_rtn...
+  /// </summary>
+  /// <param name="rva">rva of the vm entry...</param>
+  /// <param name="writer">writer to open...</param>
+  /// <returns>returns true if the writer was opened...</returns>
+  bool begin_rtn(std::uint32_t rva, rtn_writer_t& writer) const;
+
+  /// <summary>
+  /// close a writer opened by begin_rtn and publish the routine... routines
+  /// which are not committed never make it into the cache...
+  /// </summary>
+  /// <param name="rva">rva of the vm entry...</param>
+  /// <param name="writer">writer opened by begin_rtn...</param>
+  /// <param name="keep">false to drop the routine (emulation failed)...</param>
+  /// <returns>returns true if the routine is in the cache...</returns>
+  bool commit_rtn(std::uint32_t rva, rtn_writer_t& writer,
+                  bool keep = true) const;
+
+  /// <summary>
+  /// load the vm handler profiles of the binary...
+  /// </summary>
+  /// <param name="profiles">list to append to...</param>
+  /// <returns>returns false on a cache miss...</returns>
+  bool load_hndlrs(std::vector<hndlr_profile_t>& profiles) const;
+
+  /// <summary>
+  /// replace the vm handler profiles of the binary... duplicates are
+  /// dropped...
+  /// </summary>
+  /// <param name="profiles">every trusted handler...</param>
+  /// <returns>returns true if the profiles were written...</returns>
+  bool store_hndlrs(const std::vector<hndlr_profile_t>& profiles) const;
+
+  /// <summary>
+  /// hash of a block of memory, 1mb chunks are hashed on the pool if one is
+  /// given...
+  /// </summary>
+  static std::uint64_t hash(const std::uint8_t* data, std::size_t size,
+                            thread_pool_t* pool = nullptr);
+
+ private:
+  std::string path(const char* name) const;
+  std::string rtn_path(std::uint32_t rva) const;
+
+  std::string m_dir;
+  std::uint64_t m_hash = 0ull;
+  std::uintptr_t m_module_base = 0ull, m_image_base = 0ull;
+};
+}  // namespace vm
@@ -0,0 +1,122 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread_pool_t.hpp>
+#include <vector>
+#include <vmemu_t.hpp>
+
+namespace vm {
+/// <summary>
+/// a binary of a batch and what to do with it...
+/// </summary>
+struct batch_job_t {
+  std::string bin;
+
+  /// <summary>
+  /// rvas of the vm entries to emulate, empty means every vm entry
+  /// vm::locate finds...
+  /// </summary>
+  std::vector<std::uint32_t> vm_entries;
+
+  /// <summary>
+  /// routine file to write, see rtn_writer_t...
+  /// </summary>
+  std::string out;
+};
+
+/// <summary>
+/// how a binary of a batch went...
+/// </summary>
+struct batch_result_t {
+  bool loaded = false, written = false;
+
+  /// <summary>
+  /// vm entries of the binary, those emulated (or loaded from the cache) and
+  /// those of them loaded from the cache...
+  /// </summary>
+  std::size_t entries = 0u, emulated = 0u, cached = 0u;
+
+  /// <summary>
+  /// vm entries which ran out of budget or were cancelled, see
+  /// emu_status_t... their routines are written as far as they were
+  /// emulated...
+  /// </summary>
+  std::size_t stopped = 0u;
+
+  /// <summary>
+  /// time from the start of loading until the routine file was written...
+  /// </summary>
+  std::chrono::milliseconds time{};
+};
+
+/// <summary>
+/// emulates many binaries in a single process... three stages run at the
+/// same time, connected by bounded queues:
+///
+/// load:     map and relocate a binary and find its vm entries, on a thread of
+///           its own
+/// emulate:  every vm entry is a task on the thread pool... entries of several
+///           binaries are in flight at once, every binary has its own decode
+///           cache, vm handler knowledge base and warm engines
+/// write:    write routine files and cache entries, on a thread of its own
+///
+/// depth binaries can be loaded ahead of emulation and depth binaries can be
+/// between emulation and being written, a slow disk or a huge binary only
+/// holds up the other stages once those are used up...
+/// </summary>
+class batch_t {
+ public:
+  /// <summary>
+  /// called by the write stage once a binary is done...
+  /// </summary>
+  using done_t =
+      std::function<void(const batch_job_t& job, const batch_result_t& result)>;
+
+  /// <summary>
+  /// create a batch runner...
+  /// </summary>
+  /// <param name="cfg">configuration of every engine, image, decode cache,
+  /// knowledge base and profiles are filled in per binary...</param>
+  /// <param name="pool">pool vm entries are emulated on...</param>
+  /// <param name="depth">binaries each bounded queue holds...</param>
+  batch_t(const emu_cfg_t& cfg, thread_pool_t& pool, std::size_t depth = 2u);
+
+  /// <summary>
+  /// cache emulated vm entries and profiled vm handlers of every binary in
+  /// this directory, see analysis_cache_t...
+  /// </summary>
+  /// <param name="dir">root directory of the cache...</param>
+  void cache(const std::string& dir) { m_cache_dir = dir; }
+
+  /// <summary>
+  /// read a manifest... one binary per line: path of the binary, comma
+  /// separated hex rvas of vm entries or "all", path of the routine file,
+  /// separated by whitespace. everything after a # is a comment...
+  /// </summary>
+  /// <param name="path">path of the manifest...</param>
+  /// <param name="jobs">list to append to...</param>
+  /// <returns>returns false if the manifest could not be read or has a
+  /// malformed line...</returns>
+  static bool parse(const std::string& path, std::vector<batch_job_t>& jobs);
+
+  /// <summary>
+  /// process every job... returns once all of them are written or failed
+  /// (or emu_cfg_t::cancel was set)...
+  /// </summary>
+  /// <param name="jobs">binaries to process...</param>
+  /// <param name="done">optional callback for every finished job...</param>
+  /// <returns>result of each job...</returns>
+  std::vector<batch_result_t> run(const std::vector<batch_job_t>& jobs,
+                                  const done_t& done = {});
+
+ private:
+  bool cancelled() const;
+
+  emu_cfg_t m_cfg;
+  thread_pool_t& m_pool;
+  const std::size_t m_depth;
+  std::string m_cache_dir;
+};
+}  // namespace vm
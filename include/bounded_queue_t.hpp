@@ -0,0 +1,77 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace vm {
+/// <summary>
+/// fifo queue between two pipeline stages... a producer blocks while the
+/// queue is full so that a stage which falls behind slows down the ones
+/// feeding it instead of letting work pile up in memory...
+/// </summary>
+/// <typeparam name="T">type of the items...</typeparam>
+template <class T>
+class bounded_queue_t {
+ public:
+  /// <summary>
+  /// create an empty queue...
+  /// </summary>
+  /// <param name="capacity">most items the queue holds, at least one...</param>
+  explicit bounded_queue_t(std::size_t capacity)
+      : m_capacity(capacity ? capacity : 1u) {}
+
+  bounded_queue_t(const bounded_queue_t&) = delete;
+  bounded_queue_t& operator=(const bounded_queue_t&) = delete;
+
+  /// <summary>
+  /// append an item, blocks while the queue is full...
+  /// </summary>
+  /// <param name="item">item to append...</param>
+  /// <returns>returns false if the queue was closed, the item is
+  /// dropped...</returns>
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_not_full.wait(lock,
+                    [&] { return m_closed || m_items.size() < m_capacity; });
+    if (m_closed) return false;
+
+    m_items.push_back(std::move(item));
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  /// <summary>
+  /// take the oldest item, blocks while the queue is empty...
+  /// </summary>
+  /// <param name="item">receives the item...</param>
+  /// <returns>returns false once the queue is closed and empty...</returns>
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_not_empty.wait(lock, [&] { return m_closed || !m_items.empty(); });
+    if (m_items.empty()) return false;
+
+    item = std::move(m_items.front());
+    m_items.pop_front();
+    m_not_full.notify_one();
+    return true;
+  }
+
+  /// <summary>
+  /// no more items will be pushed... items already queued can still be
+  /// popped...
+  /// </summary>
+  void close() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_closed = true;
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+  }
+
+ private:
+  const std::size_t m_capacity;
+  std::mutex m_lock;
+  std::condition_variable m_not_empty, m_not_full;
+  std::deque<T> m_items;
+  bool m_closed = false;
+};
+}  // namespace vm
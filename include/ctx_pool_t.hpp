@@ -0,0 +1,72 @@
+#pragma once
+#include <unicorn/unicorn.h>
+
+#include <cstdint>
+#include <emu_stats_t.hpp>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// pool of unicorn-engine cpu contexts... tracing saves a context for every
+/// single native instruction of a vm handler, allocating and freeing them each
+/// time is nothing but malloc churn. contexts are handed back to the pool once
+/// a handler has been profiled and are reused for the next one...
+/// </summary>
+class ctx_pool_t {
+ public:
+  ctx_pool_t() = default;
+  ~ctx_pool_t();
+
+  ctx_pool_t(const ctx_pool_t&) = delete;
+  ctx_pool_t& operator=(const ctx_pool_t&) = delete;
+
+  /// <summary>
+  /// binds the pool to a unicorn-engine instance... must be called before any
+  /// context is acquired...
+  /// </summary>
+  /// <param name="uc">unicorn-engine the contexts are allocated for...</param>
+  void init(uc_engine* uc);
+
+  /// <summary>
+  /// get an unused context from the pool, allocating one if the pool is
+  /// empty...
+  /// </summary>
+  /// <returns>context or nullptr if allocation failed...</returns>
+  uc_context* acquire();
+
+  /// <summary>
+  /// get an unused context from the pool and save the current cpu state into
+  /// it...
+  /// </summary>
+  /// <returns>context or nullptr if allocation or saving failed...</returns>
+  uc_context* save();
+
+  /// <summary>
+  /// give a context back to the pool...
+  /// </summary>
+  /// <param name="ctx">context previously returned by acquire/save...</param>
+  void release(uc_context* ctx);
+
+  /// <summary>
+  /// give a list of contexts back to the pool... the vector is cleared but
+  /// keeps its capacity...
+  /// </summary>
+  /// <param name="ctxs">contexts previously returned by acquire/save...</param>
+  void release(std::vector<uc_context*>& ctxs);
+
+  /// <summary>
+  /// number of allocated contexts sitting in the pool...
+  /// </summary>
+  std::size_t size() const { return m_free.size(); }
+
+  /// <summary>
+  /// context allocations and saves, see emu_stats_t...
+  /// </summary>
+  const emu_stats_t& stats() const { return m_stats; }
+
+ private:
+  uc_engine* m_uc = nullptr;
+  std::vector<uc_context*> m_free;
+  emu_stats_t m_stats;
+};
+}  // namespace vm
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vmprofiler.hpp>
+
+namespace vm {
+/// <summary>
+/// address indexed cache of decoded native instructions over the mapped
+/// image... the image is never modified once relocated so an instruction only
+/// has to be decoded once. the cache is filled lazily and can be shared
+/// between emulator instances (and threads) working on the same image...
+/// </summary>
+class decode_cache_t {
+ public:
+  /// <summary>
+  /// create a decode cache over a range of host memory...
+  /// </summary>
+  /// <param name="base">host address of the image...</param>
+  /// <param name="size">size of the image...</param>
+  explicit decode_cache_t(std::uintptr_t base, std::size_t size);
+  ~decode_cache_t();
+
+  decode_cache_t(const decode_cache_t&) = delete;
+  decode_cache_t& operator=(const decode_cache_t&) = delete;
+
+  /// <summary>
+  /// decode the instruction at an address... addresses outside of the image
+  /// are decoded every time into thread local storage...
+  /// </summary>
+  /// <param name="addr">host address of the instruction...</param>
+  /// <returns>decoded instruction or nullptr if it could not be
+  /// decoded...</returns>
+  const zydis_decoded_instr_t* decode(std::uintptr_t addr);
+
+  /// <summary>
+  /// true if decoded instructions of an address stay valid (are cached)...
+  /// </summary>
+  bool contains(std::uintptr_t addr) const {
+    return addr >= m_base && addr < m_base + m_size;
+  }
+
+  std::uintptr_t base() const { return m_base; }
+  std::size_t size() const { return m_size; }
+
+ private:
+  /// <summary>
+  /// one slot per byte of a 4kb page of the image...
+  /// </summary>
+  struct page_t {
+    std::atomic<const zydis_decoded_instr_t*> instrs[0x1000];
+  };
+
+  const std::uintptr_t m_base;
+  const std::size_t m_size;
+  std::unique_ptr<std::atomic<page_t*>[]> m_pages;
+};
+}  // namespace vm
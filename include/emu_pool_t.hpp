@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <vmemu_t.hpp>
+
+namespace vm {
+/// <summary>
+/// warm emulators, one per slot (usually one per worker of a thread_pool_t)...
+/// an engine is opened, mapped and hooked the first time its slot is used and
+/// only reset from then on, so emulating thousands of vm entries costs one
+/// uc_open and one mapping of the image per slot...
+///
+/// a slot must only ever be used by a single thread at a time...
+/// </summary>
+class emu_pool_t {
+ public:
+  /// <summary>
+  /// create an empty pool...
+  /// </summary>
+  /// <param name="slots">number of engines...</param>
+  /// <param name="cfg">configuration of every engine...</param>
+  emu_pool_t(std::size_t slots, const emu_cfg_t& cfg);
+
+  /// <summary>
+  /// get the engine of a slot bound to a vm and ready to emulate...
+  /// </summary>
+  /// <param name="slot">slot of the engine...</param>
+  /// <param name="vm_ctx">vm to emulate, has to outlive the next emulate
+  /// call...</param>
+  /// <returns>engine or nullptr if it could not be initialized...</returns>
+  emu_t* get(std::size_t slot, vm::vmctx_t* vm_ctx);
+
+  std::size_t size() const { return m_engines.size(); }
+
+ private:
+  emu_cfg_t m_cfg;
+  std::vector<std::unique_ptr<emu_t>> m_engines;
+};
+}  // namespace vm
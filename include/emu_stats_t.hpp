@@ -0,0 +1,126 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// counters are only compiled in with VMEMU_STATS defined (cmake option
+// VMEMU_STATS)... without it every VMEMU_STAT* macro expands to nothing and
+// emu_stats_t stays zero...
+#ifdef VMEMU_STATS
+#define VMEMU_STAT_CAT_(a, b) a##b
+#define VMEMU_STAT_CAT(a, b) VMEMU_STAT_CAT_(a, b)
+
+#define VMEMU_STAT_ADD(stats, field, val) ((stats).field += (val))
+
+#define VMEMU_STAT_TIME(stats, field) \
+  vm::stat_timer_t VMEMU_STAT_CAT(stat_timer_, __LINE__)((stats).field)
+#else
+#define VMEMU_STAT_ADD(stats, field, val) ((void)0)
+#define VMEMU_STAT_TIME(stats, field) ((void)0)
+#endif
+
+#define VMEMU_STAT_INC(stats, field) VMEMU_STAT_ADD(stats, field, 1u)
+
+namespace vm {
+/// <summary>
+/// performance counters of an emulator... times are in nanoseconds...
+/// </summary>
+struct emu_stats_t {
+  /// <summary>
+  /// true if the counters are compiled in...
+  /// </summary>
+#ifdef VMEMU_STATS
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  /// <summary>
+  /// emulate calls and the time spent in them...
+  /// </summary>
+  std::uint64_t routines = 0u, emulate_ns = 0u;
+
+  /// <summary>
+  /// native instructions and basic blocks seen by the code/block hooks...
+  /// </summary>
+  std::uint64_t instrs_hooked = 0u, blocks_hooked = 0u;
+
+  /// <summary>
+  /// vm handler executions which were traced and profiled, taken from the
+  /// handler cache and run on the host...
+  /// </summary>
+  std::uint64_t hndlrs_traced = 0u, hndlrs_cached = 0u, hndlrs_native = 0u;
+
+  /// <summary>
+  /// time spent in vm::instrs::deobfuscate and vm::instrs::determine...
+  /// </summary>
+  std::uint64_t deobfuscate_ns = 0u, determine_ns = 0u;
+
+  /// <summary>
+  /// cpu contexts allocated by the context pool and cpu states saved into
+  /// them...
+  /// </summary>
+  std::uint64_t ctx_allocs = 0u, ctx_saves = 0u;
+
+  /// <summary>
+  /// bytes copied between the emulated stack, its mirror and snapshots...
+  /// </summary>
+  std::uint64_t stack_bytes = 0u;
+
+  /// <summary>
+  /// legit_branch calls and the native instructions executed speculatively by
+  /// them...
+  /// </summary>
+  std::uint64_t legit_branches = 0u, spec_instrs = 0u;
+
+  /// <summary>
+  /// virtual jump tables resolved and their entries found legit...
+  /// </summary>
+  std::uint64_t jmp_tables = 0u, table_targets = 0u;
+
+  /// <summary>
+  /// unmapped memory accesses...
+  /// </summary>
+  std::uint64_t mem_faults = 0u;
+
+  /// <summary>
+  /// virtual jmp stack snapshots spilled to disk and read back...
+  /// </summary>
+  std::uint64_t snap_spills = 0u, snap_loads = 0u;
+
+  /// <summary>
+  /// sum up or take the difference of two sets of counters... the counters of
+  /// a single run of a reused engine are its counters after the run minus
+  /// those before...
+  /// </summary>
+  emu_stats_t& operator+=(const emu_stats_t& other);
+  emu_stats_t& operator-=(const emu_stats_t& other);
+
+  /// <summary>
+  /// the counters as a single json object...
+  /// </summary>
+  std::string json() const;
+};
+
+/// <summary>
+/// adds the time it lived to a counter... see VMEMU_STAT_TIME...
+/// </summary>
+class stat_timer_t {
+ public:
+  explicit stat_timer_t(std::uint64_t& ns)
+      : m_ns(ns), m_begin(std::chrono::steady_clock::now()) {}
+
+  ~stat_timer_t() {
+    m_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_begin)
+                .count();
+  }
+
+  stat_timer_t(const stat_timer_t&) = delete;
+  stat_timer_t& operator=(const stat_timer_t&) = delete;
+
+ private:
+  std::uint64_t& m_ns;
+  std::chrono::steady_clock::time_point m_begin;
+};
+}  // namespace vm
@@ -0,0 +1,204 @@
+#pragma once
+#include <unicorn/unicorn.h>
+
+#include <ctx_pool_t.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vmprofiler.hpp>
+
+namespace vm {
+/// <summary>
+/// a vm handler is identified by its address and the native registers used
+/// for VIP and VSP...
+/// </summary>
+struct hndlr_key_t {
+  std::uintptr_t begin;
+  zydis_reg_t vip, vsp;
+
+  bool operator==(const hndlr_key_t& other) const {
+    return begin == other.begin && vip == other.vip && vsp == other.vsp;
+  }
+};
+
+struct hndlr_key_hash_t {
+  std::size_t operator()(const hndlr_key_t& key) const {
+    return std::hash<std::uintptr_t>()(key.begin) ^
+           (static_cast<std::size_t>(key.vip) << 48) ^
+           (static_cast<std::size_t>(key.vsp) << 56);
+  }
+};
+
+/// <summary>
+/// a native register holding the decrypted operand of a vm handler right
+/// before a given native instruction executes...
+/// </summary>
+struct imm_src_t {
+  /// <summary>
+  /// address of the native instruction...
+  /// </summary>
+  std::uintptr_t addr;
+
+  /// <summary>
+  /// unicorn-engine register id...
+  /// </summary>
+  int reg;
+
+  /// <summary>
+  /// true if the operand is sign extended from its size...
+  /// </summary>
+  bool sext;
+};
+
+/// <summary>
+/// everything learned about a vm handler from traced executions of it...
+/// </summary>
+struct hndlr_entry_t {
+  /// <summary>
+  /// virtual instruction produced by the first traced execution... the
+  /// immediate value of it is replaced per execution...
+  /// </summary>
+  vm::instrs::vinstr_t vinstr;
+
+  /// <summary>
+  /// places the operand could have been taken from, registers read by the
+  /// native instructions the profile matched... each traced execution removes
+  /// the candidates that do not agree with vm::instrs::determine...
+  /// </summary>
+  std::vector<imm_src_t> candidates;
+
+  /// <summary>
+  /// operand of the first traced execution and whether a later one saw a
+  /// different operand... a register which holds the operand by chance is
+  /// only ruled out once the operand changes...
+  /// </summary>
+  std::uint64_t first_imm;
+  bool imm_varied;
+
+  /// <summary>
+  /// where the operand is taken from once the entry is trusted...
+  /// </summary>
+  imm_src_t imm;
+
+  /// <summary>
+  /// address of each native instruction of the traced execution which made
+  /// the entry trusted...
+  /// </summary>
+  std::vector<std::uintptr_t> trace;
+
+  /// <summary>
+  /// number of traced executions that agreed with this entry...
+  /// </summary>
+  std::uint32_t runs;
+
+  /// <summary>
+  /// set once enough traced executions agreed, the handler is no longer
+  /// traced from then on...
+  /// </summary>
+  bool trusted;
+
+  /// <summary>
+  /// set if traced executions disagreed, the handler is always traced...
+  /// </summary>
+  bool poisoned;
+};
+
+/// <summary>
+/// a trusted vm handler as handed between caches...
+/// </summary>
+using hndlr_profile_t = std::pair<hndlr_key_t, hndlr_entry_t>;
+
+class hndlr_kb_t;
+
+/// <summary>
+/// cache of profiled vm handlers keyed by handler address and VIP/VSP register
+/// assignment... once a handler is trusted its virtual instruction can be
+/// produced without deobfuscating and determining its native trace again,
+/// only the decrypted operand is read out of the live cpu...
+///
+/// only handlers still being verified are kept here, trusted and poisoned
+/// ones are published to a hndlr_kb_t which may be shared with other caches
+/// so that a handler is profiled once per image instead of once per engine...
+/// </summary>
+class hndlr_cache_t {
+ public:
+  /// <summary>
+  /// number of traced executions which have to agree before a handler is
+  /// trusted...
+  /// </summary>
+  static constexpr auto verify_runs = 3u;
+
+  /// <summary>
+  /// traced executions after which a handler whose operand never changed is
+  /// poisoned, where its operand comes from can not be told apart...
+  /// </summary>
+  static constexpr auto max_runs = 16u;
+
+  /// <summary>
+  /// set the knowledge base trusted and poisoned handlers go to, has to be
+  /// called before anything else...
+  /// </summary>
+  /// <param name="kb">knowledge base, has to outlive the cache...</param>
+  void init(hndlr_kb_t* kb) { m_kb = kb; }
+
+  /// <summary>
+  /// lookup a trusted handler...
+  /// </summary>
+  /// <param name="key">handler to lookup...</param>
+  /// <returns>trusted entry or nullptr...</returns>
+  const hndlr_entry_t* get(const hndlr_key_t& key) const;
+
+  /// <summary>
+  /// learn from a traced execution of a handler... vm handlers which end a
+  /// virtual code block (jmp and vmexit) are never cached since the emulator
+  /// needs their traces...
+  /// </summary>
+  /// <param name="uc">unicorn-engine the trace was made with...</param>
+  /// <param name="pool">pool to take a backup cpu context from...</param>
+  /// <param name="key">handler which was traced...</param>
+  /// <param name="vinstr">result of vm::instrs::determine...</param>
+  /// <param name="profiled">deobfuscated native instructions the profile
+  /// was matched against...</param>
+  /// <param name="ctxs">cpu context before each native instruction...</param>
+  /// <param name="addrs">address of each native instruction...</param>
+  void learn(uc_engine* uc, ctx_pool_t& pool, const hndlr_key_t& key,
+             const vm::instrs::vinstr_t& vinstr,
+             const std::vector<vm::instrs::emu_instr_t>& profiled,
+             const std::vector<uc_context*>& ctxs,
+             const std::vector<std::uintptr_t>& addrs);
+
+  /// <summary>
+  /// produce the virtual instruction of a trusted handler...
+  /// </summary>
+  /// <param name="entry">trusted handler...</param>
+  /// <param name="val">value of the imm register, see imm_src_t...</param>
+  /// <returns>virtual instruction of this execution of the handler...</returns>
+  static vm::instrs::vinstr_t vinstr(const hndlr_entry_t& entry,
+                                     std::uint64_t val);
+
+  /// <summary>
+  /// append every trusted entry of the knowledge base...
+  /// </summary>
+  /// <param name="profiles">list to append to...</param>
+  void trusted(std::vector<hndlr_profile_t>& profiles) const;
+
+  /// <summary>
+  /// add an entry profiled elsewhere (another engine or an earlier run)... it
+  /// is trusted right away...
+  /// </summary>
+  /// <param name="profile">handler and its entry...</param>
+  void add(const hndlr_profile_t& profile);
+
+ private:
+  void poison(const hndlr_key_t& key);
+  static std::uint64_t imm_val(std::uint64_t val, std::uint8_t size,
+                               bool sext);
+
+  hndlr_kb_t* m_kb = nullptr;
+
+  /// <summary>
+  /// handlers traced fewer than verify_runs times so far...
+  /// </summary>
+  std::unordered_map<hndlr_key_t, hndlr_entry_t, hndlr_key_hash_t> m_entries;
+};
+}  // namespace vm
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <hndlr_cache_t.hpp>
+#include <memory>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// what is known about the vm handlers of an image, shared by every emulator
+/// instance (and thread) working on it... entries are published once, when a
+/// handler becomes trusted or poisoned, and never change or move afterwards,
+/// so lookups take no lock and hold on to entries for as long as the knowledge
+/// base lives. the first publisher of a handler wins, later ones get the
+/// existing entry...
+/// </summary>
+class hndlr_kb_t {
+ public:
+  hndlr_kb_t();
+  ~hndlr_kb_t();
+
+  hndlr_kb_t(const hndlr_kb_t&) = delete;
+  hndlr_kb_t& operator=(const hndlr_kb_t&) = delete;
+
+  /// <summary>
+  /// lookup a handler...
+  /// </summary>
+  /// <param name="key">handler to lookup...</param>
+  /// <returns>trusted or poisoned entry or nullptr if nothing was published
+  /// yet...</returns>
+  const hndlr_entry_t* find(const hndlr_key_t& key) const;
+
+  /// <summary>
+  /// publish a trusted or poisoned handler...
+  /// </summary>
+  /// <param name="profile">handler and its entry...</param>
+  /// <returns>entry of the handler, not necessarily this one if another
+  /// thread was faster...</returns>
+  const hndlr_entry_t* publish(const hndlr_profile_t& profile);
+
+  /// <summary>
+  /// append every trusted handler...
+  /// </summary>
+  /// <param name="profiles">list to append to...</param>
+  void trusted(std::vector<hndlr_profile_t>& profiles) const;
+
+  /// <summary>
+  /// number of published handlers...
+  /// </summary>
+  std::size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+ private:
+  /// <summary>
+  /// a vm usually has a few hundred handlers, the bucket count is fixed so
+  /// that the table never has to be resized under readers...
+  /// </summary>
+  static constexpr auto bucket_cnt = 0x1000u;
+
+  struct node_t {
+    hndlr_key_t key;
+    hndlr_entry_t entry;
+    const node_t* next;
+  };
+
+  std::unique_ptr<std::atomic<const node_t*>[]> m_buckets;
+  std::atomic<std::size_t> m_size = 0u;
+};
+}  // namespace vm
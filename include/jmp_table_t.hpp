@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <vmctx.hpp>
+#include <vmprofiler.hpp>
+
+namespace vm {
+/// <summary>
+/// jump table a virtual jmp takes its target out of... recovered by running
+/// the virtual instructions of the block over a symbolic virtual stack and
+/// virtual registers. the target has to be read from a table indexed by a
+/// virtual register (scaled by a constant shift and added to a constant base)
+/// with nothing but constants and the relocation delta added to the entry
+/// afterwards...
+/// </summary>
+class jmp_table_t {
+ public:
+  /// <summary>
+  /// find the jump table of a block ending in a virtual jmp...
+  /// </summary>
+  /// <param name="vinstrs">virtual instructions of the block...</param>
+  /// <returns>the table or nothing if the target of the virtual jmp does not
+  /// come out of one...</returns>
+  static std::optional<jmp_table_t> find(
+      const std::vector<vm::instrs::vinstr_t>& vinstrs);
+
+  /// <summary>
+  /// read the targets out of the table... entries are read in order until one
+  /// leaves the image or does not point into an executable section, targets
+  /// seen before are skipped...
+  /// </summary>
+  /// <param name="vm">vm of the block, the table is read from its
+  /// image...</param>
+  /// <param name="max">maximum number of entries to read...</param>
+  /// <returns>module based targets...</returns>
+  std::vector<std::uintptr_t> targets(const vm::vmctx_t& vm,
+                                      std::size_t max) const;
+
+ private:
+  /// <summary>
+  /// address of the first entry and bytes between entries... the base is
+  /// either image based (the bytecode adds the relocation delta to it) or
+  /// already module based...
+  /// </summary>
+  std::uint64_t m_base = 0ull, m_stride = 0ull;
+
+  /// <summary>
+  /// constant added to every entry...
+  /// </summary>
+  std::uint64_t m_adjust = 0ull;
+
+  /// <summary>
+  /// size of an entry in bytes, 4 or 8...
+  /// </summary>
+  std::uint8_t m_size = 8u;
+
+  /// <summary>
+  /// entries are image based, the relocation delta is added to them...
+  /// </summary>
+  bool m_rebased = false;
+};
+}  // namespace vm
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// messages below this level are compiled out... 0 (trace) keeps everything
+// and leaves it to the runtime level, see vm::logger_t::level...
+#ifndef VMEMU_LOG_LEVEL
+#define VMEMU_LOG_LEVEL 0
+#endif
+
+// the arguments are only evaluated and formatted if the level is enabled...
+#define VMEMU_LOG(lvl, ...)                                     \
+  do {                                                          \
+    if (static_cast<int>(lvl) >= VMEMU_LOG_LEVEL &&             \
+        vm::logger_t::enabled(lvl))                             \
+      vm::logger_t::get().write(lvl, __VA_ARGS__);              \
+  } while (0)
+
+// lets gcc and clang check the format of a message against its arguments,
+// msvc has no equivalent for functions of its own...
+#if defined(__GNUC__) || defined(__clang__)
+#define VMEMU_PRINTF_FMT(fmt_idx, arg_idx) \
+  __attribute__((format(printf, fmt_idx, arg_idx)))
+#else
+#define VMEMU_PRINTF_FMT(fmt_idx, arg_idx)
+#endif
+
+#define VMEMU_TRACE(...) VMEMU_LOG(vm::log_level_t::trace, __VA_ARGS__)
+#define VMEMU_DEBUG(...) VMEMU_LOG(vm::log_level_t::debug, __VA_ARGS__)
+#define VMEMU_INFO(...) VMEMU_LOG(vm::log_level_t::info, __VA_ARGS__)
+#define VMEMU_WARN(...) VMEMU_LOG(vm::log_level_t::warn, __VA_ARGS__)
+#define VMEMU_ERROR(...) VMEMU_LOG(vm::log_level_t::error, __VA_ARGS__)
+
+namespace vm {
+enum class log_level_t : std::uint8_t { trace, debug, info, warn, error, off };
+
+/// <summary>
+/// process wide logger... messages are formatted into a buffer owned by the
+/// calling thread and written to stdout by a background thread, so emulating
+/// threads never block on the terminal and lines of different threads never
+/// interleave... warnings and errors wake the flusher right away, everything
+/// else is written at most flush_interval later...
+/// </summary>
+class logger_t {
+ public:
+  static constexpr auto flush_interval = std::chrono::milliseconds(20);
+
+  /// <summary>
+  /// the logger, the flusher thread is started the first time...
+  /// </summary>
+  static logger_t& get();
+
+  /// <summary>
+  /// returns true if messages of this level are written... a single relaxed
+  /// load, this is all a disabled message costs...
+  /// </summary>
+  static bool enabled(log_level_t lvl) {
+    return lvl >= s_level.load(std::memory_order_relaxed);
+  }
+
+  /// <summary>
+  /// set the runtime level, messages below it are dropped...
+  /// </summary>
+  static void level(log_level_t lvl) { s_level = lvl; }
+  static log_level_t level() { return s_level; }
+
+  /// <summary>
+  /// parse a level name (trace, debug, info, warn, error, off)...
+  /// </summary>
+  /// <param name="name">name of the level...</param>
+  /// <param name="lvl">parsed level...</param>
+  /// <returns>returns false if the name is unknown...</returns>
+  static bool parse(const std::string& name, log_level_t& lvl);
+
+  ~logger_t();
+
+  logger_t(const logger_t&) = delete;
+  logger_t& operator=(const logger_t&) = delete;
+
+  /// <summary>
+  /// format a message into the buffer of the calling thread... use the
+  /// VMEMU_* macros instead so disabled messages are never formatted...
+  /// </summary>
+  /// <param name="lvl">level of the message...</param>
+  /// <param name="fmt">printf style format...</param>
+  void write(log_level_t lvl, const char* fmt, ...) VMEMU_PRINTF_FMT(3, 4);
+
+  /// <summary>
+  /// write out everything buffered by every thread before returning... for
+  /// anything printing to stdout directly afterwards...
+  /// </summary>
+  void flush();
+
+ private:
+  /// <summary>
+  /// messages of a single thread not yet written...
+  /// </summary>
+  struct thread_buf_t {
+    std::mutex lock;
+    std::string data;
+  };
+
+  logger_t();
+  thread_buf_t& local();
+  void drain();
+  void flusher();
+
+  static inline std::atomic<log_level_t> s_level{log_level_t::info};
+
+  /// <summary>
+  /// buffers of every thread that ever logged... buffers of threads which
+  /// exited are dropped once drained...
+  /// </summary>
+  std::vector<std::shared_ptr<thread_buf_t>> m_bufs;
+  std::mutex m_bufs_lock, m_drain_lock;
+
+  std::condition_variable m_wake;
+  bool m_urgent = false, m_stop = false;
+  std::thread m_flusher;
+};
+}  // namespace vm
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace vm {
+/// <summary>
+/// read only memory mapping of a file on disk...
+/// </summary>
+class mapped_file_t {
+ public:
+  mapped_file_t() = default;
+  ~mapped_file_t();
+
+  mapped_file_t(const mapped_file_t&) = delete;
+  mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+  /// <summary>
+  /// map a file into memory...
+  /// </summary>
+  /// <param name="path">path of the file...</param>
+  /// <returns>returns true if the file was mapped...</returns>
+  bool open(const std::string& path);
+
+  /// <summary>
+  /// unmap the file...
+  /// </summary>
+  void close();
+
+  const std::uint8_t* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+
+ private:
+  const std::uint8_t* m_data = nullptr;
+  std::size_t m_size = 0u;
+
+#ifdef _WIN32
+  void *m_file = nullptr, *m_mapping = nullptr;
+#endif
+};
+}  // namespace vm
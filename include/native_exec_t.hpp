@@ -0,0 +1,151 @@
+#pragma once
+#include <unicorn/unicorn.h>
+
+#include <cstdint>
+#include <decode_cache_t.hpp>
+#include <hndlr_cache_t.hpp>
+#include <stack_snapshot_t.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// how trusted vm handlers are executed...
+/// </summary>
+enum class native_mode_t : std::uint8_t {
+  /// <summary>
+  /// always run vm handlers in unicorn-engine...
+  /// </summary>
+  off,
+
+  /// <summary>
+  /// run trusted vm handlers on the host, see native_exec_t...
+  /// </summary>
+  native,
+
+  /// <summary>
+  /// run trusted vm handlers on the host and in unicorn-engine and compare the
+  /// results... only unicorn-engine's result is kept...
+  /// </summary>
+  cross_check
+};
+
+/// <summary>
+/// native instructions of a trusted vm handler in the order they execute...
+/// </summary>
+struct native_prog_t {
+  std::vector<std::pair<std::uintptr_t, const zydis_decoded_instr_t*>> instrs;
+
+  /// <summary>
+  /// false if the handler uses an instruction native_exec_t does not model...
+  /// </summary>
+  bool supported;
+};
+
+/// <summary>
+/// host side interpreter for trusted vm handlers... a vm handler is a straight
+/// line of native instructions that only move VIP, VSP and the rolling key
+/// around, so replaying the recorded trace of it over a host copy of the
+/// general purpose registers is enough to produce its effect without going
+/// through unicorn-engine for every single junk instruction...
+///
+/// only instructions whose result does not depend on rflags are modeled. a
+/// handler which contains anything else (jcc, adc, pushfq, mul, ...) is left
+/// to unicorn-engine. rflags are not computed, a handler run on the host
+/// leaves them as they were before it...
+///
+/// memory writes are buffered until commit so a run can be thrown away (or
+/// compared against unicorn-engine) without having touched the engine...
+/// </summary>
+class native_exec_t {
+ public:
+  /// <summary>
+  /// bind to an engine...
+  /// </summary>
+  /// <param name="uc">unicorn-engine registers and memory are taken from...</param>
+  /// <param name="decoder">decoded native instructions of the image...</param>
+  void init(uc_engine* uc, decode_cache_t* decoder);
+
+  /// <summary>
+  /// get the program of a trusted handler, it is built the first time...
+  /// </summary>
+  /// <param name="entry">trusted vm handler...</param>
+  /// <returns>program or nullptr if the handler cannot run on the host...</returns>
+  const native_prog_t* prog(const hndlr_entry_t& entry);
+
+  /// <summary>
+  /// never run a handler on the host again...
+  /// </summary>
+  /// <param name="entry">vm handler...</param>
+  void reject(const hndlr_entry_t& entry);
+
+  /// <summary>
+  /// run a handler on the host starting from the current state of the
+  /// engine... nothing is written back to the engine...
+  /// </summary>
+  /// <param name="prog">program of the handler...</param>
+  /// <param name="entry">trusted vm handler...</param>
+  /// <param name="imm">value of entry.imm.reg at entry.imm.addr...</param>
+  /// <returns>returns false if the handler could not be run or never got to
+  /// entry.imm.addr...</returns>
+  bool run(const native_prog_t& prog, const hndlr_entry_t& entry,
+           std::uint64_t& imm);
+
+  /// <summary>
+  /// write the registers, memory and rip of the last run to the engine...
+  /// </summary>
+  /// <param name="stack">stack writes have to be tracked...</param>
+  void commit(stack_tracker_t& stack);
+
+  /// <summary>
+  /// compare the last run against the engine...
+  /// </summary>
+  /// <param name="rip">address the engine is about to execute...</param>
+  /// <returns>returns true if registers, memory and rip match...</returns>
+  bool check(std::uintptr_t rip);
+
+ private:
+  struct write_t {
+    std::uintptr_t addr;
+    std::uint8_t size;
+    std::uint64_t val;
+  };
+
+  bool step(std::uintptr_t addr, const zydis_decoded_instr_t& instr);
+
+  bool get_reg(zydis_reg_t reg, std::uint64_t& val) const;
+  bool set_reg(zydis_reg_t reg, std::uint64_t val);
+
+  std::uintptr_t ea(std::uintptr_t addr, const zydis_decoded_instr_t& instr,
+                    const zydis_decoded_operand_t& op) const;
+
+  bool read_op(std::uintptr_t addr, const zydis_decoded_instr_t& instr,
+               const zydis_decoded_operand_t& op, std::uint64_t& val);
+  bool write_op(std::uintptr_t addr, const zydis_decoded_instr_t& instr,
+                const zydis_decoded_operand_t& op, std::uint64_t val);
+
+  bool read(std::uintptr_t addr, std::uint8_t size, std::uint64_t& val);
+  bool write(std::uintptr_t addr, std::uint8_t size, std::uint64_t val);
+
+  bool push(std::uint8_t size, std::uint64_t val);
+  bool pop(std::uint8_t size, std::uint64_t& val);
+
+  static bool supported(const zydis_decoded_instr_t& instr);
+
+  uc_engine* m_uc = nullptr;
+  decode_cache_t* m_decoder = nullptr;
+
+  /// <summary>
+  /// general purpose registers in zydis order (rax, rcx, rdx, rbx, rsp...)...
+  /// </summary>
+  std::uint64_t m_regs[16];
+  std::uintptr_t m_rip;
+
+  /// <summary>
+  /// memory written by the last run in program order...
+  /// </summary>
+  std::vector<write_t> m_writes;
+
+  std::unordered_map<const hndlr_entry_t*, native_prog_t> m_progs;
+};
+}  // namespace vm
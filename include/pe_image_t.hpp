@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <linuxpe>
+#include <mapped_file_t.hpp>
+#include <string>
+#include <thread_pool_t.hpp>
+
+namespace vm {
+/// <summary>
+/// a 64bit pe file loaded and relocated into host memory... the file is
+/// mapped instead of read, sections are copied straight out of the file
+/// mapping and relocations are applied per reloc block, both on a thread pool
+/// if one is given...
+///
+/// the image is built in shareable memory (a memfd on linux, a pagefile
+/// backed section on windows) so that every emulator can map a private copy
+/// on write view of it into unicorn-engine with uc_mem_map_ptr... a view
+/// costs nothing but the pages the emulated code writes to, and those writes
+/// never reach the image other emulators or the decode cache see...
+/// </summary>
+class pe_image_t {
+ public:
+  pe_image_t() = default;
+  ~pe_image_t();
+
+  pe_image_t(const pe_image_t&) = delete;
+  pe_image_t& operator=(const pe_image_t&) = delete;
+
+  /// <summary>
+  /// map, load and relocate a pe file...
+  /// </summary>
+  /// <param name="path">path of the pe file...</param>
+  /// <param name="pool">optional pool to load sections and apply relocations
+  /// on...</param>
+  /// <returns>returns true if the image was loaded...</returns>
+  bool load(const std::string& path, thread_pool_t* pool = nullptr);
+
+  /// <summary>
+  /// free the image... views must be unmapped before...
+  /// </summary>
+  void unload();
+
+  /// <summary>
+  /// map a private copy on write view of the image...
+  /// </summary>
+  /// <returns>page aligned view or nullptr...</returns>
+  void* map_view() const;
+
+  /// <summary>
+  /// unmap a view returned by map_view...
+  /// </summary>
+  /// <param name="view">view to unmap...</param>
+  void unmap_view(void* view) const;
+
+  /// <summary>
+  /// host address of the relocated image...
+  /// </summary>
+  std::uintptr_t module_base() const {
+    return reinterpret_cast<std::uintptr_t>(m_image);
+  }
+
+  std::uintptr_t image_base() const { return m_image_base; }
+  std::uint32_t image_size() const { return m_image_size; }
+
+  /// <summary>
+  /// size of the image rounded up to a page...
+  /// </summary>
+  std::size_t map_size() const { return m_map_size; }
+
+  /// <summary>
+  /// the pe file as it is on disk...
+  /// </summary>
+  const mapped_file_t& file() const { return m_file; }
+
+ private:
+  bool map_sections(thread_pool_t* pool);
+  void relocate(thread_pool_t* pool);
+
+  mapped_file_t m_file;
+  std::uint8_t* m_image = nullptr;
+  std::uintptr_t m_image_base = 0ull;
+  std::uint32_t m_image_size = 0u;
+  std::size_t m_map_size = 0u;
+
+#ifdef _WIN32
+  void* m_section = nullptr;
+#else
+  int m_fd = -1;
+#endif
+};
+}  // namespace vm
@@ -0,0 +1,232 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vmprofiler.hpp>
+
+namespace vm {
+/// <summary>
+/// on disk layout of emulated virtual routines... every structure is naturally
+/// aligned and referenced by its offset from the start of the file so a reader
+/// can map the file and walk it in place. blocks are written as they are
+/// emulated and the tables describing them follow at the end:
+///
+/// hdr_t
+/// per block: vinstr_t[vinstr_cnt], u64 branches[branch_cnt]
+/// per routine: blk_t[blk_cnt]
+/// rtn_t[rtn_cnt]
+///
+/// branch targets and vip's are image based (not module based) addresses...
+/// mnemonics and branch types are the vmprofiler enum values, the version has
+/// to be bumped whenever those change...
+/// </summary>
+namespace file {
+constexpr std::uint32_t magic = 'V' | 'R' << 8 | 'T' << 16 | 'N' << 24;
+constexpr std::uint16_t version = 1;
+
+struct hdr_t {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint16_t hdr_size;
+  std::uint64_t image_base;
+  std::uint32_t rtn_cnt;
+  std::uint32_t reserved;
+  std::uint64_t rtn_tbl;
+};
+
+struct rtn_t {
+  std::uint32_t rva;
+  std::uint32_t blk_cnt;
+  std::uint64_t blk_tbl;
+};
+
+struct blk_t {
+  std::uint64_t vip;
+  std::uint64_t vinstr_tbl;
+  std::uint64_t branch_tbl;
+  std::uint32_t vinstr_cnt;
+  std::uint8_t branch_type;
+  std::uint8_t branch_cnt;
+  std::uint8_t reserved[2];
+};
+
+struct vinstr_t {
+  std::uint64_t imm;
+  std::uint8_t mnemonic;
+  std::uint8_t imm_size;
+  std::uint8_t has_imm;
+  std::uint8_t reserved[5];
+};
+
+static_assert(sizeof(hdr_t) == 32 && sizeof(rtn_t) == 16 &&
+                  sizeof(blk_t) == 32 && sizeof(vinstr_t) == 16,
+              "vm::file structures must not change size...");
+}  // namespace file
+
+/// <summary>
+/// writes virtual routines into a file... blocks can be added one at a time as
+/// they are emulated so nothing but the (small) block tables of the open
+/// routines are held in memory. several routines can be open at once and the
+/// writer can be used from multiple threads...
+/// </summary>
+class rtn_writer_t {
+ public:
+  using rtn_id_t = std::size_t;
+
+  /// <summary>
+  /// create the file and write a placeholder header...
+  /// </summary>
+  /// <param name="path">path of the file...</param>
+  /// <param name="module_base">address the image is loaded at...</param>
+  /// <param name="image_base">preferred image base of the image...</param>
+  /// <returns>returns true if the file was created...</returns>
+  bool open(const std::string& path, std::uintptr_t module_base,
+            std::uintptr_t image_base);
+
+  /// <summary>
+  /// write into memory instead of a file, the buffer holds the same bytes the
+  /// file would once close() returns...
+  /// </summary>
+  /// <param name="buffer">buffer to write into, kept until close()...</param>
+  /// <param name="module_base">address the image is loaded at...</param>
+  /// <param name="image_base">preferred image base of the image...</param>
+  /// <returns>returns true...</returns>
+  bool open(std::vector<std::uint8_t>& buffer, std::uintptr_t module_base,
+            std::uintptr_t image_base);
+
+  /// <summary>
+  /// open a new virtual routine...
+  /// </summary>
+  /// <param name="rva">rva of the vm entry of the routine...</param>
+  /// <returns>id of the routine used to add blocks to it...</returns>
+  rtn_id_t begin_rtn(std::uint32_t rva);
+
+  /// <summary>
+  /// write a block of an open virtual routine...
+  /// </summary>
+  /// <param name="rtn">id returned by begin_rtn...</param>
+  /// <param name="blk">block to write...</param>
+  void add_blk(rtn_id_t rtn, const vm::instrs::vblk_t& blk);
+
+  /// <summary>
+  /// write the block table of an open virtual routine and close it...
+  /// </summary>
+  /// <param name="rtn">id returned by begin_rtn...</param>
+  void end_rtn(rtn_id_t rtn);
+
+  /// <summary>
+  /// write an entire virtual routine...
+  /// </summary>
+  /// <param name="rtn">routine to write...</param>
+  void add_rtn(const vm::instrs::vrtn_t& rtn);
+
+  /// <summary>
+  /// write the routine table and the final header... routines which are still
+  /// open are dropped...
+  /// </summary>
+  /// <returns>returns true if every write succeeded...</returns>
+  bool close();
+
+  /// <summary>
+  /// path of the file the writer was opened on, empty if it writes into
+  /// memory...
+  /// </summary>
+  const std::string& path() const { return m_path; }
+
+ private:
+  void reset(std::uintptr_t module_base, std::uintptr_t image_base);
+  void write(const void* data, std::size_t size);
+
+  std::mutex m_lock;
+  std::ofstream m_file;
+  std::string m_path;
+  std::vector<std::uint8_t>* m_buffer = nullptr;
+  std::uint64_t m_offset = 0u;
+  std::uintptr_t m_module_base = 0u, m_image_base = 0u;
+
+  /// <summary>
+  /// routine entry and block table of every open routine...
+  /// </summary>
+  struct open_rtn_t {
+    file::rtn_t rtn;
+    std::vector<file::blk_t> blks;
+  };
+
+  rtn_id_t m_next_id = 0u;
+  std::unordered_map<rtn_id_t, open_rtn_t> m_open;
+  std::vector<file::rtn_t> m_rtns;
+
+  /// <summary>
+  /// scratch buffers used to convert a block...
+  /// </summary>
+  std::vector<file::vinstr_t> m_vinstrs;
+  std::vector<std::uint64_t> m_branches;
+};
+
+/// <summary>
+/// view over the bytes of a file written by rtn_writer_t... nothing is copied
+/// or allocated, accessors hand out spans into the file after bounds checking
+/// them...
+/// </summary>
+class rtn_file_t {
+ public:
+  /// <summary>
+  /// validate the header and routine table of a file...
+  /// </summary>
+  /// <param name="data">contents of the file, usually mapped...</param>
+  /// <param name="size">size of the file...</param>
+  /// <returns>returns true if the file is a supported routine file...</returns>
+  bool init(const std::uint8_t* data, std::size_t size);
+
+  const file::hdr_t& hdr() const { return *m_hdr; }
+
+  /// <summary>
+  /// every routine in the file...
+  /// </summary>
+  std::span<const file::rtn_t> rtns() const { return m_rtns; }
+
+  /// <summary>
+  /// blocks of a routine... empty if the routine is malformed...
+  /// </summary>
+  std::span<const file::blk_t> blks(const file::rtn_t& rtn) const;
+
+  /// <summary>
+  /// virtual instructions of a block... empty if the block is malformed...
+  /// </summary>
+  std::span<const file::vinstr_t> vinstrs(const file::blk_t& blk) const;
+
+  /// <summary>
+  /// image based branch targets of a block... empty if the block is
+  /// malformed...
+  /// </summary>
+  std::span<const std::uint64_t> branches(const file::blk_t& blk) const;
+
+  /// <summary>
+  /// convert a routine back into its vmprofiler representation...
+  /// </summary>
+  /// <param name="rtn">routine to convert...</param>
+  /// <param name="module_base">address the image is loaded at...</param>
+  /// <param name="vrtn">routine to fill...</param>
+  void to_vrtn(const file::rtn_t& rtn, std::uintptr_t module_base,
+               vm::instrs::vrtn_t& vrtn) const;
+
+ private:
+  template <class T>
+  std::span<const T> table(std::uint64_t offset, std::uint64_t cnt) const {
+    if (offset % alignof(T) || offset > m_size ||
+        cnt > (m_size - offset) / sizeof(T))
+      return {};
+
+    return {reinterpret_cast<const T*>(m_data + offset), cnt};
+  }
+
+  const std::uint8_t* m_data = nullptr;
+  std::size_t m_size = 0u;
+  const file::hdr_t* m_hdr = nullptr;
+  std::span<const file::rtn_t> m_rtns;
+};
+}  // namespace vm
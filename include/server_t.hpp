@@ -0,0 +1,112 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread_pool_t.hpp>
+#include <unordered_map>
+#include <vector>
+#include <vmemu_t.hpp>
+
+namespace vm {
+/// <summary>
+/// protocol spoken over the socket of server_t... every message, in either
+/// direction, is a u32 length followed by that many bytes. integers are in
+/// host byte order (little endian on every supported host):
+///
+/// load      u8 op, path of the binary          u8 reply, u32 image id
+/// emulate   u8 op, u32 image id, u32 rva       u8 reply, u8 emu_status_t,
+///                                              routine file (reply ok only)
+/// unload    u8 op, u32 image id                u8 reply
+///
+/// the routine file is what rtn_writer_t writes for the single routine of the
+/// vm entry, read it with rtn_file_t... loading a binary which is already
+/// loaded returns the id it was given before. a connection can send any
+/// number of requests, each is answered before the next is read...
+/// </summary>
+namespace serve {
+constexpr std::uint32_t max_request = 0x10000;
+
+// connections served at once, any more are closed as soon as accepted...
+constexpr std::size_t max_conns = 64u;
+
+enum class op_t : std::uint8_t { load = 1, emulate, unload };
+
+enum class reply_t : std::uint8_t {
+  ok,
+  malformed,
+  unknown_image,
+  load_failed,
+  emu_failed
+};
+}  // namespace serve
+
+/// <summary>
+/// daemon which keeps relocated images, their decoded instructions, profiled
+/// vm handlers and warm engines resident between requests, so a request only
+/// pays for emulation... every connection is served by a thread of its own,
+/// up to serve::max_conns of them at once. emulation runs on the thread pool
+/// with one engine per worker and image. routines already emulated are
+/// answered from memory...
+/// </summary>
+class server_t {
+ public:
+  /// <summary>
+  /// create a server...
+  /// </summary>
+  /// <param name="cfg">configuration of every engine, image, decode cache,
+  /// knowledge base and profiles are filled in per binary... cancel stops the
+  /// server...</param>
+  /// <param name="pool">pool vm entries are emulated on...</param>
+  server_t(const emu_cfg_t& cfg, thread_pool_t& pool);
+
+  /// <summary>
+  /// cache emulated vm entries and profiled vm handlers of every binary in
+  /// this directory, see analysis_cache_t...
+  /// </summary>
+  /// <param name="dir">root directory of the cache...</param>
+  void cache(const std::string& dir) { m_cache_dir = dir; }
+
+  /// <summary>
+  /// listen on a unix domain socket and serve requests until
+  /// emu_cfg_t::cancel is set... the socket is only accessible to the user
+  /// running the server. not supported on windows...
+  /// </summary>
+  /// <param name="path">path of the socket, a socket nobody listens on is
+  /// replaced, any other file is not...</param>
+  /// <returns>returns false if the socket could not be created...</returns>
+  bool run(const std::string& path);
+
+ private:
+  struct image_t;
+
+  void serve(int fd);
+  void handle(const std::vector<std::uint8_t>& request,
+              std::vector<std::uint8_t>& reply);
+
+  void load(const std::string& path, std::vector<std::uint8_t>& reply);
+  void emulate(std::uint32_t id, std::uint32_t rva,
+               std::vector<std::uint8_t>& reply);
+  void unload(std::uint32_t id, std::vector<std::uint8_t>& reply);
+
+  std::shared_ptr<image_t> find(std::uint32_t id);
+  void store_hndlrs(image_t& image) const;
+  bool stopped() const;
+
+  emu_cfg_t m_cfg;
+  thread_pool_t& m_pool;
+  std::string m_cache_dir;
+
+  std::mutex m_lock;
+  std::unordered_map<std::uint32_t, std::shared_ptr<image_t>> m_images;
+  std::uint32_t m_next_id = 1u;
+
+  /// <summary>
+  /// connections still being served, run() waits for them before it
+  /// returns...
+  /// </summary>
+  std::size_t m_conns = 0u;
+  std::condition_variable m_conns_cv;
+};
+}  // namespace vm
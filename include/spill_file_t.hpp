@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace vm {
+/// <summary>
+/// anonymous temporary file data can be moved out of memory into... the file
+/// is created on first use and deleted by the os once closed. space is only
+/// given back by clear...
+/// </summary>
+class spill_file_t {
+ public:
+  spill_file_t() = default;
+  ~spill_file_t();
+
+  spill_file_t(const spill_file_t&) = delete;
+  spill_file_t& operator=(const spill_file_t&) = delete;
+
+  /// <summary>
+  /// append data to the file...
+  /// </summary>
+  /// <param name="data">data to write...</param>
+  /// <param name="size">number of bytes to write...</param>
+  /// <param name="offset">offset the data was written at...</param>
+  /// <returns>returns true if the data was written...</returns>
+  bool write(const void* data, std::size_t size, std::uint64_t& offset);
+
+  /// <summary>
+  /// read back data written before...
+  /// </summary>
+  /// <param name="offset">offset returned by write...</param>
+  /// <param name="data">buffer to read into...</param>
+  /// <param name="size">number of bytes to read...</param>
+  /// <returns>returns true if the data was read...</returns>
+  bool read(std::uint64_t offset, void* data, std::size_t size);
+
+  /// <summary>
+  /// forget everything written so far, the space is reused from the start...
+  /// </summary>
+  void clear() { m_size = 0ull; }
+
+  /// <summary>
+  /// bytes written since the last clear...
+  /// </summary>
+  std::uint64_t size() const { return m_size; }
+
+ private:
+  bool seek(std::uint64_t offset);
+
+  std::FILE* m_file = nullptr;
+  std::uint64_t m_size = 0ull;
+};
+}  // namespace vm
@@ -0,0 +1,170 @@
+#pragma once
+#include <unicorn/unicorn.h>
+
+#include <bitset>
+#include <cstdint>
+#include <emu_stats_t.hpp>
+#include <memory>
+#include <spill_file_t.hpp>
+#include <vector>
+
+#define PAGE_4KB 0x1000
+#define STACK_SIZE PAGE_4KB * 512
+#define STACK_BASE 0xFFFF000000000000
+#define STACK_PAGE_CNT ((STACK_SIZE) / PAGE_4KB)
+
+namespace vm {
+/// <summary>
+/// sparse copy of the emulated stack... only the pages which have been written
+/// to since the stack was mapped are kept, every other page is known to still
+/// be zero...
+/// </summary>
+class stack_snapshot_t {
+  friend class stack_tracker_t;
+
+ public:
+  /// <summary>
+  /// number of bytes of stack memory held by the snapshot... zero while it is
+  /// spilled...
+  /// </summary>
+  std::size_t size() const { return m_data.size(); }
+
+  /// <summary>
+  /// returns true if the snapshot holds no pages (entire stack is zero)...
+  /// </summary>
+  bool empty() const { return m_present.none(); }
+
+  /// <summary>
+  /// drop all pages but keep the allocation around for the next snapshot...
+  /// </summary>
+  void clear() {
+    m_present.reset();
+    m_data.clear();
+    m_spilled = false;
+  }
+
+  /// <summary>
+  /// move the pages of the snapshot into a spill file and free their
+  /// memory... a spilled snapshot has to be loaded before it is restored...
+  /// </summary>
+  /// <param name="file">file to spill to...</param>
+  /// <returns>returns true if the snapshot was spilled...</returns>
+  bool spill(spill_file_t& file);
+
+  /// <summary>
+  /// read the pages of a spilled snapshot back into memory...
+  /// </summary>
+  /// <param name="file">file the snapshot was spilled to...</param>
+  /// <returns>returns true if the snapshot is in memory...</returns>
+  bool load(spill_file_t& file);
+
+  bool spilled() const { return m_spilled; }
+
+ private:
+  /// <summary>
+  /// pages held by this snapshot, stored in m_data in ascending order...
+  /// </summary>
+  std::bitset<STACK_PAGE_CNT> m_present;
+  std::vector<std::uint8_t> m_data;
+
+  /// <summary>
+  /// where the pages are in the spill file if m_spilled is set...
+  /// </summary>
+  std::uint64_t m_spill_offset = 0ull;
+  bool m_spilled = false;
+};
+
+/// <summary>
+/// tracks which pages of the emulated stack are written to so that the stack
+/// can be snapshot and restored page by page instead of copying all of
+/// STACK_SIZE each time... a host side mirror of the stack is kept up to date
+/// lazily and is what vm handler traces point at...
+/// </summary>
+class stack_tracker_t {
+ public:
+  stack_tracker_t();
+
+  /// <summary>
+  /// installs the write hook over the stack... the stack must already be
+  /// mapped and zeroed...
+  /// </summary>
+  /// <param name="uc">unicorn-engine the stack is mapped in...</param>
+  /// <returns>returns true if the hook was installed...</returns>
+  bool init(uc_engine* uc);
+
+  /// <summary>
+  /// read every page written since the last sync into the mirror... after
+  /// this call the mirror matches the emulated stack...
+  /// </summary>
+  void sync();
+
+  /// <summary>
+  /// host side copy of the entire stack as of the last sync/restore...
+  /// </summary>
+  std::uint8_t* mirror() const { return m_mirror.get(); }
+
+  /// <summary>
+  /// take a snapshot of the stack as of the last sync/restore...
+  /// </summary>
+  /// <param name="snap">snapshot to fill, its allocation is reused...</param>
+  void snapshot(stack_snapshot_t& snap) const;
+
+  /// <summary>
+  /// restore the emulated stack to a snapshot... only pages present in the
+  /// snapshot or written to since init are touched. the mirror is updated as
+  /// well...
+  /// </summary>
+  /// <param name="snap">snapshot to restore...</param>
+  void restore(const stack_snapshot_t& snap);
+
+  /// <summary>
+  /// undo every write to the emulated stack since the last sync/restore, the
+  /// stack is put back to what the mirror holds...
+  /// </summary>
+  void revert();
+
+  /// <summary>
+  /// zero every page written to since init, the stack is as it was right
+  /// after init...
+  /// </summary>
+  void reset();
+
+  /// <summary>
+  /// write to emulated memory from the host... unicorn-engine does not invoke
+  /// memory hooks for uc_mem_write so writes that may land on the stack must
+  /// go through here...
+  /// </summary>
+  /// <param name="addr">address to write to...</param>
+  /// <param name="data">data to write...</param>
+  /// <param name="size">number of bytes to write...</param>
+  /// <returns>unicorn-engine error code...</returns>
+  uc_err write(std::uintptr_t addr, const void* data, std::size_t size);
+
+  /// <summary>
+  /// bytes of stack copied around, see emu_stats_t...
+  /// </summary>
+  const emu_stats_t& stats() const { return m_stats; }
+
+ private:
+  void mark(std::uintptr_t addr, std::size_t size);
+
+  static void mem_write(uc_engine* uc, uc_mem_type type, uint64_t address,
+                        int size, int64_t value, stack_tracker_t* obj);
+
+  uc_engine* m_uc = nullptr;
+  uc_hook m_hook;
+
+  /// <summary>
+  /// pages written to since the last sync/restore...
+  /// </summary>
+  std::bitset<STACK_PAGE_CNT> m_dirty;
+
+  /// <summary>
+  /// pages written to since the stack was mapped...
+  /// </summary>
+  std::bitset<STACK_PAGE_CNT> m_touched;
+
+  std::unique_ptr<std::uint8_t[]> m_mirror;
+  mutable emu_stats_t m_stats;
+};
+}  // namespace vm
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// work stealing thread pool... every worker has its own queue of tasks, idle
+/// workers steal from the other queues so a few long running tasks do not
+/// leave the remaining workers idle...
+/// </summary>
+class thread_pool_t {
+ public:
+  /// <summary>
+  /// a task is given the index of the worker running it so that per worker
+  /// state (such as an emulator instance) can be kept by the caller...
+  /// </summary>
+  using task_t = std::function<void(std::size_t worker_idx)>;
+
+  /// <summary>
+  /// create the pool and start the workers...
+  /// </summary>
+  /// <param name="worker_cnt">number of workers, 0 means one per hardware
+  /// thread...</param>
+  explicit thread_pool_t(std::size_t worker_cnt = 0u);
+
+  /// <summary>
+  /// finishes every queued task and joins the workers...
+  /// </summary>
+  ~thread_pool_t();
+
+  thread_pool_t(const thread_pool_t&) = delete;
+  thread_pool_t& operator=(const thread_pool_t&) = delete;
+
+  /// <summary>
+  /// queue a task... tasks submitted from a worker go to that workers own
+  /// queue, others are spread over all of the queues...
+  /// </summary>
+  /// <param name="task">task to run...</param>
+  void submit(task_t task);
+
+  /// <summary>
+  /// block until every submitted task has finished... must not be called
+  /// from a task...
+  /// </summary>
+  void wait();
+
+  /// <summary>
+  /// number of workers...
+  /// </summary>
+  std::size_t size() const { return m_threads.size(); }
+
+ private:
+  struct queue_t {
+    std::mutex lock;
+    std::deque<task_t> tasks;
+  };
+
+  void run(std::size_t worker_idx);
+  bool pop(std::size_t worker_idx, task_t& task);
+
+  std::vector<std::unique_ptr<queue_t>> m_queues;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_lock;
+  std::condition_variable m_work_cv, m_done_cv;
+  std::atomic<std::size_t> m_queued = 0u, m_pending = 0u, m_next = 0u;
+  bool m_stop = false;
+};
+}  // namespace vm
@@ -2,39 +2,413 @@
 #include <unicorn/unicorn.h>
 
 #include <atomic>
+#include <chrono>
+#include <ctx_pool_t.hpp>
+#include <decode_cache_t.hpp>
+#include <emu_stats_t.hpp>
 #include <functional>
+#include <hndlr_cache_t.hpp>
+#include <hndlr_kb_t.hpp>
+#include <jmp_table_t.hpp>
 #include <linuxpe>
+#include <logger_t.hpp>
+#include <native_exec_t.hpp>
 #include <numeric>
+#include <pe_image_t.hpp>
+#include <stack_snapshot_t.hpp>
 #include <string>
+#include <thread_pool_t.hpp>
+#include <utility>
 #include <vmctx.hpp>
 #include <vmprofiler.hpp>
-
-#define PAGE_4KB 0x1000
-#define STACK_SIZE PAGE_4KB * 512
-#define STACK_BASE 0xFFFF000000000000
+#include <worklist_t.hpp>
 
 namespace vm {
+/// <summary>
+/// optional settings of an emulator instance...
+/// </summary>
+struct emu_cfg_t {
+  /// <summary>
+  /// decode cache of the image to share with other emulator instances... if
+  /// nullptr the emulator creates its own...
+  /// </summary>
+  decode_cache_t* decode_cache = nullptr;
+
+  /// <summary>
+  /// vm handler knowledge base of the image to share with other emulator
+  /// instances... if nullptr the emulator creates its own which only its forks
+  /// share...
+  /// </summary>
+  hndlr_kb_t* hndlr_kb = nullptr;
+
+  /// <summary>
+  /// image loaded by pe_image_t... if set the engine maps a view of it
+  /// instead of copying the image at vm::vmctx_t::m_module_base...
+  /// </summary>
+  const pe_image_t* image = nullptr;
+
+  /// <summary>
+  /// order in which the branches of a routine are emulated...
+  /// </summary>
+  worklist_t::order_t order = worklist_t::order_t::bfs;
+
+  /// <summary>
+  /// validate both targets of a possible virtual jcc at the same time, each on
+  /// its own forked unicorn-engine... the entries of a virtual jump table are
+  /// split between the same two forks...
+  /// </summary>
+  bool parallel_spec = false;
+
+  /// <summary>
+  /// run trusted vm handlers on the host instead of in unicorn-engine...
+  /// </summary>
+  native_mode_t native = native_mode_t::off;
+
+  /// <summary>
+  /// hook basic blocks instead of every native instruction... vm handlers
+  /// which have to be traced are traced on a forked engine, trusted ones have
+  /// their operand computed on the host...
+  /// </summary>
+  bool block_hooks = false;
+
+  /// <summary>
+  /// if not zero the image is not mapped into unicorn-engine up front but in
+  /// chunks of this size (a multiple of 4kb) the first time they are
+  /// accessed...
+  /// </summary>
+  std::uint32_t lazy_chunk = 0u;
+
+  /// <summary>
+  /// if not zero the stack snapshots of virtual jmps still waiting on queued
+  /// branches are kept to about this many bytes of memory, past it they are
+  /// spilled to a temporary file and read back once a branch needs them...
+  /// </summary>
+  std::size_t snapshot_budget = 0u;
+
+  /// <summary>
+  /// if not zero the most native instructions a single vm handler, a single
+  /// virtual code block and a whole routine may take before emulation of the
+  /// routine is given up... speculative execution of a branch that runs out of
+  /// the handler or block budget is not a legit branch. the routine budget
+  /// only counts the routine itself, never speculative execution, whichever
+  /// engine it runs on...
+  /// </summary>
+  std::uint64_t hndlr_budget = 0u, blk_budget = 0u, rtn_budget = 0u;
+
+  /// <summary>
+  /// if not zero the most milliseconds a single emulate call may take...
+  /// </summary>
+  std::uint32_t time_budget = 0u;
+
+  /// <summary>
+  /// optional cancellation token... once set, emulate calls of every engine
+  /// given it stop as soon as their hooks see it...
+  /// </summary>
+  const std::atomic<bool>* cancel = nullptr;
+
+  /// <summary>
+  /// vm handlers profiled before (by an earlier run, see analysis_cache_t)...
+  /// they are added to the knowledge base and trusted from the start...
+  /// </summary>
+  const std::vector<hndlr_profile_t>* profiles = nullptr;
+};
+
+/// <summary>
+/// memory an emulator actually touched...
+/// </summary>
+struct working_set_t {
+  /// <summary>
+  /// image chunks mapped in total and by the last emulate call...
+  /// </summary>
+  std::size_t chunks = 0u, run_chunks = 0u;
+
+  /// <summary>
+  /// unmapped memory accesses of the last emulate call...
+  /// </summary>
+  std::size_t faults = 0u;
+
+  /// <summary>
+  /// pages outside of the image zero filled by the last emulate call...
+  /// </summary>
+  std::size_t zero_pages = 0u;
+};
+
+/// <summary>
+/// how the last emulate call of an engine ended...
+/// </summary>
+enum class emu_status_t : std::uint8_t {
+  ok,
+
+  /// <summary>
+  /// failed for any other reason, see the log...
+  /// </summary>
+  error,
+
+  /// <summary>
+  /// one of the instruction budgets of emu_cfg_t ran out...
+  /// </summary>
+  hndlr_budget,
+  blk_budget,
+  rtn_budget,
+
+  /// <summary>
+  /// emu_cfg_t::time_budget ran out...
+  /// </summary>
+  time_budget,
+
+  /// <summary>
+  /// emu_cfg_t::cancel was set...
+  /// </summary>
+  cancelled
+};
+
 class emu_t {
  public:
-  explicit emu_t(vm::vmctx_t* vm_ctx);
+  /// <summary>
+  /// receives every virtual code block as soon as its branches are known...
+  /// </summary>
+  using blk_sink_t = std::function<void(const vm::instrs::vrtn_t& vrtn,
+                                        const vm::instrs::vblk_t& vblk)>;
+
+  explicit emu_t(vm::vmctx_t* vm_ctx, const emu_cfg_t& cfg = {});
   ~emu_t();
   bool init();
-  bool emulate(std::uint32_t vmenter_rva, vm::instrs::vrtn_t& vrtn);
+
+  /// <summary>
+  /// put the engine back into the state init left it in so that it can
+  /// emulate another routine... cpu, stack and every page of the image written
+  /// to are restored and pages zero filled by invalid_mem are unmapped again.
+  /// profiled vm handlers and lazily mapped image chunks are kept...
+  /// </summary>
+  /// <param name="vm_ctx">optional vm to bind the engine (and its forks) to
+  /// from now on... it has to be of the image the engine was created
+  /// for...</param>
+  /// <returns>returns false if the engine was never initialized or vm_ctx is
+  /// of another image...</returns>
+  bool reset(vm::vmctx_t* vm_ctx = nullptr);
+
+  /// <summary>
+  /// emulate a virtual routine...
+  /// </summary>
+  /// <param name="vmenter_rva">rva of the vm entry of the routine...</param>
+  /// <param name="vrtn">routine to fill...</param>
+  /// <param name="sink">optional consumer of the blocks... if given the
+  /// virtual instructions of a block are released once the sink returns so
+  /// that vrtn only keeps the shape (vip and branches) of the routine and
+  /// memory use does not grow with the size of the routine...</param>
+  /// <returns>returns true if the routine was emulated...</returns>
+  bool emulate(std::uint32_t vmenter_rva, vm::instrs::vrtn_t& vrtn,
+               const blk_sink_t& sink = {});
+
+  /// <summary>
+  /// memory touched by the engine, see emu_cfg_t::lazy_chunk...
+  /// </summary>
+  const working_set_t& working_set() const { return m_ws; }
+
+  /// <summary>
+  /// bytes of virtual jmp stack snapshots held in memory, 0 once emulate
+  /// returns... see emu_cfg_t::snapshot_budget...
+  /// </summary>
+  std::size_t jmp_bytes() const { return m_jmp_bytes; }
+
+  /// <summary>
+  /// performance counters of the engine and its forks summed up... all zero
+  /// unless built with VMEMU_STATS...
+  /// </summary>
+  emu_stats_t stats() const;
+
+  /// <summary>
+  /// how the last emulate call ended... if a budget ran out or emulation was
+  /// cancelled vrtn holds the blocks emulated up until then, the last of them
+  /// cut short...
+  /// </summary>
+  emu_status_t status() const { return m_status; }
+
+  /// <summary>
+  /// name of a status for logs and reports...
+  /// </summary>
+  static const char* status_name(emu_status_t status);
+
+  /// <summary>
+  /// append every vm handler trusted by the knowledge base of the engine...
+  /// </summary>
+  /// <param name="profiles">list to append to...</param>
+  void profiles(std::vector<hndlr_profile_t>& profiles) const;
 
  private:
-  uc_engine* uc;
+  uc_engine* uc = nullptr;
   const vm::vmctx_t* m_vm;
+  emu_cfg_t m_cfg;
+
+  /// <summary>
+  /// view of m_cfg.image mapped into unicorn-engine...
+  /// </summary>
+  void* m_view = nullptr;
+
+  /// <summary>
+  /// decoded native instructions of the image, m_cfg.decode_cache or
+  /// m_own_decoder...
+  /// </summary>
+  decode_cache_t* m_decoder;
+  std::unique_ptr<decode_cache_t> m_own_decoder;
 
   /// <summary>
   /// used in branch_pred_spec_exec to count legit SREG virtual instructions...
   /// </summary>
   std::uint8_t m_sreg_cnt;
 
+  /// <summary>
+  /// how the current or last emulate call ended, see status...
+  /// </summary>
+  emu_status_t m_status = emu_status_t::ok;
+
+  /// <summary>
+  /// end of emu_cfg_t::time_budget for the current emulate call... forks are
+  /// given the one of their parent by fork...
+  /// </summary>
+  std::chrono::steady_clock::time_point m_deadline;
+
+  /// <summary>
+  /// native instructions executed by the current vm handler, virtual code
+  /// block and routine, and since the clock was last checked...
+  /// </summary>
+  std::uint64_t cc_hndlr_instrs = 0u, cc_blk_instrs = 0u, cc_rtn_instrs = 0u;
+  std::uint32_t cc_clock_instrs = 0u;
+
+  /// <summary>
+  /// native instructions between two checks of the clock and the cancellation
+  /// token...
+  /// </summary>
+  static constexpr auto clock_interval = 0x400u;
+
+  /// <summary>
+  /// charge native instructions to the budgets, called from the hooks...
+  /// unicorn-engine is stopped and m_status set once one of them runs out...
+  /// </summary>
+  /// <param name="instrs">native instructions executed...</param>
+  /// <returns>returns false if out of budget...</returns>
+  bool charge(std::uint32_t instrs);
+
+  /// <summary>
+  /// check the deadline and the cancellation token, m_status is set if either
+  /// of them says to stop...
+  /// </summary>
+  /// <returns>returns false if emulation has to stop...</returns>
+  bool in_time();
+
   /// <summary>
   /// current code trace...
   /// </summary>
   vm::instrs::hndlr_trace_t cc_trace;
 
+  /// <summary>
+  /// every cpu context saved for the current code trace... deobfuscate removes
+  /// entries from cc_trace so this is what gets handed back to the pool...
+  /// </summary>
+  std::vector<uc_context*> cc_ctxs;
+
+  /// <summary>
+  /// address of every native instruction executed by the current vm handler...
+  /// </summary>
+  std::vector<std::uintptr_t> cc_addrs;
+
+  /// <summary>
+  /// cache entry of the current vm handler if it is not being traced...
+  /// </summary>
+  const hndlr_entry_t* cc_hndlr = nullptr;
+
+  /// <summary>
+  /// operand of the current vm handler if it is not being traced...
+  /// </summary>
+  std::uint64_t cc_imm = 0ull;
+
+  /// <summary>
+  /// set once cc_imm has been read during the current run of cc_hndlr...
+  /// </summary>
+  bool cc_imm_read = false;
+
+  /// <summary>
+  /// cpu context at the start of cc_hndlr if it has an operand, the handler
+  /// is traced from here if it ends without the operand having been read...
+  /// </summary>
+  uc_context* cc_hndlr_ctx = nullptr;
+
+  /// <summary>
+  /// set while the current vm handler is traced after its cached run missed
+  /// the operand, the cache is not consulted for it...
+  /// </summary>
+  bool cc_uncached = false;
+
+  /// <summary>
+  /// host side interpreter for trusted vm handlers...
+  /// </summary>
+  native_exec_t m_native;
+
+  /// <summary>
+  /// vm handler last run on the host in native_mode_t::cross_check, compared
+  /// against unicorn-engine once the next vm handler starts...
+  /// </summary>
+  const hndlr_entry_t* cc_native = nullptr;
+
+  /// <summary>
+  /// operand of cc_native as read by the host run...
+  /// </summary>
+  std::uint64_t cc_native_imm = 0ull;
+
+  /// <summary>
+  /// vm handlers trusted or poisoned so far, m_cfg.hndlr_kb or
+  /// m_own_hndlr_kb...
+  /// </summary>
+  hndlr_kb_t* m_hndlr_kb;
+  std::unique_ptr<hndlr_kb_t> m_own_hndlr_kb;
+
+  /// <summary>
+  /// vm handlers being profiled...
+  /// </summary>
+  hndlr_cache_t m_hndlr_cache;
+
+  /// <summary>
+  /// pool of reusable cpu contexts...
+  /// </summary>
+  ctx_pool_t m_ctx_pool;
+
+  /// <summary>
+  /// dirty page tracking of the emulated stack...
+  /// </summary>
+  stack_tracker_t m_stack;
+
+  /// <summary>
+  /// stack of each virtual code block's virtual jmp handler, indexed the same
+  /// way as cc_vrtn->m_blks... a snapshot (and the cpu context of the jmp) is
+  /// released as soon as the last branch queued from its block was started,
+  /// see release_jmp...
+  /// </summary>
+  std::vector<stack_snapshot_t> m_jmp_stacks;
+
+  /// <summary>
+  /// number of queued branches of each block which still need its virtual
+  /// jmp...
+  /// </summary>
+  std::vector<std::uint32_t> m_jmp_refs;
+
+  /// <summary>
+  /// bytes of m_jmp_stacks in memory and the file the rest is spilled to, see
+  /// emu_cfg_t::snapshot_budget... every snapshot taken adds to it and is
+  /// subtracted again when it is spilled or released...
+  /// </summary>
+  std::size_t m_jmp_bytes = 0u;
+  spill_file_t m_spill;
+
+  /// <summary>
+  /// branches of the current routine that are yet to be emulated...
+  /// </summary>
+  worklist_t m_worklist;
+
+  /// <summary>
+  /// scratch snapshot used by legit_branch to backup the stack...
+  /// </summary>
+  stack_snapshot_t m_spec_stack;
+
   /// <summary>
   /// current virtual code block...
   /// block...
@@ -47,9 +421,39 @@ class emu_t {
   vm::instrs::vrtn_t* cc_vrtn;
 
   /// <summary>
-  /// unicorn engine hook
+  /// what the code hook does with the native instructions it sees...
+  /// </summary>
+  enum class mode_t : std::uint8_t {
+    /// <summary>
+    /// trace and profile vm handlers of the routine being emulated...
+    /// </summary>
+    trace,
+
+    /// <summary>
+    /// branch prediction, see branch_pred_spec_exec...
+    /// </summary>
+    speculative
+  };
+
+  mode_t m_mode = mode_t::trace;
+
+  /// <summary>
+  /// unicorn engine hook... code_exec_hook is added once and stays for the
+  /// lifetime of the engine since adding or removing hooks throws away
+  /// unicorn-engine's translated blocks...
+  /// </summary>
+  uc_hook code_exec_hook, invalid_mem_hook, int_hook;
+
+  /// <summary>
+  /// the one code hook of the engine, dispatches on m_mode...
   /// </summary>
-  uc_hook code_exec_hook, invalid_mem_hook, int_hook, branch_pred_hook;
+  /// <param name="uc"></param>
+  /// <param name="address"></param>
+  /// <param name="size"></param>
+  /// <param name="obj"></param>
+  /// <returns></returns>
+  static bool code_callback(uc_engine* uc, uint64_t address, uint32_t size,
+                            emu_t* obj);
 
   /// <summary>
   /// code execution callback for executable memory ranges of the vmprotect'ed
@@ -80,7 +484,7 @@ class emu_t {
   /// <summary>
   /// invalid memory access handler. no runtime values can possibly effect the
   /// decryption of virtual instructions. thus invalid memory accesses can be
-  /// ignored entirely...
+  /// ignored entirely... the image itself is mapped in here in lazy mode...
   /// </summary>
   /// <param name="uc">uc engine context pointer...</param>
   /// <param name="type">type of memory access...</param>
@@ -88,7 +492,56 @@ class emu_t {
   /// <param name="size">size of the memory access...</param>
   /// <param name="value">value being read...</param>
   /// <param name="obj">emu_t object pointer...</param>
-  static void invalid_mem(uc_engine* uc, uc_mem_type type, uint64_t address,
+  /// <returns>returns true if the access can be retried...</returns>
+  static bool invalid_mem(uc_engine* uc, uc_mem_type type, uint64_t address,
+                          int size, int64_t value, emu_t* obj);
+
+  /// <summary>
+  /// map the image chunk of an address...
+  /// </summary>
+  /// <param name="address">address inside of the image...</param>
+  /// <returns>returns false if the address is outside of the image or the
+  /// chunk could not be mapped...</returns>
+  bool map_chunk(std::uintptr_t address);
+
+  /// <summary>
+  /// is the address inside of the image as mapped into unicorn-engine...
+  /// </summary>
+  bool in_image(std::uintptr_t address) const;
+
+  /// <summary>
+  /// size of the image as mapped into unicorn-engine...
+  /// </summary>
+  std::size_t image_map_size() const;
+
+  /// <summary>
+  /// image chunks mapped so far in lazy mode...
+  /// </summary>
+  std::vector<bool> m_chunks;
+
+  working_set_t m_ws;
+  emu_stats_t m_stats;
+
+  /// <summary>
+  /// cpu state right after init, see reset...
+  /// </summary>
+  uc_context* m_golden = nullptr;
+
+  /// <summary>
+  /// pages of the image written to since init or the last reset, as a bitmap
+  /// and as a list...
+  /// </summary>
+  std::vector<bool> m_image_dirty;
+  std::vector<std::uint32_t> m_image_pages;
+
+  /// <summary>
+  /// pages zero filled by invalid_mem since init or the last reset...
+  /// </summary>
+  std::vector<std::uintptr_t> m_zero_pages;
+
+  uc_hook image_write_hook;
+
+  static void image_write(uc_engine* uc, uc_mem_type type, uint64_t address,
                           int size, int64_t value, emu_t* obj);
 
   /// <summary>
@@ -114,13 +567,268 @@ class emu_t {
   /// determines if a branch is legit or not...
   /// </summary>
   /// <param name="vblk"></param>
+  /// <param name="jmp_stack">stack of the virtual jmp of vblk...</param>
   /// <param name="branch_addr"></param>
   /// <returns></returns>
-  bool legit_branch(vm::instrs::vblk_t& vblk, std::uintptr_t branch_addr);
+  bool legit_branch(vm::instrs::vblk_t& vblk,
+                    const stack_snapshot_t& jmp_stack,
+                    std::uintptr_t branch_addr);
+
+  /// <summary>
+  /// determines if the two branches of a possible virtual jcc are legit, in
+  /// parallel on forked engines if m_cfg.parallel_spec is set... forks start
+  /// from the memory of this engine, but each sees only its own speculative
+  /// writes while serially the second branch also sees those of the first.
+  /// neither branch is kept, so both ways give the same answer for code
+  /// which does not read what it wrote on the other branch...
+  /// </summary>
+  /// <param name="vblk"></param>
+  /// <param name="jmp_stack">stack of the virtual jmp of vblk...</param>
+  /// <param name="br1"></param>
+  /// <param name="br2"></param>
+  /// <param name="serial">validate one branch after the other even if
+  /// m_cfg.parallel_spec is set, used when forking failed...</param>
+  /// <returns></returns>
+  std::pair<bool, bool> legit_branches(vm::instrs::vblk_t& vblk,
+                                       const stack_snapshot_t& jmp_stack,
+                                       std::uintptr_t br1, std::uintptr_t br2,
+                                       bool serial = false);
+
+  /// <summary>
+  /// keep only the legit targets of a virtual jump table, validated in
+  /// parallel on forked engines if m_cfg.parallel_spec is set...
+  /// </summary>
+  /// <param name="vblk">block ending in the virtual jmp...</param>
+  /// <param name="jmp_stack">stack of the virtual jmp of vblk...</param>
+  /// <param name="targets">candidate targets, the legit ones are left in
+  /// order...</param>
+  /// <param name="serial">validate one target after the other even if
+  /// m_cfg.parallel_spec is set, used when forking failed...</param>
+  void legit_targets(vm::instrs::vblk_t& vblk,
+                     const stack_snapshot_t& jmp_stack,
+                     std::vector<std::uintptr_t>& targets,
+                     bool serial = false);
+
+  /// <summary>
+  /// most entries of a virtual jump table that are validated... a block of a
+  /// routine file cannot have more branches...
+  /// </summary>
+  static constexpr auto max_table_entries = 0xFFu;
+
+  /// <summary>
+  /// get a forked engine used for speculative execution, created the first
+  /// time it is asked for... its memory is made to match this engine every
+  /// time, see clone_memory...
+  /// </summary>
+  /// <param name="idx">index of the fork...</param>
+  /// <returns>the fork or nullptr if it could not be initialized...</returns>
+  emu_t* fork(std::size_t idx);
+
+  /// <summary>
+  /// make the image and the zero filled pages of this engine match those of
+  /// another engine of the same image... only pages written to (or zero
+  /// filled) by either engine are touched...
+  /// </summary>
+  /// <param name="other">engine to copy from...</param>
+  /// <returns>returns false if a page could not be mapped...</returns>
+  bool clone_memory(const emu_t& other);
+
+  /// <summary>
+  /// put back the image pages written to and unmap zero filled pages...
+  /// </summary>
+  void restore_memory();
+
+  /// <summary>
+  /// engines legit_branches validates on and the tracer... they map their
+  /// own copy of the image, share the decode cache and keep their vm handler
+  /// cache between calls...
+  /// </summary>
+  std::unique_ptr<emu_t> m_forks[3];
+
+  /// <summary>
+  /// single worker the second fork of m_cfg.parallel_spec runs on, started
+  /// the first time it is needed...
+  /// </summary>
+  std::unique_ptr<thread_pool_t> m_spec_pool;
+  thread_pool_t& spec_pool();
+
+  /// <summary>
+  /// take over what stops emulation from an engine speculative execution
+  /// ran on... an error, the time budget or cancellation of a fork stop this
+  /// engine too...
+  /// </summary>
+  /// <param name="spec">this engine or one of its forks...</param>
+  void join(const emu_t& spec);
+
+  /// <summary>
+  /// index of the fork that traces vm handlers for m_cfg.block_hooks...
+  /// </summary>
+  static constexpr auto tracer_fork = 2u;
+
+  /// <summary>
+  /// set while unicorn-engine is inside of a vm handler, used by
+  /// block_callback to find handler starts...
+  /// </summary>
+  bool cc_in_hndlr = false;
+
+  /// <summary>
+  /// set while the tracer is retracing a single vm handler, cc_retraced is
+  /// set once that handler started...
+  /// </summary>
+  bool cc_retrace = false, cc_retraced = false;
+
+  /// <summary>
+  /// stack of the vm handler being retraced...
+  /// </summary>
+  stack_snapshot_t m_hndlr_stack;
+
+  /// <summary>
+  /// basic block callback used instead of code_callback for
+  /// m_cfg.block_hooks...
+  /// </summary>
+  /// <param name="uc"></param>
+  /// <param name="address"></param>
+  /// <param name="size"></param>
+  /// <param name="obj"></param>
+  static void block_callback(uc_engine* uc, uint64_t address, uint32_t size,
+                             emu_t* obj);
+
+  /// <summary>
+  /// start of a vm handler in m_cfg.block_hooks... produces the virtual
+  /// instruction of the handler either on the host or by retracing it, the
+  /// host is only used as m_cfg.native says...
+  /// </summary>
+  /// <param name="address">address of the first native instruction...</param>
+  /// <returns>returns true if unicorn-engine is to run the handler...</returns>
+  bool hndlr_begin(std::uintptr_t address);
+
+  /// <summary>
+  /// trace a single vm handler on this (tracer) engine...
+  /// </summary>
+  /// <param name="ctx">cpu context at the start of the handler...</param>
+  /// <param name="stack">stack at the start of the handler...</param>
+  /// <param name="vblk">block the handler is part of, its vip and virtual
+  /// jmp information are filled in...</param>
+  /// <returns>virtual instruction of the handler if it produced one...</returns>
+  std::optional<vm::instrs::vinstr_t> retrace(uc_context* ctx,
+                                              const stack_snapshot_t& stack,
+                                              vm::instrs::vblk_t& vblk);
+
+  /// <summary>
+  /// get the virtual jmp stack snapshot of a block in cc_vrtn...
+  /// </summary>
+  /// <param name="blk_idx">index of the block in cc_vrtn->m_blks...</param>
+  /// <returns></returns>
+  stack_snapshot_t& jmp_stack(std::size_t blk_idx);
 
   /// <summary>
   /// extracts the current code blocks branch data...
   /// </summary>
   void extract_branch_data();
+
+  /// <summary>
+  /// queue every branch of a block in cc_vrtn that has not been seen yet...
+  /// </summary>
+  /// <param name="blk_idx">index of the block in cc_vrtn->m_blks...</param>
+  /// <param name="depth">nesting depth of the branches...</param>
+  void queue_branches(std::size_t blk_idx, std::uint32_t depth);
+
+  /// <summary>
+  /// free the virtual jmp cpu context and stack snapshot of a block in
+  /// cc_vrtn...
+  /// </summary>
+  /// <param name="blk_idx">index of the block in cc_vrtn->m_blks...</param>
+  void release_jmp(std::size_t blk_idx);
+
+  /// <summary>
+  /// spill virtual jmp stack snapshots until those in memory fit
+  /// emu_cfg_t::snapshot_budget... snapshots needed last by the worklist order
+  /// go first...
+  /// </summary>
+  void spill_jmps();
+
+  /// <summary>
+  /// hand cc_blk to the block sink of the current emulate call...
+  /// </summary>
+  void emit_blk();
+
+  /// <summary>
+  /// block sink of the current emulate call...
+  /// </summary>
+  const blk_sink_t* cc_sink = nullptr;
+
+  /// <summary>
+  /// RET or JMP REG means the end of a vm handler...
+  /// </summary>
+  /// <param name="instr"></param>
+  /// <returns></returns>
+  static bool hndlr_end(const zydis_decoded_instr_t& instr);
+
+  /// <summary>
+  /// print a virtual instruction...
+  /// </summary>
+  /// <param name="vinstr"></param>
+  static void print_vinstr(const vm::instrs::vinstr_t& vinstr);
+
+  /// <summary>
+  /// deobfuscate cc_trace and remove the fetch of the next vm handler from
+  /// it...
+  /// </summary>
+  void deobfuscate();
+
+  /// <summary>
+  /// determine the virtual instruction of cc_trace and learn from it...
+  /// </summary>
+  /// <returns></returns>
+  vm::instrs::vinstr_t determine();
+
+  /// <summary>
+  /// step over a native instruction of a cached vm handler...
+  /// </summary>
+  /// <param name="address">address of the native instruction...</param>
+  /// <param name="instr">the native instruction...</param>
+  /// <returns>virtual instruction if this is the end of the handler...</returns>
+  std::optional<vm::instrs::vinstr_t> cached_step(
+      std::uintptr_t address, const zydis_decoded_instr_t& instr);
+
+  /// <summary>
+  /// run the current (trusted) vm handler on the host... in
+  /// native_mode_t::cross_check the result is only kept for comparison and
+  /// unicorn-engine executes the handler as usual...
+  /// </summary>
+  /// <param name="address">address of the first native instruction...</param>
+  /// <returns>virtual instruction if the handler was run on the host and
+  /// unicorn-engine has to continue at the next handler...</returns>
+  std::optional<vm::instrs::vinstr_t> native_step(std::uintptr_t address);
+
+  /// <summary>
+  /// compare cc_native against unicorn-engine...
+  /// </summary>
+  /// <param name="address">address of the next vm handler...</param>
+  void cross_check(std::uintptr_t address);
+
+  /// <summary>
+  /// never run cc_native on the host again...
+  /// </summary>
+  /// <param name="reason">what did not match...</param>
+  void native_mismatch(const char* reason);
+
+  /// <summary>
+  /// rewind the cpu and stack to the start of the current cached vm handler
+  /// and trace it from there instead...
+  /// </summary>
+  void trace_uncached();
+
+  /// <summary>
+  /// give the current trace back and start a new one...
+  /// </summary>
+  void reset_trace();
+
+  /// <summary>
+  /// cache key of the current vm handler...
+  /// </summary>
+  hndlr_key_t hndlr_key() const {
+    return {cc_trace.m_begin, cc_trace.m_vip, cc_trace.m_vsp};
+  }
 };
 }  // namespace vm
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+namespace vm {
+/// <summary>
+/// branch of an already emulated virtual code block that still has to be
+/// emulated...
+/// </summary>
+struct work_item_t {
+  /// <summary>
+  /// index of the block in vrtn_t::m_blks whose virtual jmp handler (cpu
+  /// context and stack snapshot) is used to emulate the branch... all branches
+  /// of a block share it...
+  /// </summary>
+  std::size_t src_blk;
+
+  /// <summary>
+  /// module based virtual instruction pointer of the branch...
+  /// </summary>
+  std::uintptr_t target;
+
+  /// <summary>
+  /// number of branches taken from the vm entry to get here...
+  /// </summary>
+  std::uint32_t depth;
+};
+
+/// <summary>
+/// worklist of the routine exploration... every branch target is marked as
+/// visited the moment it is queued so that a block reached from several
+/// other blocks is only ever emulated once...
+/// </summary>
+class worklist_t {
+ public:
+  /// <summary>
+  /// order in which queued branches are emulated...
+  /// </summary>
+  enum class order_t : std::uint8_t {
+    /// <summary>
+    /// first queued first emulated...
+    /// </summary>
+    bfs,
+
+    /// <summary>
+    /// last queued first emulated...
+    /// </summary>
+    dfs,
+
+    /// <summary>
+    /// most deeply nested branch first, in queue order for equal depth...
+    /// </summary>
+    depth
+  };
+
+  explicit worklist_t(order_t order = order_t::bfs);
+
+  /// <summary>
+  /// mark a virtual instruction pointer as visited without queueing it...
+  /// </summary>
+  /// <param name="target">module based virtual instruction pointer...</param>
+  /// <returns>returns false if it was already visited...</returns>
+  bool visit(std::uintptr_t target);
+
+  /// <summary>
+  /// queue a branch unless its target was visited before...
+  /// </summary>
+  /// <param name="item">branch to queue...</param>
+  /// <returns>returns true if the branch was queued...</returns>
+  bool push(const work_item_t& item);
+
+  /// <summary>
+  /// take the next branch to emulate...
+  /// </summary>
+  /// <returns>next branch or nullopt if the worklist is empty...</returns>
+  std::optional<work_item_t> pop();
+
+  bool empty() const { return m_queue.empty(); }
+  std::size_t size() const { return m_queue.size(); }
+  std::size_t visited() const { return m_visited.size(); }
+
+  /// <summary>
+  /// forget every queued branch and visited target...
+  /// </summary>
+  void clear();
+
+  order_t order() const { return m_order; }
+  void order(order_t order);
+
+ private:
+  struct entry_t {
+    work_item_t item;
+    std::uint64_t seq;
+  };
+
+  /// <summary>
+  /// orders entries so that the next one to emulate is on top of the heap...
+  /// </summary>
+  struct cmp_t {
+    order_t order;
+    bool operator()(const entry_t& a, const entry_t& b) const;
+  };
+
+  order_t m_order;
+  std::uint64_t m_seq = 0ull;
+  std::unordered_set<std::uintptr_t> m_visited;
+  std::priority_queue<entry_t, std::vector<entry_t>, cmp_t> m_queue;
+};
+}  // namespace vm
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <analysis_cache_t.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mapped_file_t.hpp>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace vm {
+// chunks of the binary hashed by a single task...
+static constexpr auto hash_chunk_size = 0x100000u;
+
+static std::uint64_t hash_chunk(const std::uint8_t* data, std::size_t size) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  std::size_t idx = 0u;
+
+  for (; idx + sizeof hash <= size; idx += sizeof hash) {
+    std::uint64_t word;
+    std::memcpy(&word, data + idx, sizeof word);
+    hash = (hash ^ word) * 0x100000001b3ull;
+    hash ^= hash >> 29;
+  }
+
+  for (; idx < size; ++idx) hash = (hash ^ data[idx]) * 0x100000001b3ull;
+  return hash;
+}
+
+// temporary name of a file about to be written... unique per process and
+// call so that neither writers in other processes nor other threads of this
+// one ever write to the same temporary file...
+static std::string tmp_path(const std::string& path) {
+  static std::atomic<std::uint32_t> next = 0u;
+#ifdef _WIN32
+  const auto pid = _getpid();
+#else
+  const auto pid = getpid();
+#endif
+
+  char suffix[32];
+  std::snprintf(suffix, sizeof suffix, ".%d.%u.tmp", static_cast<int>(pid),
+                next++);
+  return path + suffix;
+}
+
+template <class T>
+static const T* table(const mapped_file_t& file, std::uint64_t offset,
+                      std::uint64_t cnt) {
+  if (offset % alignof(T) || offset > file.size() ||
+      cnt > (file.size() - offset) / sizeof(T))
+    return nullptr;
+
+  return reinterpret_cast<const T*>(file.data() + offset);
+}
+
+std::uint64_t analysis_cache_t::hash(const std::uint8_t* data,
+                                     std::size_t size, thread_pool_t* pool) {
+  // the size goes in last so files which are a prefix of one another differ...
+  std::vector<std::uint64_t> hashes((size + hash_chunk_size - 1) /
+                                        hash_chunk_size +
+                                    1);
+
+  for (auto idx = 0u; idx + 1 < hashes.size(); ++idx) {
+    const auto chunk = [=, &hashes](std::size_t) {
+      const auto offset = static_cast<std::size_t>(idx) * hash_chunk_size;
+      hashes[idx] = hash_chunk(
+          data + offset, std::min<std::size_t>(hash_chunk_size, size - offset));
+    };
+
+    if (pool)
+      pool->submit(chunk);
+    else
+      chunk(0u);
+  }
+
+  if (pool) pool->wait();
+  hashes.back() = size;
+  return hash_chunk(reinterpret_cast<const std::uint8_t*>(hashes.data()),
+                    hashes.size() * sizeof(std::uint64_t));
+}
+
+bool analysis_cache_t::open(const std::string& dir, const pe_image_t& image,
+                            thread_pool_t* pool) {
+  m_hash = hash(image.file().data(), image.file().size(), pool);
+  m_module_base = image.module_base();
+  m_image_base = image.image_base();
+
+  char name[17];
+  std::snprintf(name, sizeof name, "%016llx",
+                static_cast<unsigned long long>(m_hash));
+
+  m_dir = (std::filesystem::path(dir) / name).string();
+  std::error_code err;
+  std::filesystem::create_directories(m_dir, err);
+  return !err;
+}
+
+bool analysis_cache_t::load_rtn(std::uint32_t rva,
+                                vm::instrs::vrtn_t& vrtn) const {
+  mapped_file_t mapping;
+  if (!mapping.open(rtn_path(rva))) return false;
+
+  rtn_file_t file;
+  if (!file.init(mapping.data(), mapping.size()) ||
+      file.hdr().image_base != m_image_base || file.rtns().size() != 1u ||
+      file.rtns()[0].rva != rva)
+    return false;
+
+  file.to_vrtn(file.rtns()[0], m_module_base, vrtn);
+  return true;
+}
+
+bool analysis_cache_t::begin_rtn(std::uint32_t rva,
+                                 rtn_writer_t& writer) const {
+  return writer.open(tmp_path(rtn_path(rva)), m_module_base, m_image_base);
+}
+
+bool analysis_cache_t::commit_rtn(std::uint32_t rva, rtn_writer_t& writer,
+                                  bool keep) const {
+  // the writer knows the temporary name begin_rtn gave it...
+  const auto tmp = writer.path();
+  const auto written = writer.close();
+
+  std::error_code err;
+  if (!keep || !written) {
+    std::filesystem::remove(tmp, err);
+    return false;
+  }
+
+  std::filesystem::rename(tmp, rtn_path(rva), err);
+  if (!err) return true;
+
+  std::filesystem::remove(tmp, err);
+  return false;
+}
+
+bool analysis_cache_t::load_hndlrs(
+    std::vector<hndlr_profile_t>& profiles) const {
+  mapped_file_t mapping;
+  if (!mapping.open(path("hndlrs.vhnd"))) return false;
+
+  const auto hdr = table<file::hndlr_hdr_t>(mapping, 0u, 1u);
+  if (!hdr || hdr->magic != file::hndlr_magic ||
+      hdr->version != file::hndlr_version ||
+      hdr->hdr_size != sizeof(file::hndlr_hdr_t))
+    return false;
+
+  const auto hndlrs =
+      table<file::hndlr_t>(mapping, hdr->hndlr_tbl, hdr->hndlr_cnt);
+  if (!hndlrs) return false;
+
+  // a file which turns out to be broken half way through is a cache miss
+  // too, nothing of it is handed out...
+  std::vector<hndlr_profile_t> loaded;
+  loaded.reserve(hdr->hndlr_cnt);
+
+  for (auto idx = 0u; idx < hdr->hndlr_cnt; ++idx) {
+    const auto& hndlr = hndlrs[idx];
+    const auto trace =
+        table<std::uint32_t>(mapping, hndlr.trace_tbl, hndlr.trace_cnt);
+    if (!trace || !hndlr.trace_cnt) return false;
+
+    auto& [key, entry] = loaded.emplace_back();
+    key = {m_module_base + hndlr.rva, static_cast<zydis_reg_t>(hndlr.vip),
+           static_cast<zydis_reg_t>(hndlr.vsp)};
+
+    entry.vinstr.mnemonic =
+        static_cast<vm::instrs::mnemonic_t>(hndlr.mnemonic);
+    entry.vinstr.imm.has_imm = hndlr.has_imm;
+    entry.vinstr.imm.size = hndlr.imm_size;
+    entry.vinstr.imm.val = 0ull;
+    entry.imm = {m_module_base + hndlr.imm_rva, hndlr.imm_reg,
+                 static_cast<bool>(hndlr.imm_sext)};
+
+    for (auto trace_idx = 0u; trace_idx < hndlr.trace_cnt; ++trace_idx)
+      entry.trace.push_back(m_module_base + trace[trace_idx]);
+
+    entry.runs = hndlr_cache_t::verify_runs;
+    entry.trusted = true;
+    entry.poisoned = false;
+  }
+
+  profiles.insert(profiles.end(), std::make_move_iterator(loaded.begin()),
+                  std::make_move_iterator(loaded.end()));
+  return true;
+}
+
+bool analysis_cache_t::store_hndlrs(
+    const std::vector<hndlr_profile_t>& profiles) const {
+  // every engine profiles the same handlers...
+  std::unordered_map<hndlr_key_t, const hndlr_entry_t*, hndlr_key_hash_t>
+      unique;
+  for (const auto& [key, entry] : profiles)
+    if (entry.trusted && !entry.trace.empty()) unique.emplace(key, &entry);
+
+  file::hndlr_hdr_t hdr{};
+  hdr.magic = file::hndlr_magic;
+  hdr.version = file::hndlr_version;
+  hdr.hdr_size = sizeof hdr;
+  hdr.hndlr_cnt = static_cast<std::uint32_t>(unique.size());
+  hdr.hndlr_tbl = sizeof hdr;
+
+  std::vector<file::hndlr_t> hndlrs;
+  std::vector<std::uint32_t> traces;
+  auto trace_tbl = hdr.hndlr_tbl + unique.size() * sizeof(file::hndlr_t);
+
+  for (const auto& [key, entry] : unique) {
+    auto& hndlr = hndlrs.emplace_back();
+    hndlr.rva = static_cast<std::uint32_t>(key.begin - m_module_base);
+    hndlr.vip = static_cast<std::uint16_t>(key.vip);
+    hndlr.vsp = static_cast<std::uint16_t>(key.vsp);
+    hndlr.imm_rva = entry->vinstr.imm.has_imm
+                        ? static_cast<std::uint32_t>(entry->imm.addr -
+                                                     m_module_base)
+                        : 0u;
+    hndlr.imm_reg = entry->imm.reg;
+    hndlr.imm_sext = entry->imm.sext;
+    hndlr.mnemonic = static_cast<std::uint8_t>(entry->vinstr.mnemonic);
+    hndlr.imm_size = entry->vinstr.imm.size;
+    hndlr.has_imm = entry->vinstr.imm.has_imm;
+    hndlr.trace_tbl = trace_tbl;
+    hndlr.trace_cnt = static_cast<std::uint32_t>(entry->trace.size());
+
+    for (const auto addr : entry->trace)
+      traces.push_back(static_cast<std::uint32_t>(addr - m_module_base));
+
+    trace_tbl += entry->trace.size() * sizeof(std::uint32_t);
+  }
+
+  const auto dst = path("hndlrs.vhnd"), tmp = tmp_path(dst);
+  std::error_code err;
+  {
+    std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&hdr), sizeof hdr);
+    output.write(reinterpret_cast<const char*>(hndlrs.data()),
+                 hndlrs.size() * sizeof(file::hndlr_t));
+    output.write(reinterpret_cast<const char*>(traces.data()),
+                 traces.size() * sizeof(std::uint32_t));
+    if (!output.good()) {
+      output.close();
+      std::filesystem::remove(tmp, err);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmp, dst, err);
+  if (!err) return true;
+
+  std::filesystem::remove(tmp, err);
+  return false;
+}
+
+std::string analysis_cache_t::path(const char* name) const {
+  return (std::filesystem::path(m_dir) / name).string();
+}
+
+std::string analysis_cache_t::rtn_path(std::uint32_t rva) const {
+  char name[32];
+  std::snprintf(name, sizeof name, "rtn_%08x.vrtn", rva);
+  return path(name);
+}
+}  // namespace vm
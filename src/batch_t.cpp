@@ -0,0 +1,275 @@
+#include <analysis_cache_t.hpp>
+#include <batch_t.hpp>
+#include <bounded_queue_t.hpp>
+#include <cstdlib>
+#include <emu_pool_t.hpp>
+#include <fstream>
+#include <optional>
+#include <semaphore>
+#include <sstream>
+#include <thread>
+#include <vmlocate.hpp>
+
+namespace vm {
+// a binary on its way through the stages...
+struct batch_image_t {
+  std::size_t job_idx;
+  std::chrono::steady_clock::time_point begin;
+  batch_result_t result;
+
+  pe_image_t image;
+  std::optional<analysis_cache_t> cache;
+  std::vector<hndlr_profile_t> profiles;
+  std::unique_ptr<decode_cache_t> decode_cache;
+  hndlr_kb_t hndlr_kb;
+  std::unique_ptr<emu_pool_t> engines;
+
+  std::vector<std::uint32_t> rvas;
+  std::vector<vm::instrs::vrtn_t> rtns;
+  std::vector<emu_status_t> statuses;
+  std::vector<std::uint8_t> cached;
+
+  // vm entries still being emulated, the last one hands the binary over to
+  // the write stage...
+  std::atomic<std::size_t> pending = 0u;
+};
+
+using batch_queue_t = bounded_queue_t<std::unique_ptr<batch_image_t>>;
+
+batch_t::batch_t(const emu_cfg_t& cfg, thread_pool_t& pool, std::size_t depth)
+    : m_cfg(cfg), m_pool(pool), m_depth(depth ? depth : 1u) {}
+
+bool batch_t::parse(const std::string& path, std::vector<batch_job_t>& jobs) {
+  std::ifstream manifest(path);
+  if (!manifest) {
+    VMEMU_ERROR("> failed to open manifest %s...\n", path.c_str());
+    return false;
+  }
+
+  std::string line;
+  for (auto line_num = 1u; std::getline(manifest, line); ++line_num) {
+    if (const auto comment = line.find('#'); comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream fields(line);
+    std::string bin, entries, out, extra;
+    if (!(fields >> bin)) continue;
+
+    if (!(fields >> entries >> out) || fields >> extra) {
+      VMEMU_ERROR(
+          "> %s:%d: expected <binary> <vm entry rvas|all> <output>...\n",
+          path.c_str(), line_num);
+      return false;
+    }
+
+    batch_job_t job{bin, {}, out};
+    if (entries != "all") {
+      std::istringstream rvas(entries);
+      for (std::string rva; std::getline(rvas, rva, ',');) {
+        char* end = nullptr;
+        job.vm_entries.push_back(
+            static_cast<std::uint32_t>(std::strtoul(rva.c_str(), &end, 16)));
+
+        if (rva.empty() || *end) {
+          VMEMU_ERROR("> %s:%d: malformed vm entry rva %s...\n", path.c_str(),
+                      line_num, rva.c_str());
+          return false;
+        }
+      }
+    }
+
+    jobs.push_back(std::move(job));
+  }
+
+  return true;
+}
+
+std::vector<batch_result_t> batch_t::run(const std::vector<batch_job_t>& jobs,
+                                         const done_t& done) {
+  std::vector<batch_result_t> results(jobs.size());
+  batch_queue_t loaded(m_depth), emulated(m_depth);
+
+  // binaries taken by the emulate stage until written... the write stage
+  // never has more than depth of them queued so the last task of a binary
+  // never blocks a worker on a full queue...
+  std::counting_semaphore<> in_flight(static_cast<std::ptrdiff_t>(m_depth));
+
+  // load stage... a binary which fails to load still goes through the other
+  // stages so that its result is reported in order with the rest...
+  std::thread loader([&] {
+    for (auto idx = 0u; idx < jobs.size() && !cancelled(); ++idx) {
+      const auto& job = jobs[idx];
+      auto img = std::make_unique<batch_image_t>();
+      img->job_idx = idx;
+      img->begin = std::chrono::steady_clock::now();
+
+      if (!img->image.load(job.bin) || !img->image.module_base()) {
+        VMEMU_ERROR("> failed to load %s...\n", job.bin.c_str());
+        if (!loaded.push(std::move(img))) break;
+        continue;
+      }
+
+      const auto module_base = img->image.module_base();
+      const auto image_size = img->image.image_size();
+      img->rvas = job.vm_entries;
+      if (img->rvas.empty())
+        for (const auto& entry :
+             vm::locate::get_vm_entries(module_base, image_size))
+          img->rvas.push_back(entry.rva);
+
+      auto cfg = m_cfg;
+      if (!m_cache_dir.empty()) {
+        img->cache.emplace();
+        if (!img->cache->open(m_cache_dir, img->image)) {
+          VMEMU_WARN("> failed to open the cache of %s...\n", job.bin.c_str());
+          img->cache.reset();
+        } else if (img->cache->load_hndlrs(img->profiles)) {
+          cfg.profiles = &img->profiles;
+        }
+      }
+
+      img->decode_cache =
+          std::make_unique<decode_cache_t>(module_base, image_size);
+      cfg.image = &img->image;
+      cfg.decode_cache = img->decode_cache.get();
+      cfg.hndlr_kb = &img->hndlr_kb;
+      img->engines = std::make_unique<emu_pool_t>(m_pool.size(), cfg);
+
+      img->rtns.resize(img->rvas.size());
+      img->statuses.assign(img->rvas.size(), emu_status_t::error);
+      img->cached.assign(img->rvas.size(), false);
+      img->result.loaded = true;
+      img->result.entries = img->rvas.size();
+
+      if (!loaded.push(std::move(img))) break;
+    }
+
+    loaded.close();
+  });
+
+  // write stage...
+  std::thread writer([&] {
+    for (std::unique_ptr<batch_image_t> img; emulated.pop(img);) {
+      const auto& job = jobs[img->job_idx];
+      auto& result = img->result;
+
+      if (result.loaded) {
+        rtn_writer_t output;
+        if (!output.open(job.out, img->image.module_base(),
+                         img->image.image_base()))
+          VMEMU_ERROR("> failed to open output file %s...\n", job.out.c_str());
+
+        // routines stopped by a budget or cancellation are written with the
+        // blocks emulated so far, same as --vmentry and --emuall, but are
+        // never cached...
+        for (auto idx = 0u; idx < img->rvas.size(); ++idx) {
+          const auto status = img->statuses[idx];
+          if (status == emu_status_t::error) continue;
+
+          output.add_rtn(img->rtns[idx]);
+          if (status != emu_status_t::ok) {
+            ++result.stopped;
+            continue;
+          }
+
+          ++result.emulated;
+          if (img->cached[idx]) {
+            ++result.cached;
+            continue;
+          }
+
+          rtn_writer_t cache_writer;
+          if (img->cache &&
+              img->cache->begin_rtn(img->rvas[idx], cache_writer)) {
+            cache_writer.add_rtn(img->rtns[idx]);
+            img->cache->commit_rtn(img->rvas[idx], cache_writer);
+          }
+        }
+
+        if (img->cache) {
+          std::vector<hndlr_profile_t> learned;
+          img->hndlr_kb.trusted(learned);
+          if (!img->cache->store_hndlrs(learned))
+            VMEMU_WARN("> failed to cache vm handler profiles of %s...\n",
+                       job.bin.c_str());
+        }
+
+        result.written = output.close();
+      }
+
+      result.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - img->begin);
+      results[img->job_idx] = result;
+      if (done) done(job, result);
+
+      // engines and the image go before the next binary is let in...
+      img.reset();
+      in_flight.release();
+    }
+  });
+
+  // emulate stage, dispatched from this thread...
+  for (std::unique_ptr<batch_image_t> img;;) {
+    in_flight.acquire();
+    if (!loaded.pop(img)) {
+      in_flight.release();
+      break;
+    }
+
+    const auto cnt = img->rvas.size();
+    if (!cnt) {
+      emulated.push(std::move(img));
+      continue;
+    }
+
+    auto* const image = img.release();
+    image->pending = cnt;
+
+    for (auto idx = 0u; idx < cnt; ++idx) {
+      m_pool.submit([this, image, idx, &emulated](std::size_t worker_idx) {
+        const auto rva = image->rvas[idx];
+        auto& rtn = image->rtns[idx];
+        auto& status = image->statuses[idx];
+
+        if (image->cache && image->cache->load_rtn(rva, rtn)) {
+          image->cached[idx] = true;
+          status = emu_status_t::ok;
+        } else if (cancelled()) {
+          status = emu_status_t::cancelled;
+        } else {
+          const auto& pe = image->image;
+          vm::vmctx_t vmctx(pe.module_base(), pe.image_base(),
+                            pe.image_size(), rva);
+
+          if (!vmctx.init()) {
+            VMEMU_ERROR("> failed to init vmctx for vm entry rva = 0x%x...\n",
+                        rva);
+          } else if (const auto emu = image->engines->get(worker_idx, &vmctx);
+                     !emu) {
+            VMEMU_ERROR(
+                "> failed to init vm::emu_t for vm entry rva = 0x%x...\n", rva);
+          } else {
+            const auto ok = emu->emulate(rva, rtn);
+            status = ok ? emu_status_t::ok : emu->status();
+            if (!ok && status == emu_status_t::ok)
+              status = emu_status_t::error;
+          }
+        }
+
+        if (!--image->pending)
+          emulated.push(std::unique_ptr<batch_image_t>(image));
+      });
+    }
+  }
+
+  m_pool.wait();
+  emulated.close();
+  loader.join();
+  writer.join();
+  return results;
+}
+
+bool batch_t::cancelled() const {
+  return m_cfg.cancel && m_cfg.cancel->load(std::memory_order_relaxed);
+}
+}  // namespace vm
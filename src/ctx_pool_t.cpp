@@ -0,0 +1,48 @@
+#include <ctx_pool_t.hpp>
+
+namespace vm {
+ctx_pool_t::~ctx_pool_t() {
+  for (auto ctx : m_free) uc_context_free(ctx);
+}
+
+void ctx_pool_t::init(uc_engine* uc) {
+  m_uc = uc;
+  // a single vm handler is usually a couple hundred native instructions...
+  m_free.reserve(0x400);
+}
+
+uc_context* ctx_pool_t::acquire() {
+  if (m_free.empty()) {
+    uc_context* ctx = nullptr;
+    if (uc_context_alloc(m_uc, &ctx)) return nullptr;
+    VMEMU_STAT_INC(m_stats, ctx_allocs);
+    return ctx;
+  }
+
+  auto ctx = m_free.back();
+  m_free.pop_back();
+  return ctx;
+}
+
+uc_context* ctx_pool_t::save() {
+  const auto ctx = acquire();
+  if (!ctx) return nullptr;
+
+  if (uc_context_save(m_uc, ctx)) {
+    release(ctx);
+    return nullptr;
+  }
+
+  VMEMU_STAT_INC(m_stats, ctx_saves);
+  return ctx;
+}
+
+void ctx_pool_t::release(uc_context* ctx) {
+  if (ctx) m_free.push_back(ctx);
+}
+
+void ctx_pool_t::release(std::vector<uc_context*>& ctxs) {
+  for (auto ctx : ctxs) release(ctx);
+  ctxs.clear();
+}
+}  // namespace vm
@@ -0,0 +1,64 @@
+#include <decode_cache_t.hpp>
+
+namespace vm {
+decode_cache_t::decode_cache_t(std::uintptr_t base, std::size_t size)
+    : m_base(base),
+      m_size(size),
+      m_pages(std::make_unique<std::atomic<page_t*>[]>((size + 0xFFF) >>
+                                                        12)) {}
+
+decode_cache_t::~decode_cache_t() {
+  for (auto idx = 0ull; idx < (m_size + 0xFFF) >> 12; ++idx) {
+    const auto page = m_pages[idx].load();
+    if (!page) continue;
+
+    for (auto& instr : page->instrs) delete instr.load();
+    delete page;
+  }
+}
+
+const zydis_decoded_instr_t* decode_cache_t::decode(std::uintptr_t addr) {
+  if (addr < m_base || addr >= m_base + m_size) {
+    static thread_local zydis_decoded_instr_t instr;
+    return ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(vm::utils::g_decoder.get(),
+                                                 reinterpret_cast<void*>(addr),
+                                                 0x1000, &instr))
+               ? &instr
+               : nullptr;
+  }
+
+  const auto offset = addr - m_base;
+  auto& page_slot = m_pages[offset >> 12];
+  auto page = page_slot.load(std::memory_order_acquire);
+
+  if (!page) {
+    // another thread may be allocating the same page, whoever loses the race
+    // frees theirs and uses the winners...
+    auto new_page = new page_t{};
+    if (page_slot.compare_exchange_strong(page, new_page,
+                                          std::memory_order_acq_rel))
+      page = new_page;
+    else
+      delete new_page;
+  }
+
+  auto& instr_slot = page->instrs[offset & 0xFFF];
+  if (auto instr = instr_slot.load(std::memory_order_acquire)) return instr;
+
+  auto new_instr = new zydis_decoded_instr_t;
+  if (!ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(
+          vm::utils::g_decoder.get(), reinterpret_cast<void*>(addr),
+          std::min<std::size_t>(m_size - offset, 15), new_instr))) {
+    delete new_instr;
+    return nullptr;
+  }
+
+  const zydis_decoded_instr_t* instr = nullptr;
+  if (instr_slot.compare_exchange_strong(instr, new_instr,
+                                         std::memory_order_acq_rel))
+    return new_instr;
+
+  delete new_instr;
+  return instr;
+}
+}  // namespace vm
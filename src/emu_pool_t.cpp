@@ -0,0 +1,20 @@
+#include <emu_pool_t.hpp>
+
+namespace vm {
+emu_pool_t::emu_pool_t(std::size_t slots, const emu_cfg_t& cfg)
+    : m_cfg(cfg), m_engines(slots) {}
+
+emu_t* emu_pool_t::get(std::size_t slot, vm::vmctx_t* vm_ctx) {
+  auto& engine = m_engines[slot];
+  if (engine && engine->reset(vm_ctx)) return engine.get();
+
+  // first use of the slot or the engine is beyond repair...
+  engine = std::make_unique<emu_t>(vm_ctx, m_cfg);
+  if (!engine->init()) {
+    engine.reset();
+    return nullptr;
+  }
+
+  return engine.get();
+}
+}  // namespace vm
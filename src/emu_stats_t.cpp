@@ -0,0 +1,51 @@
+#include <cinttypes>
+#include <cstdio>
+#include <emu_stats_t.hpp>
+#include <utility>
+
+namespace vm {
+// every counter and its json name...
+static const std::pair<const char*, std::uint64_t emu_stats_t::*> fields[] = {
+    {"routines", &emu_stats_t::routines},
+    {"emulate_ns", &emu_stats_t::emulate_ns},
+    {"instrs_hooked", &emu_stats_t::instrs_hooked},
+    {"blocks_hooked", &emu_stats_t::blocks_hooked},
+    {"hndlrs_traced", &emu_stats_t::hndlrs_traced},
+    {"hndlrs_cached", &emu_stats_t::hndlrs_cached},
+    {"hndlrs_native", &emu_stats_t::hndlrs_native},
+    {"deobfuscate_ns", &emu_stats_t::deobfuscate_ns},
+    {"determine_ns", &emu_stats_t::determine_ns},
+    {"ctx_allocs", &emu_stats_t::ctx_allocs},
+    {"ctx_saves", &emu_stats_t::ctx_saves},
+    {"stack_bytes", &emu_stats_t::stack_bytes},
+    {"legit_branches", &emu_stats_t::legit_branches},
+    {"spec_instrs", &emu_stats_t::spec_instrs},
+    {"jmp_tables", &emu_stats_t::jmp_tables},
+    {"table_targets", &emu_stats_t::table_targets},
+    {"mem_faults", &emu_stats_t::mem_faults},
+    {"snap_spills", &emu_stats_t::snap_spills},
+    {"snap_loads", &emu_stats_t::snap_loads}};
+
+emu_stats_t& emu_stats_t::operator+=(const emu_stats_t& other) {
+  for (const auto& [name, field] : fields) this->*field += other.*field;
+  return *this;
+}
+
+emu_stats_t& emu_stats_t::operator-=(const emu_stats_t& other) {
+  for (const auto& [name, field] : fields) this->*field -= other.*field;
+  return *this;
+}
+
+std::string emu_stats_t::json() const {
+  std::string result = enabled ? "{\"enabled\":true" : "{\"enabled\":false";
+  char buffer[64];
+
+  for (const auto& [name, field] : fields) {
+    std::snprintf(buffer, sizeof buffer, ",\"%s\":%" PRIu64, name,
+                  this->*field);
+    result += buffer;
+  }
+
+  return result += '}';
+}
+}  // namespace vm
@@ -0,0 +1,189 @@
+#include <hndlr_cache_t.hpp>
+#include <hndlr_kb_t.hpp>
+
+namespace vm {
+static int gp_regs[] = {
+    UC_X86_REG_RAX, UC_X86_REG_RBX, UC_X86_REG_RCX, UC_X86_REG_RDX,
+    UC_X86_REG_RSI, UC_X86_REG_RDI, UC_X86_REG_RBP, UC_X86_REG_RSP,
+    UC_X86_REG_R8,  UC_X86_REG_R9,  UC_X86_REG_R10, UC_X86_REG_R11,
+    UC_X86_REG_R12, UC_X86_REG_R13, UC_X86_REG_R14, UC_X86_REG_R15};
+
+static constexpr auto gp_reg_cnt = sizeof gp_regs / sizeof gp_regs[0];
+
+// does a native instruction read a register, directly or to address memory...
+static bool reads_reg(const zydis_decoded_instr_t& instr, int uc_reg) {
+  const auto same = [&](zydis_reg_t reg) {
+    if (reg == ZYDIS_REGISTER_NONE) return false;
+    const auto full =
+        ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+    return vm::instrs::reg_map.count(full) &&
+           vm::instrs::reg_map[full] == uc_reg;
+  };
+
+  for (auto idx = 0u; idx < instr.operand_count; ++idx) {
+    const auto& op = instr.operands[idx];
+    if (op.type == ZYDIS_OPERAND_TYPE_REGISTER &&
+        (op.actions & ZYDIS_OPERAND_ACTION_MASK_READ) && same(op.reg.value))
+      return true;
+
+    if (op.type == ZYDIS_OPERAND_TYPE_MEMORY &&
+        (same(op.mem.base) || same(op.mem.index)))
+      return true;
+  }
+
+  return false;
+}
+
+const hndlr_entry_t* hndlr_cache_t::get(const hndlr_key_t& key) const {
+  const auto entry = m_kb->find(key);
+  return entry && entry->trusted ? entry : nullptr;
+}
+
+void hndlr_cache_t::learn(uc_engine* uc, ctx_pool_t& pool,
+                          const hndlr_key_t& key,
+                          const vm::instrs::vinstr_t& vinstr,
+                          const std::vector<vm::instrs::emu_instr_t>& profiled,
+                          const std::vector<uc_context*>& ctxs,
+                          const std::vector<std::uintptr_t>& addrs) {
+  if (vinstr.mnemonic == vm::instrs::mnemonic_t::unknown ||
+      vinstr.mnemonic == vm::instrs::mnemonic_t::jmp ||
+      vinstr.mnemonic == vm::instrs::mnemonic_t::vmexit)
+    return;
+
+  // some engine already made up its mind about the handler...
+  if (m_kb->find(key)) return;
+
+  auto& entry = m_entries[key];
+
+  const bool first_run = !entry.runs;
+  if (first_run) entry.vinstr = vinstr;
+
+  // the same handler must always produce the same kind of virtual
+  // instruction...
+  if (entry.vinstr.mnemonic != vinstr.mnemonic ||
+      entry.vinstr.imm.has_imm != vinstr.imm.has_imm ||
+      entry.vinstr.imm.size != vinstr.imm.size) {
+    poison(key);
+    return;
+  }
+
+  if (vinstr.imm.has_imm) {
+    if (first_run)
+      entry.first_imm = vinstr.imm.val;
+    else if (vinstr.imm.val != entry.first_imm)
+      entry.imm_varied = true;
+
+    std::uint64_t vals[gp_reg_cnt];
+    void* val_ptrs[gp_reg_cnt];
+    for (auto idx = 0u; idx < gp_reg_cnt; ++idx) val_ptrs[idx] = &vals[idx];
+
+    const auto backup = pool.save();
+    if (first_run) {
+      // find every register which holds the operand right before a native
+      // instruction of the profile reads it...
+      for (auto idx = 0u; idx < ctxs.size(); ++idx) {
+        const auto instr = std::find_if(
+            profiled.begin(), profiled.end(),
+            [&](const vm::instrs::emu_instr_t& instr) {
+              return instr.m_cpu == ctxs[idx];
+            });
+        if (instr == profiled.end()) continue;
+
+        uc_context_restore(uc, ctxs[idx]);
+        uc_reg_read_batch(uc, gp_regs, val_ptrs, gp_reg_cnt);
+        for (auto reg = 0u; reg < gp_reg_cnt; ++reg) {
+          if (!reads_reg(instr->m_instr, gp_regs[reg])) continue;
+
+          for (const bool sext : {false, true})
+            if ((!sext || vinstr.imm.size < 64) &&
+                imm_val(vals[reg], vinstr.imm.size, sext) == vinstr.imm.val)
+              entry.candidates.push_back({addrs[idx], gp_regs[reg], sext});
+        }
+      }
+    } else {
+      // drop every candidate which does not hold the operand this time...
+      std::erase_if(entry.candidates, [&](const imm_src_t& src) {
+        const auto itr = std::find(addrs.begin(), addrs.end(), src.addr);
+        if (itr == addrs.end()) return true;
+
+        std::uint64_t val = 0ull;
+        uc_context_restore(uc, ctxs[itr - addrs.begin()]);
+        uc_reg_read(uc, src.reg, &val);
+        return imm_val(val, vinstr.imm.size, src.sext) != vinstr.imm.val;
+      });
+    }
+
+    uc_context_restore(uc, backup);
+    pool.release(backup);
+
+    if (entry.candidates.empty()) {
+      poison(key);
+      return;
+    }
+  }
+
+  if (++entry.runs < verify_runs) return;
+
+  // keep tracing until the operand changes, a constant (or an 8bit operand
+  // which happened to repeat) proves nothing about where it comes from...
+  if (vinstr.imm.has_imm && !entry.imm_varied) {
+    if (entry.runs >= max_runs) poison(key);
+    return;
+  }
+
+  // take the operand from the last place it shows up in, this is the closest
+  // to where the profile itself read it...
+  if (vinstr.imm.has_imm) {
+    entry.imm = *std::max_element(
+        entry.candidates.begin(), entry.candidates.end(),
+        [&](const imm_src_t& a, const imm_src_t& b) {
+          return std::find(addrs.begin(), addrs.end(), a.addr) <
+                 std::find(addrs.begin(), addrs.end(), b.addr);
+        });
+    entry.candidates.clear();
+  }
+
+  entry.trace = addrs;
+  entry.trusted = true;
+
+  m_kb->publish({key, std::move(entry)});
+  m_entries.erase(key);
+}
+
+vm::instrs::vinstr_t hndlr_cache_t::vinstr(const hndlr_entry_t& entry,
+                                           std::uint64_t val) {
+  auto vinstr = entry.vinstr;
+  if (vinstr.imm.has_imm)
+    vinstr.imm.val = imm_val(val, vinstr.imm.size, entry.imm.sext);
+  return vinstr;
+}
+
+void hndlr_cache_t::trusted(std::vector<hndlr_profile_t>& profiles) const {
+  m_kb->trusted(profiles);
+}
+
+void hndlr_cache_t::add(const hndlr_profile_t& profile) {
+  auto trusted = profile;
+  trusted.second.trusted = true;
+  trusted.second.poisoned = false;
+  m_kb->publish(trusted);
+}
+
+void hndlr_cache_t::poison(const hndlr_key_t& key) {
+  hndlr_entry_t entry{};
+  entry.poisoned = true;
+
+  m_kb->publish({key, std::move(entry)});
+  m_entries.erase(key);
+}
+
+std::uint64_t hndlr_cache_t::imm_val(std::uint64_t val, std::uint8_t size,
+                                     bool sext) {
+  if (size >= 64) return val;
+
+  const auto mask = (1ull << size) - 1;
+  val &= mask;
+  if (sext && (val >> (size - 1)) & 1) val |= ~mask;
+  return val;
+}
+}  // namespace vm
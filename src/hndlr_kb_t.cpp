@@ -0,0 +1,56 @@
+#include <hndlr_kb_t.hpp>
+
+namespace vm {
+hndlr_kb_t::hndlr_kb_t()
+    : m_buckets(std::make_unique<std::atomic<const node_t*>[]>(bucket_cnt)) {}
+
+hndlr_kb_t::~hndlr_kb_t() {
+  for (auto idx = 0u; idx < bucket_cnt; ++idx)
+    for (auto node = m_buckets[idx].load(); node;) {
+      const auto next = node->next;
+      delete node;
+      node = next;
+    }
+}
+
+const hndlr_entry_t* hndlr_kb_t::find(const hndlr_key_t& key) const {
+  const auto& bucket = m_buckets[hndlr_key_hash_t()(key) % bucket_cnt];
+  for (auto node = bucket.load(std::memory_order_acquire); node;
+       node = node->next)
+    if (node->key == key) return &node->entry;
+
+  return nullptr;
+}
+
+const hndlr_entry_t* hndlr_kb_t::publish(const hndlr_profile_t& profile) {
+  auto& bucket = m_buckets[hndlr_key_hash_t()(profile.first) % bucket_cnt];
+  auto head = bucket.load(std::memory_order_acquire);
+  node_t* new_node = nullptr;
+
+  for (;;) {
+    // another thread may have published the same handler in the meantime,
+    // whoever loses the race frees theirs and uses the winners...
+    for (auto node = head; node; node = node->next)
+      if (node->key == profile.first) {
+        delete new_node;
+        return &node->entry;
+      }
+
+    if (!new_node) new_node = new node_t{profile.first, profile.second};
+    new_node->next = head;
+
+    if (bucket.compare_exchange_weak(head, new_node, std::memory_order_release,
+                                     std::memory_order_acquire)) {
+      m_size.fetch_add(1u, std::memory_order_relaxed);
+      return &new_node->entry;
+    }
+  }
+}
+
+void hndlr_kb_t::trusted(std::vector<hndlr_profile_t>& profiles) const {
+  for (auto idx = 0u; idx < bucket_cnt; ++idx)
+    for (auto node = m_buckets[idx].load(std::memory_order_acquire); node;
+         node = node->next)
+      if (node->entry.trusted) profiles.emplace_back(node->key, node->entry);
+}
+}  // namespace vm
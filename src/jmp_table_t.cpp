@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstring>
+#include <jmp_table_t.hpp>
+
+namespace vm {
+// symbolic value of a virtual stack slot or virtual register...
+struct table_val_t {
+  enum class kind_t : std::uint8_t {
+    unknown,
+
+    // val...
+    constant,
+
+    // val + scale * a virtual register...
+    index,
+
+    // [base + scale * a virtual register] + val...
+    entry
+  } kind = kind_t::unknown;
+
+  std::uint64_t val = 0ull, scale = 0ull, base = 0ull;
+  std::uint8_t size = 0u;
+
+  // a virtual register loaded before the block stored anything into it, the
+  // index or the relocation delta...
+  bool plain = false;
+
+  // the relocation delta was added...
+  bool rebased = false;
+};
+
+static table_val_t constant(std::uint64_t val) {
+  return {table_val_t::kind_t::constant, val};
+}
+
+static table_val_t add(const table_val_t& lhs, const table_val_t& rhs) {
+  using kind_t = table_val_t::kind_t;
+  if (lhs.kind == kind_t::constant && rhs.kind == kind_t::constant)
+    return constant(lhs.val + rhs.val);
+
+  // a constant moves an index or the entry read with it...
+  if (lhs.kind == kind_t::constant || rhs.kind == kind_t::constant) {
+    const auto& other = lhs.kind == kind_t::constant ? rhs : lhs;
+    const auto val = lhs.kind == kind_t::constant ? lhs.val : rhs.val;
+    if (other.kind != kind_t::index && other.kind != kind_t::entry) return {};
+
+    auto result = other;
+    result.val += val;
+    result.plain = false;
+    return result;
+  }
+
+  // a plain virtual register added to an index or entry is taken to be the
+  // relocation delta, it can only be added once...
+  if (lhs.plain != rhs.plain) {
+    const auto& other = lhs.plain ? rhs : lhs;
+    if ((other.kind != kind_t::index && other.kind != kind_t::entry) ||
+        other.rebased)
+      return {};
+
+    auto result = other;
+    result.rebased = true;
+    return result;
+  }
+
+  return {};
+}
+
+static table_val_t shl(const table_val_t& val, const table_val_t& cnt) {
+  using kind_t = table_val_t::kind_t;
+  if (cnt.kind != kind_t::constant || cnt.val > 63u) return {};
+  if (val.kind == kind_t::constant) return constant(val.val << cnt.val);
+  if (val.kind != kind_t::index || val.rebased) return {};
+
+  auto result = val;
+  result.val <<= cnt.val;
+  result.scale <<= cnt.val;
+  result.plain = false;
+  return result;
+}
+
+std::optional<jmp_table_t> jmp_table_t::find(
+    const std::vector<vm::instrs::vinstr_t>& vinstrs) {
+  using kind_t = table_val_t::kind_t;
+  if (vinstrs.empty() ||
+      vinstrs.back().mnemonic != vm::instrs::mnemonic_t::jmp)
+    return {};
+
+  // slots pushed by earlier blocks are unknown...
+  std::vector<table_val_t> stack;
+  const auto pop = [&]() -> table_val_t {
+    if (stack.empty()) return {};
+    const auto val = stack.back();
+    stack.pop_back();
+    return val;
+  };
+
+  std::vector<std::optional<table_val_t>> vregs(VIRTUAL_REGISTER_COUNT);
+  const auto vreg = [&](const vm::instrs::vinstr_t& vinstr)
+      -> std::optional<table_val_t>* {
+    const auto idx = vinstr.imm.val / 8u;
+    return idx < vregs.size() ? &vregs[idx] : nullptr;
+  };
+
+  for (const auto& vinstr : vinstrs) {
+    switch (vinstr.mnemonic) {
+      case vm::instrs::mnemonic_t::lconst:
+        stack.push_back(constant(vinstr.imm.val));
+        break;
+      case vm::instrs::mnemonic_t::lreg: {
+        const auto reg = vreg(vinstr);
+        if (reg && reg->has_value()) {
+          stack.push_back(reg->value());
+          break;
+        }
+
+        table_val_t val{kind_t::index, 0ull, 1ull};
+        val.plain = true;
+        stack.push_back(val);
+        break;
+      }
+      case vm::instrs::mnemonic_t::sreg: {
+        const auto val = pop();
+        if (const auto reg = vreg(vinstr)) *reg = val;
+        break;
+      }
+      case vm::instrs::mnemonic_t::add: {
+        const auto lhs = pop(), rhs = pop();
+        stack.push_back(add(lhs, rhs));
+        stack.push_back({});  // flags...
+        break;
+      }
+      case vm::instrs::mnemonic_t::shl:
+      case vm::instrs::mnemonic_t::shr: {
+        // the value is on top of the shift count...
+        const auto val = pop(), cnt = pop();
+        if (vinstr.mnemonic == vm::instrs::mnemonic_t::shl)
+          stack.push_back(shl(val, cnt));
+        else if (val.kind == kind_t::constant &&
+                 cnt.kind == kind_t::constant && cnt.val < 64u)
+          stack.push_back(constant(val.val >> cnt.val));
+        else
+          stack.push_back({});
+
+        stack.push_back({});  // flags...
+        break;
+      }
+      case vm::instrs::mnemonic_t::_or:
+        pop();
+        pop();
+        stack.push_back({});
+        stack.push_back({});  // flags...
+        break;
+      case vm::instrs::mnemonic_t::read: {
+        const auto addr = pop();
+        table_val_t val;
+        if (addr.kind == kind_t::index && !addr.plain &&
+            (vinstr.stack_size == 64u || vinstr.stack_size == 32u)) {
+          val.kind = kind_t::entry;
+          val.base = addr.val;
+          val.scale = addr.scale;
+          val.size = vinstr.stack_size / 8u;
+        }
+        stack.push_back(val);
+        break;
+      }
+      case vm::instrs::mnemonic_t::write:
+        pop();
+        pop();
+        break;
+      case vm::instrs::mnemonic_t::lflags:
+        pop();
+        break;
+      case vm::instrs::mnemonic_t::pushvsp:
+        stack.push_back({});
+        break;
+      case vm::instrs::mnemonic_t::jmp: {
+        if (&vinstr != &vinstrs.back()) return {};
+
+        const auto target = pop();
+        if (target.kind != kind_t::entry) return {};
+
+        jmp_table_t table;
+        table.m_base = target.base;
+        table.m_stride = target.scale;
+        table.m_adjust = target.val;
+        table.m_size = target.size;
+        table.m_rebased = target.rebased;
+        return table;
+      }
+      default:
+        // anything else (LVSP included) has stack effects which are not
+        // modeled...
+        return {};
+    }
+  }
+
+  return {};
+}
+
+std::vector<std::uintptr_t> jmp_table_t::targets(const vm::vmctx_t& vm,
+                                                 std::size_t max) const {
+  const auto module_end = vm.m_module_base + vm.m_image_size;
+  std::uintptr_t base = 0ull;
+
+  if (m_base >= vm.m_image_base && m_base < vm.m_image_base + vm.m_image_size)
+    base = m_base - vm.m_image_base + vm.m_module_base;
+  else if (m_base >= vm.m_module_base && m_base < module_end)
+    base = m_base;
+  else
+    return {};
+
+  std::vector<std::uintptr_t> result;
+  for (auto idx = 0ull; idx < max; ++idx) {
+    if (module_end - base < m_size ||
+        (idx && m_stride > (module_end - base - m_size) / idx))
+      break;
+
+    // the image at the module base is relocated, entries that need it are
+    // module based already...
+    std::uint64_t entry = 0ull;
+    std::memcpy(&entry, reinterpret_cast<const void*>(base + idx * m_stride),
+                m_size);
+
+    auto target = entry + m_adjust;
+    if (m_rebased) target = target - vm.m_image_base + vm.m_module_base;
+
+    if (target < vm.m_module_base || target >= module_end ||
+        !vm::utils::scn::executable(vm.m_module_base, target))
+      break;
+
+    if (std::find(result.begin(), result.end(), target) == result.end())
+      result.push_back(target);
+  }
+
+  return result;
+}
+}  // namespace vm
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <logger_t.hpp>
+
+namespace vm {
+logger_t& logger_t::get() {
+  static logger_t logger;
+  return logger;
+}
+
+bool logger_t::parse(const std::string& name, log_level_t& lvl) {
+  static const std::pair<const char*, log_level_t> names[] = {
+      {"trace", log_level_t::trace}, {"debug", log_level_t::debug},
+      {"info", log_level_t::info},   {"warn", log_level_t::warn},
+      {"error", log_level_t::error}, {"off", log_level_t::off}};
+
+  const auto it =
+      std::find_if(std::begin(names), std::end(names),
+                   [&](const auto& entry) { return name == entry.first; });
+
+  if (it == std::end(names)) return false;
+  lvl = it->second;
+  return true;
+}
+
+logger_t::logger_t() : m_flusher(&logger_t::flusher, this) {}
+
+logger_t::~logger_t() {
+  {
+    std::lock_guard lock(m_bufs_lock);
+    m_stop = true;
+  }
+
+  m_wake.notify_one();
+  m_flusher.join();
+  drain();
+}
+
+void logger_t::write(log_level_t lvl, const char* fmt, ...) {
+  // most messages fit on the stack, only longer ones are formatted twice...
+  char msg[512];
+  std::va_list args;
+  va_start(args, fmt);
+  const auto len = std::vsnprintf(msg, sizeof msg, fmt, args);
+  va_end(args);
+
+  if (len < 0) return;
+
+  auto& buf = local();
+  if (static_cast<std::size_t>(len) < sizeof msg) {
+    std::lock_guard lock(buf.lock);
+    buf.data.append(msg, len);
+  } else {
+    std::string long_msg(len, '\0');
+    va_start(args, fmt);
+    std::vsnprintf(long_msg.data(), len + 1, fmt, args);
+    va_end(args);
+
+    std::lock_guard lock(buf.lock);
+    buf.data += long_msg;
+  }
+
+  if (lvl >= log_level_t::warn) {
+    {
+      std::lock_guard lock(m_bufs_lock);
+      m_urgent = true;
+    }
+    m_wake.notify_one();
+  }
+}
+
+void logger_t::flush() { drain(); }
+
+logger_t::thread_buf_t& logger_t::local() {
+  thread_local std::shared_ptr<thread_buf_t> buf;
+  if (!buf) {
+    buf = std::make_shared<thread_buf_t>();
+    std::lock_guard lock(m_bufs_lock);
+    m_bufs.push_back(buf);
+  }
+
+  return *buf;
+}
+
+void logger_t::drain() {
+  std::lock_guard drain_lock(m_drain_lock);
+  std::vector<std::shared_ptr<thread_buf_t>> bufs;
+  {
+    std::lock_guard lock(m_bufs_lock);
+    bufs = m_bufs;
+
+    // the logger holds the only reference to buffers of exited threads...
+    // those are dropped after this last drain...
+    m_bufs.erase(std::remove_if(m_bufs.begin(), m_bufs.end(),
+                                [](const auto& buf) {
+                                  return buf.use_count() == 2;
+                                }),
+                 m_bufs.end());
+  }
+
+  std::string data;
+  for (const auto& buf : bufs) {
+    {
+      std::lock_guard lock(buf->lock);
+      data.swap(buf->data);
+    }
+
+    if (!data.empty()) std::fwrite(data.data(), 1, data.size(), stdout);
+    data.clear();
+  }
+
+  std::fflush(stdout);
+}
+
+void logger_t::flusher() {
+  std::unique_lock lock(m_bufs_lock);
+  while (!m_stop) {
+    m_wake.wait_for(lock, flush_interval, [&] { return m_urgent || m_stop; });
+    m_urgent = false;
+
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+}
+}  // namespace vm
@@ -0,0 +1,78 @@
+#include <mapped_file_t.hpp>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+mapped_file_t::~mapped_file_t() { close(); }
+
+bool mapped_file_t::open(const std::string& path) {
+  close();
+#ifdef _WIN32
+  m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size) || !size.QuadPart) {
+    close();
+    return false;
+  }
+
+  if (!(m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0,
+                                       nullptr))) {
+    close();
+    return false;
+  }
+
+  m_data = reinterpret_cast<const std::uint8_t*>(
+      MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  m_size = size.QuadPart;
+#else
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) || !st.st_size) {
+    ::close(fd);
+    return false;
+  }
+
+  // the mapping keeps the file referenced, the descriptor is not needed...
+  const auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED) return false;
+
+  m_data = reinterpret_cast<const std::uint8_t*>(data);
+  m_size = st.st_size;
+#endif
+  if (!m_data) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void mapped_file_t::close() {
+#ifdef _WIN32
+  if (m_data) UnmapViewOfFile(m_data);
+  if (m_mapping) CloseHandle(m_mapping);
+  if (m_file) CloseHandle(m_file);
+  m_mapping = m_file = nullptr;
+#else
+  if (m_data) munmap(const_cast<std::uint8_t*>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0u;
+}
+}  // namespace vm
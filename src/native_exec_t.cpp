@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <native_exec_t.hpp>
+
+namespace vm {
+// unicorn-engine ids of the general purpose registers in zydis order...
+static int uc_regs[] = {
+    UC_X86_REG_RAX, UC_X86_REG_RCX, UC_X86_REG_RDX, UC_X86_REG_RBX,
+    UC_X86_REG_RSP, UC_X86_REG_RBP, UC_X86_REG_RSI, UC_X86_REG_RDI,
+    UC_X86_REG_R8,  UC_X86_REG_R9,  UC_X86_REG_R10, UC_X86_REG_R11,
+    UC_X86_REG_R12, UC_X86_REG_R13, UC_X86_REG_R14, UC_X86_REG_R15};
+
+static constexpr auto reg_cnt = sizeof uc_regs / sizeof uc_regs[0];
+static constexpr auto rsp_idx = 4u;
+
+static std::uint64_t mask(std::uint32_t bits) {
+  return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+}
+
+static std::uint64_t sext(std::uint64_t val, std::uint32_t bits) {
+  if (bits >= 64) return val;
+  val &= mask(bits);
+  return (val >> (bits - 1)) & 1 ? val | ~mask(bits) : val;
+}
+
+void native_exec_t::init(uc_engine* uc, decode_cache_t* decoder) {
+  m_uc = uc;
+  m_decoder = decoder;
+}
+
+const native_prog_t* native_exec_t::prog(const hndlr_entry_t& entry) {
+  if (const auto itr = m_progs.find(&entry); itr != m_progs.end())
+    return itr->second.supported ? &itr->second : nullptr;
+
+  auto& prog = m_progs[&entry];
+  prog.supported = !entry.trace.empty();
+
+  for (const auto addr : entry.trace) {
+    const auto instr =
+        m_decoder->contains(addr) ? m_decoder->decode(addr) : nullptr;
+
+    if (!instr || !supported(*instr)) {
+      prog.supported = false;
+      break;
+    }
+
+    prog.instrs.push_back({addr, instr});
+  }
+
+  // the recorded trace has to end the handler...
+  if (prog.supported) {
+    const auto& last = *prog.instrs.back().second;
+    prog.supported =
+        last.mnemonic == ZYDIS_MNEMONIC_RET ||
+        (last.mnemonic == ZYDIS_MNEMONIC_JMP &&
+         last.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER);
+  }
+
+  if (!prog.supported) prog.instrs.clear();
+  return prog.supported ? &prog : nullptr;
+}
+
+void native_exec_t::reject(const hndlr_entry_t& entry) {
+  auto& prog = m_progs[&entry];
+  prog.instrs.clear();
+  prog.supported = false;
+}
+
+bool native_exec_t::run(const native_prog_t& prog, const hndlr_entry_t& entry,
+                        std::uint64_t& imm) {
+  void* reg_ptrs[reg_cnt];
+  for (auto idx = 0u; idx < reg_cnt; ++idx) reg_ptrs[idx] = &m_regs[idx];
+
+  if (uc_reg_read_batch(m_uc, uc_regs, reg_ptrs, reg_cnt)) return false;
+
+  m_writes.clear();
+  m_rip = 0ull;
+
+  bool imm_read = !entry.vinstr.imm.has_imm;
+  for (const auto& [addr, instr] : prog.instrs) {
+    // the operand is read right before the native instruction it was learned
+    // at executes, same as emu_t::cached_step...
+    if (entry.vinstr.imm.has_imm && addr == entry.imm.addr) {
+      const auto reg = std::find(std::begin(uc_regs), std::end(uc_regs),
+                                 entry.imm.reg);
+      if (reg == std::end(uc_regs)) return false;
+      imm = m_regs[reg - std::begin(uc_regs)];
+      imm_read = true;
+    }
+
+    if (!step(addr, *instr)) return false;
+  }
+
+  // a program which never gets to the operand has nothing to produce the
+  // virtual instruction from...
+  return imm_read && m_rip != 0ull;
+}
+
+void native_exec_t::commit(stack_tracker_t& stack) {
+  for (const auto& write : m_writes)
+    stack.write(write.addr, &write.val, write.size);
+
+  void* reg_ptrs[reg_cnt];
+  for (auto idx = 0u; idx < reg_cnt; ++idx) reg_ptrs[idx] = &m_regs[idx];
+
+  uc_reg_write_batch(m_uc, uc_regs, reg_ptrs, reg_cnt);
+
+  // writing rip from inside of a code hook makes unicorn-engine continue at
+  // the next vm handler instead of executing this one...
+  uc_reg_write(m_uc, UC_X86_REG_RIP, &m_rip);
+}
+
+bool native_exec_t::check(std::uintptr_t rip) {
+  if (rip != m_rip) return false;
+
+  std::uint64_t regs[reg_cnt];
+  void* reg_ptrs[reg_cnt];
+  for (auto idx = 0u; idx < reg_cnt; ++idx) reg_ptrs[idx] = &regs[idx];
+
+  if (uc_reg_read_batch(m_uc, uc_regs, reg_ptrs, reg_cnt)) return false;
+
+  for (auto idx = 0u; idx < reg_cnt; ++idx)
+    if (regs[idx] != m_regs[idx]) return false;
+
+  for (const auto& write : m_writes) {
+    std::uint64_t val = 0ull, live = 0ull;
+    if (!read(write.addr, write.size, val) ||
+        uc_mem_read(m_uc, write.addr, &live, write.size) || val != live)
+      return false;
+  }
+
+  return true;
+}
+
+bool native_exec_t::supported(const zydis_decoded_instr_t& instr) {
+  switch (instr.mnemonic) {
+    case ZYDIS_MNEMONIC_MOV:
+    case ZYDIS_MNEMONIC_MOVZX:
+    case ZYDIS_MNEMONIC_MOVSX:
+    case ZYDIS_MNEMONIC_MOVSXD:
+    case ZYDIS_MNEMONIC_LEA:
+    case ZYDIS_MNEMONIC_XCHG:
+    case ZYDIS_MNEMONIC_ADD:
+    case ZYDIS_MNEMONIC_SUB:
+    case ZYDIS_MNEMONIC_XOR:
+    case ZYDIS_MNEMONIC_AND:
+    case ZYDIS_MNEMONIC_OR:
+    case ZYDIS_MNEMONIC_NOT:
+    case ZYDIS_MNEMONIC_NEG:
+    case ZYDIS_MNEMONIC_INC:
+    case ZYDIS_MNEMONIC_DEC:
+    case ZYDIS_MNEMONIC_SHL:
+    case ZYDIS_MNEMONIC_SHR:
+    case ZYDIS_MNEMONIC_SAR:
+    case ZYDIS_MNEMONIC_ROL:
+    case ZYDIS_MNEMONIC_ROR:
+    case ZYDIS_MNEMONIC_BSWAP:
+    case ZYDIS_MNEMONIC_PUSH:
+    case ZYDIS_MNEMONIC_POP:
+    case ZYDIS_MNEMONIC_RET:
+    case ZYDIS_MNEMONIC_JMP:
+    case ZYDIS_MNEMONIC_NOP:
+    case ZYDIS_MNEMONIC_CMP:
+    case ZYDIS_MNEMONIC_TEST:
+    case ZYDIS_MNEMONIC_BT:
+    case ZYDIS_MNEMONIC_CLC:
+    case ZYDIS_MNEMONIC_STC:
+    case ZYDIS_MNEMONIC_CDQE:
+    case ZYDIS_MNEMONIC_CWDE:
+    case ZYDIS_MNEMONIC_CQO:
+      break;
+    default:
+      return false;
+  }
+
+  // fs/gs based memory needs segment bases which are not modeled...
+  for (auto idx = 0u; idx < instr.operand_count; ++idx) {
+    const auto& op = instr.operands[idx];
+    if (op.type == ZYDIS_OPERAND_TYPE_MEMORY &&
+        (op.mem.segment == ZYDIS_REGISTER_FS ||
+         op.mem.segment == ZYDIS_REGISTER_GS))
+      return false;
+  }
+
+  return true;
+}
+
+bool native_exec_t::step(std::uintptr_t addr,
+                         const zydis_decoded_instr_t& instr) {
+  const auto& op0 = instr.operands[0];
+  const auto& op1 = instr.operands[1];
+  const auto size = static_cast<std::uint32_t>(op0.size);
+  std::uint64_t dst = 0ull, src = 0ull;
+
+  switch (instr.mnemonic) {
+    case ZYDIS_MNEMONIC_NOP:
+    case ZYDIS_MNEMONIC_CMP:
+    case ZYDIS_MNEMONIC_TEST:
+    case ZYDIS_MNEMONIC_BT:
+    case ZYDIS_MNEMONIC_CLC:
+    case ZYDIS_MNEMONIC_STC:
+      // only rflags are written...
+      return true;
+
+    case ZYDIS_MNEMONIC_MOV:
+      return read_op(addr, instr, op1, src) &&
+             write_op(addr, instr, op0, src);
+
+    case ZYDIS_MNEMONIC_MOVZX:
+      return read_op(addr, instr, op1, src) &&
+             write_op(addr, instr, op0, src & mask(op1.size));
+
+    case ZYDIS_MNEMONIC_MOVSX:
+    case ZYDIS_MNEMONIC_MOVSXD:
+      return read_op(addr, instr, op1, src) &&
+             write_op(addr, instr, op0, sext(src, op1.size));
+
+    case ZYDIS_MNEMONIC_LEA:
+      return write_op(addr, instr, op0, ea(addr, instr, op1));
+
+    case ZYDIS_MNEMONIC_XCHG:
+      return read_op(addr, instr, op0, dst) &&
+             read_op(addr, instr, op1, src) &&
+             write_op(addr, instr, op0, src) &&
+             write_op(addr, instr, op1, dst);
+
+    case ZYDIS_MNEMONIC_ADD:
+    case ZYDIS_MNEMONIC_SUB:
+    case ZYDIS_MNEMONIC_XOR:
+    case ZYDIS_MNEMONIC_AND:
+    case ZYDIS_MNEMONIC_OR: {
+      if (!read_op(addr, instr, op0, dst) || !read_op(addr, instr, op1, src))
+        return false;
+
+      switch (instr.mnemonic) {
+        case ZYDIS_MNEMONIC_ADD:
+          dst += src;
+          break;
+        case ZYDIS_MNEMONIC_SUB:
+          dst -= src;
+          break;
+        case ZYDIS_MNEMONIC_XOR:
+          dst ^= src;
+          break;
+        case ZYDIS_MNEMONIC_AND:
+          dst &= src;
+          break;
+        default:
+          dst |= src;
+          break;
+      }
+      return write_op(addr, instr, op0, dst);
+    }
+
+    case ZYDIS_MNEMONIC_NOT:
+    case ZYDIS_MNEMONIC_NEG:
+    case ZYDIS_MNEMONIC_INC:
+    case ZYDIS_MNEMONIC_DEC: {
+      if (!read_op(addr, instr, op0, dst)) return false;
+
+      switch (instr.mnemonic) {
+        case ZYDIS_MNEMONIC_NOT:
+          dst = ~dst;
+          break;
+        case ZYDIS_MNEMONIC_NEG:
+          dst = 0ull - dst;
+          break;
+        case ZYDIS_MNEMONIC_INC:
+          ++dst;
+          break;
+        default:
+          --dst;
+          break;
+      }
+      return write_op(addr, instr, op0, dst);
+    }
+
+    case ZYDIS_MNEMONIC_SHL:
+    case ZYDIS_MNEMONIC_SHR:
+    case ZYDIS_MNEMONIC_SAR:
+    case ZYDIS_MNEMONIC_ROL:
+    case ZYDIS_MNEMONIC_ROR: {
+      if (!read_op(addr, instr, op0, dst) || !read_op(addr, instr, op1, src))
+        return false;
+
+      auto cnt = static_cast<std::uint32_t>(src & (size == 64 ? 63 : 31));
+      if (!cnt) return true;
+
+      dst &= mask(size);
+      switch (instr.mnemonic) {
+        case ZYDIS_MNEMONIC_SHL:
+          dst = cnt >= size ? 0ull : dst << cnt;
+          break;
+        case ZYDIS_MNEMONIC_SHR:
+          dst = cnt >= size ? 0ull : dst >> cnt;
+          break;
+        case ZYDIS_MNEMONIC_SAR:
+          dst = static_cast<std::uint64_t>(static_cast<std::int64_t>(
+                    sext(dst, size)) >>
+                std::min(cnt, size - 1));
+          break;
+        case ZYDIS_MNEMONIC_ROL:
+          if ((cnt %= size)) dst = (dst << cnt) | (dst >> (size - cnt));
+          break;
+        default:
+          if ((cnt %= size)) dst = (dst >> cnt) | (dst << (size - cnt));
+          break;
+      }
+      return write_op(addr, instr, op0, dst);
+    }
+
+    case ZYDIS_MNEMONIC_BSWAP: {
+      if (!read_op(addr, instr, op0, dst)) return false;
+
+      std::uint64_t val = 0ull;
+      for (auto idx = 0u; idx < size / 8; ++idx)
+        val = (val << 8) | ((dst >> (idx * 8)) & 0xFF);
+      return write_op(addr, instr, op0, val);
+    }
+
+    case ZYDIS_MNEMONIC_CDQE:
+      m_regs[0] = sext(m_regs[0], 32);
+      return true;
+
+    case ZYDIS_MNEMONIC_CWDE:
+      m_regs[0] = sext(m_regs[0], 16) & mask(32);
+      return true;
+
+    case ZYDIS_MNEMONIC_CQO:
+      m_regs[2] = static_cast<std::int64_t>(m_regs[0]) < 0 ? ~0ull : 0ull;
+      return true;
+
+    case ZYDIS_MNEMONIC_PUSH:
+      return read_op(addr, instr, op0, src) &&
+             push(instr.operand_width / 8, src);
+
+    case ZYDIS_MNEMONIC_POP:
+      // rsp is incremented before the address of the destination is
+      // computed...
+      return pop(instr.operand_width / 8, src) &&
+             write_op(addr, instr, op0, src);
+
+    case ZYDIS_MNEMONIC_RET: {
+      if (!pop(8, m_rip)) return false;
+      if (op0.type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+          op0.visibility == ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+        m_regs[rsp_idx] += op0.imm.value.u;
+      return true;
+    }
+
+    case ZYDIS_MNEMONIC_JMP:
+      // relative jmps are already followed by the recorded trace...
+      if (op0.type == ZYDIS_OPERAND_TYPE_IMMEDIATE) return true;
+      return read_op(addr, instr, op0, m_rip);
+
+    default:
+      return false;
+  }
+}
+
+bool native_exec_t::get_reg(zydis_reg_t reg, std::uint64_t& val) const {
+  if (reg >= ZYDIS_REGISTER_AH && reg <= ZYDIS_REGISTER_BH) {
+    val = (m_regs[reg - ZYDIS_REGISTER_AH] >> 8) & 0xFF;
+    return true;
+  }
+
+  const auto full =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+  if (full < ZYDIS_REGISTER_RAX || full > ZYDIS_REGISTER_R15) return false;
+
+  val = m_regs[full - ZYDIS_REGISTER_RAX] &
+        mask(ZydisRegisterGetWidth(ZYDIS_MACHINE_MODE_LONG_64, reg));
+  return true;
+}
+
+bool native_exec_t::set_reg(zydis_reg_t reg, std::uint64_t val) {
+  if (reg >= ZYDIS_REGISTER_AH && reg <= ZYDIS_REGISTER_BH) {
+    auto& full = m_regs[reg - ZYDIS_REGISTER_AH];
+    full = (full & ~0xFF00ull) | ((val & 0xFF) << 8);
+    return true;
+  }
+
+  const auto full =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+  if (full < ZYDIS_REGISTER_RAX || full > ZYDIS_REGISTER_R15) return false;
+
+  auto& dst = m_regs[full - ZYDIS_REGISTER_RAX];
+  const auto width = ZydisRegisterGetWidth(ZYDIS_MACHINE_MODE_LONG_64, reg);
+
+  // 32bit writes zero the upper half, 8 and 16bit writes leave it alone...
+  if (width >= 32)
+    dst = val & mask(width);
+  else
+    dst = (dst & ~mask(width)) | (val & mask(width));
+  return true;
+}
+
+std::uintptr_t native_exec_t::ea(std::uintptr_t addr,
+                                 const zydis_decoded_instr_t& instr,
+                                 const zydis_decoded_operand_t& op) const {
+  std::uint64_t base = 0ull, index = 0ull;
+  if (op.mem.base == ZYDIS_REGISTER_RIP)
+    base = addr + instr.length;
+  else if (op.mem.base != ZYDIS_REGISTER_NONE)
+    get_reg(op.mem.base, base);
+
+  if (op.mem.index != ZYDIS_REGISTER_NONE) get_reg(op.mem.index, index);
+
+  auto result = base + index * (op.mem.scale ? op.mem.scale : 1) +
+                (op.mem.disp.has_displacement
+                     ? static_cast<std::uint64_t>(op.mem.disp.value)
+                     : 0ull);
+
+  return instr.address_width == 32 ? result & mask(32) : result;
+}
+
+bool native_exec_t::read_op(std::uintptr_t addr,
+                            const zydis_decoded_instr_t& instr,
+                            const zydis_decoded_operand_t& op,
+                            std::uint64_t& val) {
+  switch (op.type) {
+    case ZYDIS_OPERAND_TYPE_REGISTER:
+      return get_reg(op.reg.value, val);
+    case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+      val = op.imm.value.u;
+      return true;
+    case ZYDIS_OPERAND_TYPE_MEMORY:
+      return read(ea(addr, instr, op), op.size / 8, val);
+    default:
+      return false;
+  }
+}
+
+bool native_exec_t::write_op(std::uintptr_t addr,
+                             const zydis_decoded_instr_t& instr,
+                             const zydis_decoded_operand_t& op,
+                             std::uint64_t val) {
+  switch (op.type) {
+    case ZYDIS_OPERAND_TYPE_REGISTER:
+      return set_reg(op.reg.value, val);
+    case ZYDIS_OPERAND_TYPE_MEMORY:
+      return write(ea(addr, instr, op), op.size / 8, val);
+    default:
+      return false;
+  }
+}
+
+bool native_exec_t::read(std::uintptr_t addr, std::uint8_t size,
+                         std::uint64_t& val) {
+  if (!size || size > sizeof val) return false;
+
+  std::uint8_t bytes[sizeof val] = {};
+  if (uc_mem_read(m_uc, addr, bytes, size)) return false;
+
+  // apply the buffered writes on top of what the engine has...
+  for (const auto& write : m_writes) {
+    const auto begin = std::max(addr, write.addr);
+    const auto end = std::min(addr + size, write.addr + write.size);
+    for (auto byte = begin; byte < end; ++byte)
+      bytes[byte - addr] = (write.val >> ((byte - write.addr) * 8)) & 0xFF;
+  }
+
+  val = 0ull;
+  for (auto idx = size; idx; --idx) val = (val << 8) | bytes[idx - 1];
+  return true;
+}
+
+bool native_exec_t::write(std::uintptr_t addr, std::uint8_t size,
+                          std::uint64_t val) {
+  // unmapped memory is left to unicorn-engine and its invalid memory hook...
+  std::uint64_t probe = 0ull;
+  if (!size || size > sizeof val || uc_mem_read(m_uc, addr, &probe, size))
+    return false;
+
+  m_writes.push_back({addr, size, val & mask(size * 8)});
+  return true;
+}
+
+bool native_exec_t::push(std::uint8_t size, std::uint64_t val) {
+  m_regs[rsp_idx] -= size;
+  return write(m_regs[rsp_idx], size, val);
+}
+
+bool native_exec_t::pop(std::uint8_t size, std::uint64_t& val) {
+  if (!read(m_regs[rsp_idx], size, val)) return false;
+  m_regs[rsp_idx] += size;
+  return true;
+}
+}  // namespace vm
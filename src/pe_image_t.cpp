@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstring>
+#include <pe_image_t.hpp>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+// relocation blocks handed to a single task...
+static constexpr auto reloc_blks_per_task = 64u;
+
+pe_image_t::~pe_image_t() { unload(); }
+
+bool pe_image_t::load(const std::string& path, thread_pool_t* pool) {
+  unload();
+  if (!m_file.open(path)) return false;
+
+  const auto data = m_file.data();
+  const auto dos = reinterpret_cast<const win::dos_header_t*>(data);
+  if (m_file.size() < sizeof *dos ||
+      dos->e_lfanew + sizeof(win::nt_headers_t) > m_file.size()) {
+    unload();
+    return false;
+  }
+
+  auto img = reinterpret_cast<win::image_t<>*>(const_cast<std::uint8_t*>(data));
+  const auto nt = img->get_nt_headers();
+  m_image_base = nt->optional_header.image_base;
+  m_image_size = nt->optional_header.size_image;
+  m_map_size = (m_image_size + 0xFFFull) & ~0xFFFull;
+
+  if (!m_image_size) {
+    unload();
+    return false;
+  }
+
+#ifdef _WIN32
+  m_section = CreateFileMappingA(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+      static_cast<DWORD>(static_cast<std::uint64_t>(m_map_size) >> 32),
+      static_cast<DWORD>(m_map_size), nullptr);
+
+  if (m_section)
+    m_image = reinterpret_cast<std::uint8_t*>(
+        MapViewOfFile(m_section, FILE_MAP_WRITE, 0, 0, m_map_size));
+#else
+  m_fd = memfd_create("vmemu-image", MFD_CLOEXEC);
+  if (m_fd != -1 && !ftruncate(m_fd, m_map_size)) {
+    const auto image = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, m_fd, 0);
+    m_image = image != MAP_FAILED ? reinterpret_cast<std::uint8_t*>(image)
+                                  : nullptr;
+  }
+#endif
+
+  if (!m_image || !map_sections(pool)) {
+    unload();
+    return false;
+  }
+
+  relocate(pool);
+  return true;
+}
+
+void pe_image_t::unload() {
+#ifdef _WIN32
+  if (m_image) UnmapViewOfFile(m_image);
+  if (m_section) CloseHandle(m_section);
+  m_section = nullptr;
+#else
+  if (m_image) munmap(m_image, m_map_size);
+  if (m_fd != -1) ::close(m_fd);
+  m_fd = -1;
+#endif
+  m_file.close();
+  m_image = nullptr;
+  m_image_base = 0ull;
+  m_image_size = 0u;
+  m_map_size = 0u;
+}
+
+void* pe_image_t::map_view() const {
+  if (!m_image) return nullptr;
+#ifdef _WIN32
+  return MapViewOfFile(m_section, FILE_MAP_COPY, 0, 0, m_map_size);
+#else
+  const auto view = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, m_fd, 0);
+  return view != MAP_FAILED ? view : nullptr;
+#endif
+}
+
+void pe_image_t::unmap_view(void* view) const {
+  if (!view) return;
+#ifdef _WIN32
+  UnmapViewOfFile(view);
+#else
+  munmap(view, m_map_size);
+#endif
+}
+
+bool pe_image_t::map_sections(thread_pool_t* pool) {
+  const auto data = m_file.data();
+  auto img = reinterpret_cast<win::image_t<>*>(const_cast<std::uint8_t*>(data));
+  const auto nt = img->get_nt_headers();
+  const auto sections = nt->get_sections();
+  const auto section_cnt = nt->file_header.num_sections;
+
+  if (reinterpret_cast<const std::uint8_t*>(sections + section_cnt) >
+      data + m_file.size())
+    return false;
+
+  // headers...
+  std::memcpy(m_image, data,
+              std::min<std::size_t>({0x1000, m_file.size(), m_map_size}));
+
+  for (auto idx = 0u; idx < section_cnt; ++idx) {
+    const auto& section = sections[idx];
+    if (section.virtual_address >= m_map_size ||
+        section.ptr_raw_data >= m_file.size())
+      continue;
+
+    const auto size = std::min<std::size_t>(
+        {section.size_raw_data, m_file.size() - section.ptr_raw_data,
+         m_map_size - section.virtual_address});
+
+    // the image is zero filled memory, only raw data has to be copied...
+    const auto copy = [=, this](std::size_t) {
+      std::memcpy(m_image + section.virtual_address,
+                  data + section.ptr_raw_data, size);
+    };
+
+    if (pool)
+      pool->submit(copy);
+    else
+      copy(0u);
+  }
+
+  if (pool) pool->wait();
+  return true;
+}
+
+void pe_image_t::relocate(thread_pool_t* pool) {
+  auto img = reinterpret_cast<win::image_t<>*>(m_image);
+  const auto dir =
+      img->get_directory(win::directory_id::directory_entry_basereloc);
+  if (!dir->rva || !dir->size || dir->rva >= m_map_size) return;
+
+  const auto module_base = this->module_base();
+  const auto dir_end = module_base + std::min<std::size_t>(
+                                         dir->rva + dir->size, m_map_size);
+
+  // walking the chain of blocks is cheap, applying them is not...
+  std::vector<win::reloc_block_t*> blks;
+  auto blk = &reinterpret_cast<win::reloc_directory_t*>(module_base + dir->rva)
+                  ->first_block;
+
+  while (reinterpret_cast<std::uintptr_t>(blk) + 8 <= dir_end &&
+         blk->base_rva && blk->size_block >= 8 &&
+         reinterpret_cast<std::uintptr_t>(blk) + blk->size_block <= dir_end) {
+    blks.push_back(blk);
+    blk = blk->next();
+  }
+
+  const auto apply = [=, this](win::reloc_block_t* blk) {
+    std::for_each(blk->begin(), blk->end(), [&](win::reloc_entry_t& entry) {
+      if (entry.type != win::reloc_type_id::rel_based_dir64) return;
+
+      const auto rva = blk->base_rva + entry.offset;
+      if (rva + sizeof(std::uintptr_t) > m_map_size) return;
+
+      // relocations need not be aligned...
+      const auto reloc_at = reinterpret_cast<std::uint8_t*>(module_base + rva);
+      std::uintptr_t addr;
+      std::memcpy(&addr, reloc_at, sizeof addr);
+      addr = module_base + (addr - m_image_base);
+      std::memcpy(reloc_at, &addr, sizeof addr);
+    });
+  };
+
+  if (!pool) {
+    std::for_each(blks.begin(), blks.end(), apply);
+    return;
+  }
+
+  for (auto idx = 0u; idx < blks.size(); idx += reloc_blks_per_task)
+    pool->submit([=, &blks](std::size_t) {
+      std::for_each(
+          blks.begin() + idx,
+          blks.begin() + std::min<std::size_t>(idx + reloc_blks_per_task,
+                                               blks.size()),
+          apply);
+    });
+
+  pool->wait();
+}
+}  // namespace vm
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstring>
+#include <rtn_file_t.hpp>
+
+namespace vm {
+bool rtn_writer_t::open(const std::string& path, std::uintptr_t module_base,
+                        std::uintptr_t image_base) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_buffer = nullptr;
+  m_path = path;
+  m_file.open(path, std::ios::binary | std::ios::trunc);
+  if (!m_file.is_open()) return false;
+
+  reset(module_base, image_base);
+  return m_file.good();
+}
+
+bool rtn_writer_t::open(std::vector<std::uint8_t>& buffer,
+                        std::uintptr_t module_base,
+                        std::uintptr_t image_base) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  buffer.clear();
+  m_buffer = &buffer;
+  m_path.clear();
+  reset(module_base, image_base);
+  return true;
+}
+
+rtn_writer_t::rtn_id_t rtn_writer_t::begin_rtn(std::uint32_t rva) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  const auto id = m_next_id++;
+  m_open[id].rtn = {rva, 0u, 0u};
+  return id;
+}
+
+void rtn_writer_t::add_blk(rtn_id_t rtn, const vm::instrs::vblk_t& blk) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto& entry = m_open[rtn].blks.emplace_back();
+  entry.vip = blk.m_vip.img_base;
+  entry.branch_type = static_cast<std::uint8_t>(blk.branch_type);
+  entry.branch_cnt = static_cast<std::uint8_t>(blk.branches.size());
+  entry.vinstr_cnt = static_cast<std::uint32_t>(blk.m_vinstrs.size());
+
+  m_vinstrs.resize(blk.m_vinstrs.size());
+  std::transform(blk.m_vinstrs.begin(), blk.m_vinstrs.end(), m_vinstrs.begin(),
+                 [](const vm::instrs::vinstr_t& vinstr) -> file::vinstr_t {
+                   return {vinstr.imm.val,
+                           static_cast<std::uint8_t>(vinstr.mnemonic),
+                           vinstr.imm.size,
+                           vinstr.imm.has_imm,
+                           {}};
+                 });
+
+  entry.vinstr_tbl = m_offset;
+  write(m_vinstrs.data(), m_vinstrs.size() * sizeof(file::vinstr_t));
+
+  // branches are module based while emulating...
+  m_branches.resize(blk.branches.size());
+  std::transform(blk.branches.begin(), blk.branches.end(), m_branches.begin(),
+                 [&](std::uintptr_t br) -> std::uint64_t {
+                   return br - m_module_base + m_image_base;
+                 });
+
+  entry.branch_tbl = m_offset;
+  write(m_branches.data(), m_branches.size() * sizeof(std::uint64_t));
+}
+
+void rtn_writer_t::end_rtn(rtn_id_t rtn) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  const auto itr = m_open.find(rtn);
+  if (itr == m_open.end()) return;
+
+  auto& [entry, blks] = itr->second;
+  entry.blk_cnt = static_cast<std::uint32_t>(blks.size());
+  entry.blk_tbl = m_offset;
+  write(blks.data(), blks.size() * sizeof(file::blk_t));
+
+  m_rtns.push_back(entry);
+  m_open.erase(itr);
+}
+
+void rtn_writer_t::add_rtn(const vm::instrs::vrtn_t& rtn) {
+  const auto id = begin_rtn(static_cast<std::uint32_t>(rtn.m_rva));
+  for (const auto& blk : rtn.m_blks) add_blk(id, blk);
+  end_rtn(id);
+}
+
+bool rtn_writer_t::close() {
+  std::lock_guard<std::mutex> guard(m_lock);
+  file::hdr_t hdr{};
+  hdr.magic = file::magic;
+  hdr.version = file::version;
+  hdr.hdr_size = sizeof hdr;
+  hdr.image_base = m_image_base;
+  hdr.rtn_cnt = static_cast<std::uint32_t>(m_rtns.size());
+  hdr.rtn_tbl = m_offset;
+  write(m_rtns.data(), m_rtns.size() * sizeof(file::rtn_t));
+  m_open.clear();
+
+  if (m_buffer) {
+    std::memcpy(m_buffer->data(), &hdr, sizeof hdr);
+    m_buffer = nullptr;
+    return true;
+  }
+
+  m_file.seekp(0);
+  m_file.write(reinterpret_cast<const char*>(&hdr), sizeof hdr);
+
+  const auto result = m_file.good();
+  m_file.close();
+  return result;
+}
+
+void rtn_writer_t::reset(std::uintptr_t module_base,
+                         std::uintptr_t image_base) {
+  m_offset = 0u;
+  m_module_base = module_base;
+  m_image_base = image_base;
+  m_open.clear();
+  m_rtns.clear();
+
+  // placeholder, the real header is written by close()...
+  file::hdr_t hdr{};
+  write(&hdr, sizeof hdr);
+}
+
+void rtn_writer_t::write(const void* data, std::size_t size) {
+  if (m_buffer) {
+    const auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+    m_buffer->insert(m_buffer->end(), bytes, bytes + size);
+  } else {
+    m_file.write(reinterpret_cast<const char*>(data), size);
+  }
+  m_offset += size;
+}
+
+bool rtn_file_t::init(const std::uint8_t* data, std::size_t size) {
+  m_data = data;
+  m_size = size;
+
+  const auto hdr = table<file::hdr_t>(0u, 1u);
+  if (hdr.empty() || hdr[0].magic != file::magic ||
+      hdr[0].version != file::version || hdr[0].hdr_size != sizeof(file::hdr_t))
+    return false;
+
+  m_hdr = hdr.data();
+  m_rtns = table<file::rtn_t>(m_hdr->rtn_tbl, m_hdr->rtn_cnt);
+  return m_rtns.size() == m_hdr->rtn_cnt;
+}
+
+std::span<const file::blk_t> rtn_file_t::blks(const file::rtn_t& rtn) const {
+  return table<file::blk_t>(rtn.blk_tbl, rtn.blk_cnt);
+}
+
+std::span<const file::vinstr_t> rtn_file_t::vinstrs(
+    const file::blk_t& blk) const {
+  return table<file::vinstr_t>(blk.vinstr_tbl, blk.vinstr_cnt);
+}
+
+std::span<const std::uint64_t> rtn_file_t::branches(
+    const file::blk_t& blk) const {
+  return table<std::uint64_t>(blk.branch_tbl, blk.branch_cnt);
+}
+
+void rtn_file_t::to_vrtn(const file::rtn_t& rtn, std::uintptr_t module_base,
+                         vm::instrs::vrtn_t& vrtn) const {
+  vrtn.m_rva = rtn.rva;
+  vrtn.m_blks.clear();
+
+  for (const auto& blk : blks(rtn)) {
+    auto& vblk = vrtn.m_blks.emplace_back();
+    vblk.m_vip.img_base = blk.vip;
+    vblk.m_vip.rva = blk.vip - m_hdr->image_base;
+    vblk.branch_type = static_cast<vm::instrs::vbranch_type>(blk.branch_type);
+
+    for (const auto br : branches(blk))
+      vblk.branches.push_back(br - m_hdr->image_base + module_base);
+
+    for (const auto& vinstr : vinstrs(blk)) {
+      auto& entry = vblk.m_vinstrs.emplace_back();
+      entry.mnemonic = static_cast<vm::instrs::mnemonic_t>(vinstr.mnemonic);
+      entry.imm.has_imm = vinstr.has_imm;
+      entry.imm.size = vinstr.imm_size;
+      entry.imm.val = vinstr.imm;
+    }
+  }
+}
+}  // namespace vm
@@ -0,0 +1,447 @@
+#include <analysis_cache_t.hpp>
+#include <chrono>
+#include <cstring>
+#include <emu_pool_t.hpp>
+#include <future>
+#include <optional>
+#include <server_t.hpp>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+// a loaded binary and everything kept resident for it...
+struct server_t::image_t {
+  std::string path;
+  pe_image_t image;
+  std::optional<analysis_cache_t> cache;
+  std::vector<hndlr_profile_t> profiles;
+  std::unique_ptr<decode_cache_t> decode_cache;
+  hndlr_kb_t hndlr_kb;
+  std::unique_ptr<emu_pool_t> engines;
+
+  // routine files of the vm entries emulated so far...
+  std::mutex lock;
+  std::unordered_map<std::uint32_t, std::vector<std::uint8_t>> rtns;
+};
+
+template <class T>
+static void put(std::vector<std::uint8_t>& reply, const T& val) {
+  const auto bytes = reinterpret_cast<const std::uint8_t*>(&val);
+  reply.insert(reply.end(), bytes, bytes + sizeof val);
+}
+
+#ifndef _WIN32
+// how often a thread blocked on a socket looks at the cancel token, in ms...
+constexpr int poll_interval = 250;
+
+// read exactly size bytes... false on eof, an error or once cancelled...
+static bool recv_all(int fd, void* data, std::size_t size,
+                     const std::atomic<bool>* cancel) {
+  auto bytes = static_cast<std::uint8_t*>(data);
+  while (size) {
+    if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+
+    pollfd pfd{fd, POLLIN, 0};
+    const auto ready = ::poll(&pfd, 1u, poll_interval);
+    if (ready < 0 && errno != EINTR) return false;
+    if (ready <= 0) continue;
+
+    const auto cnt = ::recv(fd, bytes, size, 0);
+    if (cnt < 0 && errno == EINTR) continue;
+    if (cnt <= 0) return false;
+
+    bytes += cnt;
+    size -= static_cast<std::size_t>(cnt);
+  }
+
+  return true;
+}
+
+// a client which went away must not kill the daemon with SIGPIPE... linux
+// has a flag per send, macos an option per socket (see run)...
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+static bool send_all(int fd, const void* data, std::size_t size) {
+  auto bytes = static_cast<const std::uint8_t*>(data);
+  while (size) {
+    const auto cnt = ::send(fd, bytes, size, send_flags);
+    if (cnt < 0 && errno == EINTR) continue;
+    if (cnt <= 0) return false;
+
+    bytes += cnt;
+    size -= static_cast<std::size_t>(cnt);
+  }
+
+  return true;
+}
+
+// only a socket nobody listens on anymore is replaced, any other file at the
+// path and the socket of a running daemon are left alone...
+static bool remove_stale(const sockaddr_un& addr) {
+  struct stat st;
+  if (::lstat(addr.sun_path, &st) < 0) return errno == ENOENT;
+  if (!S_ISSOCK(st.st_mode)) {
+    VMEMU_ERROR("> %s exists and is not a socket...\n", addr.sun_path);
+    return false;
+  }
+
+  const auto probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe < 0) return false;
+
+  const auto live = !::connect(probe, reinterpret_cast<const sockaddr*>(&addr),
+                               sizeof addr);
+  ::close(probe);
+  if (live) {
+    VMEMU_ERROR("> another daemon is listening on %s...\n", addr.sun_path);
+    return false;
+  }
+
+  return !::unlink(addr.sun_path) || errno == ENOENT;
+}
+#endif
+
+server_t::server_t(const emu_cfg_t& cfg, thread_pool_t& pool)
+    : m_cfg(cfg), m_pool(pool) {}
+
+bool server_t::run(const std::string& path) {
+#ifdef _WIN32
+  VMEMU_ERROR("> unix domain sockets are not supported on windows...\n");
+  return false;
+#else
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof addr.sun_path) {
+    VMEMU_ERROR("> socket path %s is too long...\n", path.c_str());
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+  const auto listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    VMEMU_ERROR("> failed to create socket... %s\n", std::strerror(errno));
+    return false;
+  }
+
+  if (!remove_stale(addr)) {
+    ::close(listener);
+    return false;
+  }
+
+  // whoever can connect can make the daemon read any file it can, the socket
+  // is created accessible to its owner alone...
+  const auto mask = ::umask(0177);
+  const auto bound =
+      !::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof addr);
+  ::umask(mask);
+
+  if (!bound || ::listen(listener, SOMAXCONN) < 0) {
+    VMEMU_ERROR("> failed to listen on %s... %s\n", path.c_str(),
+                std::strerror(errno));
+    ::close(listener);
+    if (bound) ::unlink(path.c_str());
+    return false;
+  }
+
+  VMEMU_INFO("> listening on %s with %zu worker threads...\n", path.c_str(),
+             m_pool.size());
+
+  while (!stopped()) {
+    pollfd pfd{listener, POLLIN, 0};
+    if (::poll(&pfd, 1u, poll_interval) <= 0) continue;
+
+    const auto fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) continue;
+
+#ifdef SO_NOSIGPIPE
+    const int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      if (m_conns >= serve::max_conns) {
+        VMEMU_WARN("> %zu connections already served, dropping client...\n",
+                   m_conns);
+        ::close(fd);
+        continue;
+      }
+
+      ++m_conns;
+    }
+
+    std::thread([this, fd] {
+      serve(fd);
+      ::close(fd);
+
+      std::lock_guard<std::mutex> guard(m_lock);
+      if (!--m_conns) m_conns_cv.notify_all();
+    }).detach();
+  }
+
+  ::close(listener);
+  ::unlink(path.c_str());
+
+  // connections notice the cancel token within a poll interval, emulation
+  // they wait for stops at its next check...
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_conns_cv.wait(lock, [&] { return !m_conns; });
+
+  // profiles learned go back into the cache for the next run...
+  for (const auto& [id, image] : m_images) store_hndlrs(*image);
+  m_images.clear();
+  return true;
+#endif
+}
+
+#ifndef _WIN32
+void server_t::serve(int fd) {
+  std::vector<std::uint8_t> request, reply;
+  for (std::uint32_t size = 0u;
+       recv_all(fd, &size, sizeof size, m_cfg.cancel);) {
+    if (size > serve::max_request) {
+      VMEMU_WARN("> request of %d bytes is too large, dropping client...\n",
+                 size);
+      return;
+    }
+
+    request.resize(size);
+    if (!recv_all(fd, request.data(), size, m_cfg.cancel)) return;
+
+    reply.clear();
+    handle(request, reply);
+
+    const auto reply_size = static_cast<std::uint32_t>(reply.size());
+    if (!send_all(fd, &reply_size, sizeof reply_size) ||
+        !send_all(fd, reply.data(), reply.size()))
+      return;
+  }
+}
+#endif
+
+void server_t::handle(const std::vector<std::uint8_t>& request,
+                      std::vector<std::uint8_t>& reply) {
+  const auto u32 = [&](std::size_t offset) {
+    std::uint32_t val;
+    std::memcpy(&val, request.data() + offset, sizeof val);
+    return val;
+  };
+
+  switch (static_cast<serve::op_t>(request.empty() ? 0u : request[0])) {
+    case serve::op_t::load:
+      if (request.size() > 1u)
+        return load({request.begin() + 1, request.end()}, reply);
+      break;
+    case serve::op_t::emulate:
+      if (request.size() == 9u) return emulate(u32(1u), u32(5u), reply);
+      break;
+    case serve::op_t::unload:
+      if (request.size() == 5u) return unload(u32(1u), reply);
+      break;
+  }
+
+  put(reply, serve::reply_t::malformed);
+}
+
+void server_t::load(const std::string& path,
+                    std::vector<std::uint8_t>& reply) {
+  // caller holds m_lock...
+  const auto loaded = [&]() -> std::optional<std::uint32_t> {
+    for (const auto& [id, image] : m_images)
+      if (image->path == path) return id;
+    return {};
+  };
+
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (const auto id = loaded()) {
+      put(reply, serve::reply_t::ok);
+      put(reply, *id);
+      return;
+    }
+  }
+
+  auto image = std::make_shared<image_t>();
+  image->path = path;
+  if (!image->image.load(path) || !image->image.module_base()) {
+    VMEMU_ERROR("> failed to load %s...\n", path.c_str());
+    put(reply, serve::reply_t::load_failed);
+    return;
+  }
+
+  auto cfg = m_cfg;
+  if (!m_cache_dir.empty()) {
+    image->cache.emplace();
+    if (!image->cache->open(m_cache_dir, image->image)) {
+      VMEMU_WARN("> failed to open the cache of %s...\n", path.c_str());
+      image->cache.reset();
+    } else if (image->cache->load_hndlrs(image->profiles)) {
+      cfg.profiles = &image->profiles;
+    }
+  }
+
+  image->decode_cache = std::make_unique<decode_cache_t>(
+      image->image.module_base(), image->image.image_size());
+  cfg.image = &image->image;
+  cfg.decode_cache = image->decode_cache.get();
+  cfg.hndlr_kb = &image->hndlr_kb;
+  image->engines = std::make_unique<emu_pool_t>(m_pool.size(), cfg);
+
+  std::lock_guard<std::mutex> guard(m_lock);
+
+  // a concurrent load of the same binary may have won...
+  auto id = loaded();
+  if (!id) {
+    id = m_next_id++;
+    m_images[*id] = std::move(image);
+    VMEMU_INFO("> loaded %s as image %d...\n", path.c_str(), *id);
+  }
+
+  put(reply, serve::reply_t::ok);
+  put(reply, *id);
+}
+
+void server_t::emulate(std::uint32_t id, std::uint32_t rva,
+                       std::vector<std::uint8_t>& reply) {
+  const auto image = find(id);
+  if (!image) {
+    put(reply, serve::reply_t::unknown_image);
+    return;
+  }
+
+  const auto begin = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> guard(image->lock);
+    if (const auto rtn = image->rtns.find(rva); rtn != image->rtns.end()) {
+      put(reply, serve::reply_t::ok);
+      put(reply, emu_status_t::ok);
+      reply.insert(reply.end(), rtn->second.begin(), rtn->second.end());
+      return;
+    }
+  }
+
+  // the routine file is built on the worker, this thread only waits for it...
+  std::vector<std::uint8_t> rtn_file;
+  std::promise<emu_status_t> done;
+  auto status_future = done.get_future();
+
+  m_pool.submit([&, image](std::size_t worker_idx) {
+    const auto& pe = image->image;
+    vm::instrs::vrtn_t vrtn;
+    auto status = emu_status_t::error;
+    bool cached = false;
+
+    if (image->cache && image->cache->load_rtn(rva, vrtn)) {
+      status = emu_status_t::ok;
+      cached = true;
+    } else if (stopped()) {
+      status = emu_status_t::cancelled;
+    } else {
+      vm::vmctx_t vmctx(pe.module_base(), pe.image_base(), pe.image_size(),
+                        rva);
+
+      if (!vmctx.init()) {
+        VMEMU_ERROR("> failed to init vmctx for vm entry rva = 0x%x...\n", rva);
+      } else if (const auto emu = image->engines->get(worker_idx, &vmctx);
+                 !emu) {
+        VMEMU_ERROR("> failed to init vm::emu_t for vm entry rva = 0x%x...\n",
+                    rva);
+      } else if (emu->emulate(rva, vrtn)) {
+        status = emu_status_t::ok;
+      } else if (emu->status() != emu_status_t::ok) {
+        status = emu->status();
+      }
+    }
+
+    if (status == emu_status_t::ok) {
+      rtn_writer_t writer;
+      writer.open(rtn_file, pe.module_base(), pe.image_base());
+      writer.add_rtn(vrtn);
+      writer.close();
+
+      rtn_writer_t cache_writer;
+      if (!cached && image->cache &&
+          image->cache->begin_rtn(rva, cache_writer)) {
+        cache_writer.add_rtn(vrtn);
+        image->cache->commit_rtn(rva, cache_writer);
+      }
+    }
+
+    done.set_value(status);
+  });
+
+  const auto status = status_future.get();
+  VMEMU_DEBUG("> image %d, vm entry rva = 0x%x, %s in %lld us...\n", id, rva,
+              emu_t::status_name(status),
+              static_cast<long long>(
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count()));
+
+  if (status != emu_status_t::ok) {
+    put(reply, serve::reply_t::emu_failed);
+    put(reply, status);
+    return;
+  }
+
+  put(reply, serve::reply_t::ok);
+  put(reply, status);
+  reply.insert(reply.end(), rtn_file.begin(), rtn_file.end());
+
+  std::lock_guard<std::mutex> guard(image->lock);
+  image->rtns.emplace(rva, std::move(rtn_file));
+}
+
+void server_t::unload(std::uint32_t id, std::vector<std::uint8_t>& reply) {
+  std::shared_ptr<image_t> image;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (const auto entry = m_images.find(id); entry != m_images.end()) {
+      image = std::move(entry->second);
+      m_images.erase(entry);
+    }
+  }
+
+  if (!image) {
+    put(reply, serve::reply_t::unknown_image);
+    return;
+  }
+
+  // requests still emulating on the image keep it alive until they are
+  // answered...
+  store_hndlrs(*image);
+  VMEMU_INFO("> unloaded image %d...\n", id);
+  put(reply, serve::reply_t::ok);
+}
+
+std::shared_ptr<server_t::image_t> server_t::find(std::uint32_t id) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  const auto image = m_images.find(id);
+  return image != m_images.end() ? image->second : nullptr;
+}
+
+void server_t::store_hndlrs(image_t& image) const {
+  if (!image.cache) return;
+
+  std::vector<hndlr_profile_t> learned;
+  image.hndlr_kb.trusted(learned);
+  if (!image.cache->store_hndlrs(learned))
+    VMEMU_WARN("> failed to cache vm handler profiles of %s...\n",
+               image.path.c_str());
+}
+
+bool server_t::stopped() const {
+  return m_cfg.cancel && m_cfg.cancel->load(std::memory_order_relaxed);
+}
+}  // namespace vm
@@ -0,0 +1,37 @@
+#include <spill_file_t.hpp>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+namespace vm {
+spill_file_t::~spill_file_t() {
+  if (m_file) std::fclose(m_file);
+}
+
+bool spill_file_t::write(const void* data, std::size_t size,
+                         std::uint64_t& offset) {
+  if (!m_file && !(m_file = std::tmpfile())) return false;
+  if (!seek(m_size) || std::fwrite(data, 1u, size, m_file) != size)
+    return false;
+
+  offset = m_size;
+  m_size += size;
+  return true;
+}
+
+bool spill_file_t::read(std::uint64_t offset, void* data, std::size_t size) {
+  if (!m_file || offset + size > m_size) return false;
+
+  // reads have to be separated from preceding writes by a seek...
+  return seek(offset) && std::fread(data, 1u, size, m_file) == size;
+}
+
+bool spill_file_t::seek(std::uint64_t offset) {
+#ifdef _WIN32
+  return !_fseeki64(m_file, static_cast<long long>(offset), SEEK_SET);
+#else
+  return !fseeko(m_file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+}  // namespace vm
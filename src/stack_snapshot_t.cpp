@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cstring>
+#include <stack_snapshot_t.hpp>
+
+namespace vm {
+bool stack_snapshot_t::spill(spill_file_t& file) {
+  if (m_spilled) return true;
+  if (!file.write(m_data.data(), m_data.size(), m_spill_offset)) return false;
+
+  std::vector<std::uint8_t>().swap(m_data);
+  return m_spilled = true;
+}
+
+bool stack_snapshot_t::load(spill_file_t& file) {
+  if (!m_spilled) return true;
+
+  m_data.resize(m_present.count() * PAGE_4KB);
+  if (!file.read(m_spill_offset, m_data.data(), m_data.size())) return false;
+
+  m_spilled = false;
+  return true;
+}
+
+stack_tracker_t::stack_tracker_t()
+    : m_mirror(std::make_unique<std::uint8_t[]>(STACK_SIZE)) {}
+
+bool stack_tracker_t::init(uc_engine* uc) {
+  m_uc = uc;
+  return !uc_hook_add(uc, &m_hook, UC_HOOK_MEM_WRITE,
+                      (void*)&vm::stack_tracker_t::mem_write, this, STACK_BASE,
+                      STACK_BASE + (STACK_SIZE)-1);
+}
+
+void stack_tracker_t::sync() {
+  if (m_dirty.none()) return;
+
+  for (auto idx = 0u; idx < STACK_PAGE_CNT; ++idx)
+    if (m_dirty.test(idx))
+      uc_mem_read(m_uc, STACK_BASE + idx * PAGE_4KB,
+                  m_mirror.get() + idx * PAGE_4KB, PAGE_4KB);
+
+  VMEMU_STAT_ADD(m_stats, stack_bytes, m_dirty.count() * PAGE_4KB);
+  m_dirty.reset();
+}
+
+void stack_tracker_t::snapshot(stack_snapshot_t& snap) const {
+  snap.m_present = m_touched;
+  snap.m_data.resize(m_touched.count() * PAGE_4KB);
+
+  auto data = snap.m_data.data();
+  for (auto idx = 0u; idx < STACK_PAGE_CNT; ++idx) {
+    if (!m_touched.test(idx)) continue;
+
+    std::memcpy(data, m_mirror.get() + idx * PAGE_4KB, PAGE_4KB);
+    data += PAGE_4KB;
+  }
+
+  VMEMU_STAT_ADD(m_stats, stack_bytes, snap.m_data.size());
+}
+
+void stack_tracker_t::restore(const stack_snapshot_t& snap) {
+  // pages which are not in the snapshot but have been written to since have to
+  // be zeroed out again...
+  auto data = snap.m_data.data();
+  for (auto idx = 0u; idx < STACK_PAGE_CNT; ++idx) {
+    const auto mirror = m_mirror.get() + idx * PAGE_4KB;
+    if (snap.m_present.test(idx)) {
+      std::memcpy(mirror, data, PAGE_4KB);
+      data += PAGE_4KB;
+    } else if (m_touched.test(idx))
+      std::memset(mirror, 0, PAGE_4KB);
+    else
+      continue;
+
+    uc_mem_write(m_uc, STACK_BASE + idx * PAGE_4KB, mirror, PAGE_4KB);
+    VMEMU_STAT_ADD(m_stats, stack_bytes, PAGE_4KB);
+  }
+
+  m_touched |= snap.m_present;
+  m_dirty.reset();
+}
+
+void stack_tracker_t::revert() {
+  if (m_dirty.none()) return;
+
+  for (auto idx = 0u; idx < STACK_PAGE_CNT; ++idx)
+    if (m_dirty.test(idx))
+      uc_mem_write(m_uc, STACK_BASE + idx * PAGE_4KB,
+                   m_mirror.get() + idx * PAGE_4KB, PAGE_4KB);
+
+  VMEMU_STAT_ADD(m_stats, stack_bytes, m_dirty.count() * PAGE_4KB);
+  m_dirty.reset();
+}
+
+void stack_tracker_t::reset() {
+  // an empty snapshot is an all zero stack...
+  restore(stack_snapshot_t{});
+  m_touched.reset();
+}
+
+uc_err stack_tracker_t::write(std::uintptr_t addr, const void* data,
+                              std::size_t size) {
+  mark(addr, size);
+  return uc_mem_write(m_uc, addr, data, size);
+}
+
+void stack_tracker_t::mark(std::uintptr_t addr, std::size_t size) {
+  if (addr + size <= STACK_BASE || addr >= STACK_BASE + (STACK_SIZE)) return;
+
+  const auto first = (std::max<std::uintptr_t>(addr, STACK_BASE) - STACK_BASE) /
+                     PAGE_4KB;
+  const auto last = (std::min<std::uintptr_t>(addr + size - 1,
+                                              STACK_BASE + (STACK_SIZE)-1) -
+                     STACK_BASE) /
+                    PAGE_4KB;
+
+  for (auto idx = first; idx <= last; ++idx) {
+    m_dirty.set(idx);
+    m_touched.set(idx);
+  }
+}
+
+void stack_tracker_t::mem_write(uc_engine* uc, uc_mem_type type,
+                                uint64_t address, int size, int64_t value,
+                                stack_tracker_t* obj) {
+  obj->mark(address, size);
+}
+}  // namespace vm
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <thread_pool_t.hpp>
+
+namespace vm {
+/// <summary>
+/// pool and index of the worker running on this thread if any...
+/// </summary>
+static thread_local const thread_pool_t* g_pool = nullptr;
+static thread_local std::size_t g_worker_idx = 0u;
+
+thread_pool_t::thread_pool_t(std::size_t worker_cnt) {
+  if (!worker_cnt)
+    worker_cnt = std::max(std::thread::hardware_concurrency(), 1u);
+
+  for (auto idx = 0u; idx < worker_cnt; ++idx)
+    m_queues.push_back(std::make_unique<queue_t>());
+
+  for (auto idx = 0u; idx < worker_cnt; ++idx)
+    m_threads.emplace_back(&thread_pool_t::run, this, idx);
+}
+
+thread_pool_t::~thread_pool_t() {
+  wait();
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stop = true;
+  }
+
+  m_work_cv.notify_all();
+  for (auto& thread : m_threads) thread.join();
+}
+
+void thread_pool_t::submit(task_t task) {
+  ++m_pending;
+  const auto own = g_pool == this;
+  auto& queue = *m_queues[own ? g_worker_idx : m_next++ % m_queues.size()];
+  {
+    // counted under the queue lock so that pop never takes a task which is
+    // not counted yet...
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (own)
+      queue.tasks.push_back(std::move(task));
+    else
+      queue.tasks.push_front(std::move(task));
+    ++m_queued;
+  }
+
+  // a worker checking m_queued right now has either seen the task or is
+  // already waiting for the notification...
+  { std::lock_guard<std::mutex> guard(m_lock); }
+  m_work_cv.notify_one();
+}
+
+void thread_pool_t::wait() {
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_done_cv.wait(lock, [&]() { return !m_pending; });
+}
+
+void thread_pool_t::run(std::size_t worker_idx) {
+  g_pool = this;
+  g_worker_idx = worker_idx;
+
+  while (true) {
+    task_t task;
+    if (pop(worker_idx, task)) {
+      task(worker_idx);
+      if (!--m_pending) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_done_cv.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_work_cv.wait(lock, [&]() { return m_stop || m_queued; });
+    if (m_stop && !m_queued) return;
+  }
+}
+
+bool thread_pool_t::pop(std::size_t worker_idx, task_t& task) {
+  // own queue first (newest task, its data is most likely still in cache)
+  // then steal the oldest task of the other workers...
+  for (auto idx = 0u; idx < m_queues.size(); ++idx) {
+    const auto own = !idx;
+    auto& queue = *m_queues[(worker_idx + idx) % m_queues.size()];
+
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) continue;
+
+    if (own) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+
+    --m_queued;
+    return true;
+  }
+  return false;
+}
+}  // namespace vm
@@ -2,48 +2,105 @@
 #include <vmemu_t.hpp>
 
 namespace vm {
-emu_t::emu_t(vm::vmctx_t* vm_ctx) : m_vm(vm_ctx) {}
+emu_t::emu_t(vm::vmctx_t* vm_ctx, const emu_cfg_t& cfg)
+    : m_vm(vm_ctx),
+      m_cfg(cfg),
+      m_decoder(cfg.decode_cache),
+      m_hndlr_kb(cfg.hndlr_kb),
+      m_worklist(cfg.order) {
+  if (!m_decoder) {
+    m_own_decoder = std::make_unique<decode_cache_t>(m_vm->m_module_base,
+                                                     m_vm->m_image_size);
+    m_decoder = m_own_decoder.get();
+  }
+
+  if (!m_hndlr_kb) {
+    m_own_hndlr_kb = std::make_unique<hndlr_kb_t>();
+    m_hndlr_kb = m_own_hndlr_kb.get();
+  }
+
+  m_hndlr_cache.init(m_hndlr_kb);
+  if (m_cfg.profiles)
+    for (const auto& profile : *m_cfg.profiles) m_hndlr_cache.add(profile);
+}
 
 emu_t::~emu_t() {
+  if (m_golden) uc_context_free(m_golden);
   if (uc) uc_close(uc);
+  if (m_view) m_cfg.image->unmap_view(m_view);
 }
 
 bool emu_t::init() {
   uc_err err;
   if ((err = uc_open(UC_ARCH_X86, UC_MODE_64, &uc))) {
-    std::printf("> uc_open err = %d\n", err);
+    VMEMU_ERROR("> uc_open err = %d\n", err);
     return false;
   }
 
+  m_ctx_pool.init(uc);
+  m_native.init(uc, m_decoder);
+  cc_trace.m_uc = uc;
+
   if ((err = uc_mem_map(uc, STACK_BASE, STACK_SIZE, UC_PROT_ALL))) {
-    std::printf("> uc_mem_map stack err, reason = %d\n", err);
+    VMEMU_ERROR("> uc_mem_map stack err, reason = %d\n", err);
     return false;
   }
 
-  if ((err = uc_mem_map(uc, m_vm->m_module_base, m_vm->m_image_size,
-                        UC_PROT_ALL))) {
-    std::printf("> map memory failed, reason = %d\n", err);
+  if (!m_stack.init(uc)) {
+    VMEMU_ERROR("> failed to hook stack writes...\n");
     return false;
   }
 
-  if ((err = uc_mem_write(uc, m_vm->m_module_base,
-                          reinterpret_cast<void*>(m_vm->m_module_base),
-                          m_vm->m_image_size))) {
-    std::printf("> failed to write memory... reason = %d\n", err);
+  // a loaded image is mapped without copying it, the engine gets a private
+  // copy on write view of it...
+  if (m_cfg.image && !(m_view = m_cfg.image->map_view())) {
+    VMEMU_ERROR("> failed to map a view of the image...\n");
     return false;
   }
 
-  if ((err = uc_hook_add(uc, &code_exec_hook, UC_HOOK_CODE,
-                         (void*)&vm::emu_t::code_exec_callback, this,
-                         m_vm->m_module_base,
-                         m_vm->m_module_base + m_vm->m_image_size))) {
-    std::printf("> uc_hook_add error, reason = %d\n", err);
+  // in lazy mode nothing of the image is mapped up front, see map_chunk...
+  if (m_cfg.lazy_chunk) {
+    m_chunks.assign((image_map_size() + m_cfg.lazy_chunk - 1) /
+                        m_cfg.lazy_chunk,
+                    false);
+  } else if (m_cfg.image) {
+    if ((err = uc_mem_map_ptr(uc, m_vm->m_module_base,
+                              m_cfg.image->map_size(), UC_PROT_ALL,
+                              m_view))) {
+      VMEMU_ERROR("> map memory failed, reason = %d\n", err);
+      return false;
+    }
+  } else {
+    if ((err = uc_mem_map(uc, m_vm->m_module_base, m_vm->m_image_size,
+                          UC_PROT_ALL))) {
+      VMEMU_ERROR("> map memory failed, reason = %d\n", err);
+      return false;
+    }
+
+    if ((err = uc_mem_write(uc, m_vm->m_module_base,
+                            reinterpret_cast<void*>(m_vm->m_module_base),
+                            m_vm->m_image_size))) {
+      VMEMU_ERROR("> failed to write memory... reason = %d\n", err);
+      return false;
+    }
+  }
+
+  if ((err = m_cfg.block_hooks
+                 ? uc_hook_add(uc, &code_exec_hook, UC_HOOK_BLOCK,
+                               (void*)&vm::emu_t::block_callback, this,
+                               m_vm->m_module_base,
+                               m_vm->m_module_base + m_vm->m_image_size)
+                 : uc_hook_add(uc, &code_exec_hook, UC_HOOK_CODE,
+                               (void*)&vm::emu_t::code_callback, this,
+                               m_vm->m_module_base,
+                               m_vm->m_module_base + m_vm->m_image_size))) {
+    VMEMU_ERROR("> uc_hook_add error, reason = %d\n", err);
     return false;
   }
 
   if ((err = uc_hook_add(uc, &int_hook, UC_HOOK_INTR,
                          (void*)&vm::emu_t::int_callback, this, 0ull, 0ull))) {
-    std::printf("> uc_hook_add error, reason = %d\n", err);
+    VMEMU_ERROR("> uc_hook_add error, reason = %d\n", err);
     return false;
   }
 
@@ -52,15 +109,83 @@ bool emu_t::init() {
                        UC_HOOK_MEM_READ_UNMAPPED | UC_HOOK_MEM_WRITE_UNMAPPED |
                            UC_HOOK_MEM_FETCH_UNMAPPED,
                        (void*)&vm::emu_t::invalid_mem, this, true, false))) {
-    std::printf("> uc_hook_add error, reason = %d\n", err);
+    VMEMU_ERROR("> uc_hook_add error, reason = %d\n", err);
+    return false;
+  }
+
+  // pages of the image written to are put back by reset...
+  m_image_dirty.assign(image_map_size() / PAGE_4KB, false);
+  if ((err = uc_hook_add(uc, &image_write_hook, UC_HOOK_MEM_WRITE,
+                         (void*)&vm::emu_t::image_write, this,
+                         m_vm->m_module_base,
+                         m_vm->m_module_base + image_map_size() - 1))) {
+    VMEMU_ERROR("> uc_hook_add error, reason = %d\n", err);
     return false;
   }
+
+  if ((err = uc_context_alloc(uc, &m_golden)) ||
+      (err = uc_context_save(uc, m_golden))) {
+    VMEMU_ERROR("> failed to save the initial cpu state... reason = %d\n",
+                err);
+    return false;
+  }
+  return true;
+}
+
+bool emu_t::reset(vm::vmctx_t* vm_ctx) {
+  if (!m_golden) return false;
+
+  // the image and the hooks over it stay where they are... the vm the engine
+  // was bound to before may be long gone so the decoder is asked instead...
+  if (vm_ctx) {
+    if (vm_ctx->m_module_base != m_decoder->base() ||
+        vm_ctx->m_image_size != m_decoder->size()) {
+      VMEMU_ERROR("> cannot rebind an engine to a vm of another image...\n");
+      return false;
+    }
+    m_vm = vm_ctx;
+  }
+
+  uc_context_restore(uc, m_golden);
+  m_stack.reset();
+  restore_memory();
+
+  reset_trace();
+  m_worklist.clear();
+  m_jmp_stacks.clear();
+  m_jmp_refs.clear();
+  m_jmp_bytes = 0u;
+  m_spill.clear();
+  m_mode = mode_t::trace;
+  m_sreg_cnt = 0u;
+  m_status = emu_status_t::ok;
+  cc_native = nullptr;
+  cc_in_hndlr = cc_retrace = cc_retraced = false;
+  cc_blk = nullptr;
+  cc_vrtn = nullptr;
+  cc_sink = nullptr;
+
+  for (auto& fork : m_forks)
+    if (fork && !fork->reset(vm_ctx)) return false;
+
   return true;
 }
 
-bool emu_t::emulate(std::uint32_t vmenter_rva, vm::instrs::vrtn_t& vrtn) {
+bool emu_t::emulate(std::uint32_t vmenter_rva, vm::instrs::vrtn_t& vrtn,
+                    const blk_sink_t& sink) {
+  VMEMU_STAT_INC(m_stats, routines);
+  VMEMU_STAT_TIME(m_stats, emulate_ns);
+
   uc_err err;
   vrtn.m_rva = vmenter_rva;
+  cc_sink = sink ? &sink : nullptr;
+  m_ws.run_chunks = m_ws.faults = m_ws.zero_pages = 0u;
+
+  m_status = emu_status_t::ok;
+  m_deadline = std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(m_cfg.time_budget);
+  cc_hndlr_instrs = cc_blk_instrs = cc_rtn_instrs = 0u;
+  cc_clock_instrs = 0u;
 
   auto& blk = vrtn.m_blks.emplace_back();
   blk.m_vip = {0ull, 0ull};
@@ -74,79 +199,201 @@ bool emu_t::emulate(std::uint32_t vmenter_rva, vm::instrs::vrtn_t& vrtn) {
                  rsp = STACK_BASE + STACK_SIZE - PAGE_4KB;
 
   if ((err = uc_reg_write(uc, UC_X86_REG_RSP, &rsp))) {
-    std::printf("> uc_reg_write error, reason = %d\n", err);
+    VMEMU_ERROR("> uc_reg_write error, reason = %d\n", err);
+    m_status = emu_status_t::error;
     return false;
   }
 
   if ((err = uc_reg_write(uc, UC_X86_REG_RIP, &rip))) {
-    std::printf("> uc_reg_write error, reason = %d\n", err);
+    VMEMU_ERROR("> uc_reg_write error, reason = %d\n", err);
+    m_status = emu_status_t::error;
     return false;
   }
 
   cc_trace.m_vip = cc_blk->m_vm.vip;
   cc_trace.m_vsp = cc_blk->m_vm.vsp;
 
-  std::printf("> beginning execution at = %p\n", rip);
+  cc_in_hndlr = false;
+  VMEMU_DEBUG("> beginning execution at = 0x%llx\n",
+              static_cast<unsigned long long>(rip));
   if ((err = uc_emu_start(uc, rip, 0ull, 0ull, 0ull))) {
-    std::printf("> error starting emu... reason = %d\n", err);
+    VMEMU_ERROR("> error starting emu... reason = %d\n", err);
+    m_status = emu_status_t::error;
     return false;
   }
 
-  extract_branch_data();
-  std::printf("> emulated blk_%p\n\n", cc_blk->m_vip.img_base);
-
-  // keep track of the emulated blocks... by their addresses...
-  std::vector<std::uintptr_t> blk_addrs;
-  blk_addrs.push_back(blk.m_vip.rva + m_vm->m_module_base);
-
-  // the vector containing the vblk's grows inside of this for loop
-  // thus we cannot use an advanced for loop (which uses itr's)...
-  for (auto idx = 0u; idx < cc_vrtn->m_blks.size(); ++idx) {
-    vm::instrs::vblk_t blk = cc_vrtn->m_blks[idx];
-    if (blk.branch_type != vm::instrs::vbranch_type::none) {
-      // force the emulation of all branches...
-      for (const auto br : blk.branches) {
-        // only emulate blocks that havent been emulated before...
-        if (std::find(blk_addrs.begin(), blk_addrs.end(), br) !=
-            blk_addrs.end())
-          continue;
-
-        std::uintptr_t vsp = 0ull;
-        uc_context_restore(uc, blk.m_jmp.ctx);
-        uc_mem_write(uc, STACK_BASE, blk.m_jmp.stack, STACK_SIZE);
-        uc_reg_read(uc, vm::instrs::reg_map[blk.m_vm.vsp], &vsp);
-
-        // setup new cc_blk...
-        auto& new_blk = vrtn.m_blks.emplace_back();
-        new_blk.m_vip = {0ull, 0ull};
-        new_blk.m_vm = {blk.m_jmp.m_vm.vip, blk.m_jmp.m_vm.vsp};
-        cc_blk = &new_blk;
-
-        // emulate the branch...
-        uc_mem_write(uc, vsp, &br, sizeof br);
-        std::printf("> beginning execution at = %p\n", blk.m_jmp.rip);
-        if ((err = uc_emu_start(uc, blk.m_jmp.rip, 0ull, 0ull, 0ull))) {
-          std::printf("> error starting emu... reason = %d\n", err);
-          return false;
-        }
+  // every branch is queued once, the first time its target is seen...
+  m_worklist.clear();
+  if (m_status == emu_status_t::ok) {
+    extract_branch_data();
+    VMEMU_DEBUG("> emulated blk_%llx\n\n",
+                static_cast<unsigned long long>(cc_blk->m_vip.img_base));
+    emit_blk();
+
+    m_worklist.visit(cc_blk->m_vip.rva + m_vm->m_module_base);
+    queue_branches(0u, 1u);
+  }
 
-        extract_branch_data();
-        std::printf("> emulated blk_%p\n", cc_blk->m_vip.img_base);
+  // the budgets are checked by the hooks, the clock and cancellation token
+  // also before every block...
+  while (m_status == emu_status_t::ok && in_time()) {
+    const auto item = m_worklist.pop();
+    if (!item) break;
+
+    // vrtn.m_blks grows below, copy what is needed from the source block...
+    const auto src = vrtn.m_blks[item->src_blk].m_jmp;
+    const auto vsp_reg = vrtn.m_blks[item->src_blk].m_vm.vsp;
+    const auto br = item->target;
+
+    auto& src_stack = jmp_stack(item->src_blk);
+    if (src_stack.spilled()) {
+      if (!src_stack.load(m_spill)) {
+        VMEMU_ERROR("> failed to read back a spilled stack snapshot...\n");
+        m_status = emu_status_t::error;
+        return false;
       }
+
+      m_jmp_bytes += src_stack.size();
+      VMEMU_STAT_INC(m_stats, snap_loads);
+    }
+
+    std::uintptr_t vsp = 0ull;
+    uc_context_restore(uc, src.ctx);
+    m_stack.restore(src_stack);
+    uc_reg_read(uc, vm::instrs::reg_map[vsp_reg], &vsp);
+
+    // the virtual jmp is not needed anymore once every branch of it started...
+    if (!--m_jmp_refs[item->src_blk]) release_jmp(item->src_blk);
+
+    // setup new cc_blk...
+    auto& new_blk = vrtn.m_blks.emplace_back();
+    new_blk.m_vip = {0ull, 0ull};
+    new_blk.m_vm = {src.m_vm.vip, src.m_vm.vsp};
+    cc_blk = &new_blk;
+
+    // emulate the branch...
+    cc_native = nullptr;
+    cc_in_hndlr = false;
+    m_stack.write(vsp, &br, sizeof br);
+    cc_blk_instrs = 0u;
+    VMEMU_DEBUG("> beginning execution at = 0x%llx\n",
+                static_cast<unsigned long long>(src.rip));
+    if ((err = uc_emu_start(uc, src.rip, 0ull, 0ull, 0ull))) {
+      VMEMU_ERROR("> error starting emu... reason = %d\n", err);
+      m_status = emu_status_t::error;
+      return false;
     }
-  }
 
-  // free all virtual code block virtual jmp information...
-  std::for_each(vrtn.m_blks.begin(), vrtn.m_blks.end(),
-                [&](vm::instrs::vblk_t& blk) {
-                  if (blk.m_jmp.ctx) uc_context_free(blk.m_jmp.ctx);
+    if (m_status != emu_status_t::ok) break;
 
-                  if (blk.m_jmp.stack) delete[] blk.m_jmp.stack;
-                });
+    extract_branch_data();
+    VMEMU_DEBUG("> emulated blk_%llx\n",
+                static_cast<unsigned long long>(cc_blk->m_vip.img_base));
+    emit_blk();
+
+    m_worklist.visit(cc_blk->m_vip.rva + m_vm->m_module_base);
+    queue_branches(vrtn.m_blks.size() - 1, item->depth + 1);
+  }
+
+  // every virtual jmp was released along the way unless emulation was cut
+  // short...
+  for (auto idx = 0u; idx < vrtn.m_blks.size(); ++idx) release_jmp(idx);
+
+  m_jmp_stacks.clear();
+  m_jmp_refs.clear();
+  m_spill.clear();
+  cc_sink = nullptr;
+
+  if (m_cfg.lazy_chunk)
+    VMEMU_INFO(
+        "> working set = %zu of %zu image chunks (%zu kb), %zu mapped by this "
+        "run, %zu faults, %zu zero filled pages...\n",
+        m_ws.chunks, m_chunks.size(), (m_ws.chunks * m_cfg.lazy_chunk) >> 10,
+        m_ws.run_chunks, m_ws.faults, m_ws.zero_pages);
+
+  if (m_status != emu_status_t::ok) {
+    // the hooks may have been stopped in the middle of a vm handler...
+    reset_trace();
+    VMEMU_WARN(
+        "> emulation of vm entry rva = 0x%x stopped after %zu blocks, %s\n",
+        vmenter_rva, vrtn.m_blks.size(), status_name(m_status));
+    return false;
+  }
 
   return true;
 }
 
+void emu_t::queue_branches(std::size_t blk_idx, std::uint32_t depth) {
+  const auto& blk = cc_vrtn->m_blks[blk_idx];
+  auto queued = 0u;
+
+  if (blk.branch_type != vm::instrs::vbranch_type::none)
+    for (const auto br : blk.branches)
+      queued += m_worklist.push({blk_idx, br, depth});
+
+  // nothing will ever start from the virtual jmp of this block...
+  if (!queued) {
+    release_jmp(blk_idx);
+    return;
+  }
+
+  if (m_jmp_refs.size() <= blk_idx) m_jmp_refs.resize(blk_idx + 1);
+  m_jmp_refs[blk_idx] = queued;
+  if (m_cfg.snapshot_budget && m_jmp_bytes > m_cfg.snapshot_budget)
+    spill_jmps();
+}
+
+void emu_t::release_jmp(std::size_t blk_idx) {
+  auto& blk = cc_vrtn->m_blks[blk_idx];
+  if (blk.m_jmp.ctx) {
+    m_ctx_pool.release(blk.m_jmp.ctx);
+    blk.m_jmp.ctx = nullptr;
+  }
+
+  if (blk_idx >= m_jmp_stacks.size()) return;
+
+  // a snapshot is accounted for from the moment it is taken until it is
+  // freed here, a spilled one has a size of 0...
+  auto& stack = m_jmp_stacks[blk_idx];
+  m_jmp_bytes -= stack.size();
+  if (blk_idx < m_jmp_refs.size()) m_jmp_refs[blk_idx] = 0u;
+
+  stack = {};
+}
+
+void emu_t::spill_jmps() {
+  // breadth first emulates the most recent blocks last, every other order the
+  // oldest ones...
+  const auto newest_first = m_worklist.order() == worklist_t::order_t::bfs;
+  const auto cnt = m_jmp_refs.size();
+
+  for (auto idx = 0u; idx < cnt && m_jmp_bytes > m_cfg.snapshot_budget;
+       ++idx) {
+    const auto blk_idx = newest_first ? cnt - idx - 1 : idx;
+    auto& stack = m_jmp_stacks[blk_idx];
+    if (!m_jmp_refs[blk_idx] || stack.spilled() || stack.empty()) continue;
+
+    const auto size = stack.size();
+    if (!stack.spill(m_spill)) {
+      VMEMU_WARN("> failed to spill stack snapshot, budget exceeded...\n");
+      return;
+    }
+
+    m_jmp_bytes -= size;
+    VMEMU_STAT_INC(m_stats, snap_spills);
+  }
+}
+
+void emu_t::emit_blk() {
+  if (!cc_sink) return;
+
+  (*cc_sink)(*cc_vrtn, *cc_blk);
+
+  // the sink owns the virtual instructions now, only the branch information
+  // of the block is needed to continue exploring the routine...
+  std::vector<vm::instrs::vinstr_t>().swap(cc_blk->m_vinstrs);
+}
+
 void emu_t::extract_branch_data() {
   auto br_info = could_have_jcc(cc_blk->m_vinstrs);
   if (br_info.has_value()) {
@@ -157,27 +404,52 @@ void emu_t::extract_branch_data() {
     br1 += m_vm->m_module_base;
     br2 += m_vm->m_module_base;
 
-    auto br1_legit = legit_branch(*cc_blk, br1);
-    auto br2_legit = legit_branch(*cc_blk, br2);
-    std::printf("> br1 legit: %d, br2 legit: %d\n", br1_legit, br2_legit);
+    const auto& stack = jmp_stack(cc_blk - cc_vrtn->m_blks.data());
+    const auto [br1_legit, br2_legit] =
+        legit_branches(*cc_blk, stack, br1, br2);
+    VMEMU_DEBUG("> br1 legit: %d, br2 legit: %d\n", br1_legit, br2_legit);
 
     if (br1_legit && br2_legit) {
-      std::printf("> virtual jcc uncovered... br1 = %p, br2 = %p\n", br1, br2);
+      VMEMU_DEBUG("> virtual jcc uncovered... br1 = 0x%llx, br2 = 0x%llx\n",
+                  static_cast<unsigned long long>(br1),
+                  static_cast<unsigned long long>(br2));
       cc_blk->branch_type = vm::instrs::vbranch_type::jcc;
       cc_blk->branches.push_back(br1);
       cc_blk->branches.push_back(br2);
     } else if (br1_legit || br2_legit) {
-      std::printf("> absolute virtual jmp uncovered... branch = %p\n",
-                  br1_legit ? br1 : br2);
+      VMEMU_DEBUG("> absolute virtual jmp uncovered... branch = 0x%llx\n",
+                  static_cast<unsigned long long>(br1_legit ? br1 : br2));
       cc_blk->branch_type = vm::instrs::vbranch_type::absolute;
       cc_blk->branches.push_back(br1_legit ? br1 : br2);
     } else {
-      std::printf("> unknown branch type...\n");
+      VMEMU_WARN("> unknown branch type...\n");
     }
   } else if (cc_blk->m_vinstrs.back().mnemonic ==
              vm::instrs::mnemonic_t::vmexit) {
     cc_blk->branch_type = vm::instrs::vbranch_type::none;
   } else if (cc_blk->m_vinstrs.back().mnemonic == vm::instrs::mnemonic_t::jmp) {
+    // a jump table has a constant too (its base), look for one first...
+    if (const auto table = jmp_table_t::find(cc_blk->m_vinstrs); table) {
+      auto targets = table->targets(*m_vm, max_table_entries);
+      const auto entries = targets.size();
+      legit_targets(*cc_blk, jmp_stack(cc_blk - cc_vrtn->m_blks.data()),
+                    targets);
+
+      if (!targets.empty()) {
+        VMEMU_DEBUG(
+            "> virtual jump table uncovered... %zu of %zu entries legit\n",
+            targets.size(), entries);
+        VMEMU_STAT_INC(m_stats, jmp_tables);
+        VMEMU_STAT_ADD(m_stats, table_targets, targets.size());
+        cc_blk->branch_type = vm::instrs::vbranch_type::table;
+        cc_blk->branches = std::move(targets);
+        return;
+      }
+
+      VMEMU_WARN("> no legit entry in virtual jump table of %zu entries...\n",
+                 entries);
+    }
+
     // see if there is 1 lconst...
     if (auto last_lconst = std::find_if(
             cc_blk->m_vinstrs.rbegin(), cc_blk->m_vinstrs.rend(),
@@ -200,7 +472,7 @@ void emu_t::extract_branch_data() {
         cc_blk->branch_type = vm::instrs::vbranch_type::absolute;
       }
     } else {
-      std::printf("> jump table detected... review instruction stream...\n");
+      VMEMU_WARN("> jump table detected... review instruction stream...\n");
       uc_emu_stop(uc);
     }
   }
@@ -209,19 +481,18 @@ void emu_t::extract_branch_data() {
 void emu_t::int_callback(uc_engine* uc, std::uint32_t intno, emu_t* obj) {
   uc_err err;
   std::uintptr_t rip = 0ull;
-  static thread_local zydis_decoded_instr_t instr;
 
   if ((err = uc_reg_read(uc, UC_X86_REG_RIP, &rip))) {
-    std::printf("> failed to read rip... reason = %d\n", err);
+    VMEMU_ERROR("> failed to read rip... reason = %d\n", err);
     return;
   }
 
-  if (!ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(vm::utils::g_decoder.get(),
-                                             reinterpret_cast<void*>(rip),
-                                             PAGE_4KB, &instr))) {
-    std::printf("> failed to decode instruction at = 0x%p\n", rip);
+  const auto instr = obj->m_decoder->decode(rip);
+  if (!instr) {
+    VMEMU_ERROR("> failed to decode instruction at = 0x%llx\n",
+                static_cast<unsigned long long>(rip));
     if ((err = uc_emu_stop(uc))) {
-      std::printf("> failed to stop emulation, exiting... reason = %d\n", err);
+      VMEMU_ERROR("> failed to stop emulation, exiting... reason = %d\n", err);
       exit(0);
     }
     return;
@@ -229,151 +500,154 @@ void emu_t::int_callback(uc_engine* uc, std::uint32_t intno, emu_t* obj) {
 
   // advance rip over the instruction that caused the exception... this is
   // usually a division by 0...
-  rip += instr.length;
+  rip += instr->length;
 
   if ((err = uc_reg_write(uc, UC_X86_REG_RIP, &rip))) {
-    std::printf("> failed to write rip... reason = %d\n", err);
+    VMEMU_ERROR("> failed to write rip... reason = %d\n", err);
     return;
   }
 }
 
+bool emu_t::code_callback(uc_engine* uc, uint64_t address, uint32_t size,
+                          emu_t* obj) {
+  VMEMU_STAT_INC(obj->m_stats, instrs_hooked);
+  if (!obj->charge(1u)) return false;
+
+  switch (obj->m_mode) {
+    case mode_t::trace:
+      return code_exec_callback(uc, address, size, obj);
+    case mode_t::speculative:
+      return branch_pred_spec_exec(uc, address, size, obj);
+    default:
+      return true;
+  }
+}
+
 bool emu_t::branch_pred_spec_exec(uc_engine* uc, uint64_t address,
                                   uint32_t size, emu_t* obj) {
+  VMEMU_STAT_INC(obj->m_stats, spec_instrs);
   uc_err err;
-  static thread_local zydis_decoded_instr_t instr;
-  if (!ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(vm::utils::g_decoder.get(),
-                                             reinterpret_cast<void*>(address),
-                                             PAGE_4KB, &instr))) {
-    std::printf("> failed to decode instruction at = 0x%p\n", address);
+  const auto instr = obj->m_decoder->decode(address);
+  if (!instr) {
+    VMEMU_ERROR("> failed to decode instruction at = 0x%llx\n",
+                static_cast<unsigned long long>(address));
     if ((err = uc_emu_stop(uc))) {
-      std::printf("> failed to stop emulation, exiting... reason = %d\n", err);
+      VMEMU_ERROR("> failed to stop emulation, exiting... reason = %d\n", err);
       exit(0);
     }
     return false;
   }
 
-  if (instr.mnemonic == ZYDIS_MNEMONIC_INVALID) return false;
-
-  uc_context* ctx;
-  uc_context_alloc(uc, &ctx);
-  uc_context_save(uc, ctx);
+  if (instr->mnemonic == ZYDIS_MNEMONIC_INVALID) return false;
 
   // if this is the first instruction of this handler then save the stack...
-  if (!obj->cc_trace.m_instrs.size()) {
-    obj->cc_trace.m_stack = new std::uint8_t[STACK_SIZE];
-    uc_mem_read(uc, STACK_BASE, obj->cc_trace.m_stack, STACK_SIZE);
+  std::optional<vm::instrs::vinstr_t> vinstr;
+  if (obj->cc_addrs.empty()) {
+    obj->m_stack.sync();
+    obj->cc_trace.m_stack = obj->m_stack.mirror();
+    obj->cc_trace.m_begin = address;
+    obj->cc_hndlr =
+        obj->cc_uncached ? nullptr : obj->m_hndlr_cache.get(obj->hndlr_key());
+    vinstr = obj->native_step(address);
   }
 
-  obj->cc_trace.m_instrs.push_back({instr, ctx});
-
-  // RET or JMP REG means the end of a vm handler...
-  if (instr.mnemonic == ZYDIS_MNEMONIC_RET ||
-      (instr.mnemonic == ZYDIS_MNEMONIC_JMP &&
-       instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER)) {
-    // deobfuscate the instruction stream before profiling...
-    // makes it easier for profiles to be correct...
-    vm::instrs::deobfuscate(obj->cc_trace);
-
-    // find the last MOV REG, DWORD PTR [VIP] in the instruction stream, then
-    // remove any instructions from this instruction to the JMP/RET...
-    const auto rva_fetch = std::find_if(
-        obj->cc_trace.m_instrs.rbegin(), obj->cc_trace.m_instrs.rend(),
-        [& vip = obj->cc_trace.m_vip](
-            const vm::instrs::emu_instr_t& instr) -> bool {
-          const auto& i = instr.m_instr;
-          return i.mnemonic == ZYDIS_MNEMONIC_MOV &&
-                 i.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
-                 i.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY &&
-                 i.operands[1].mem.base == vip && i.operands[1].size == 32;
-        });
-
-    if (rva_fetch != obj->cc_trace.m_instrs.rend())
-      obj->cc_trace.m_instrs.erase((rva_fetch + 1).base(),
-                                   obj->cc_trace.m_instrs.end());
-
-    const auto vinstr = vm::instrs::determine(obj->cc_trace);
+  // unless the handler already ran on the host...
+  if (!vinstr) {
+    obj->cc_addrs.push_back(address);
+    if (obj->cc_hndlr) {
+      if (!(vinstr = obj->cached_step(address, *instr))) return true;
+    } else {
+      const auto ctx = obj->m_ctx_pool.save();
+      obj->cc_ctxs.push_back(ctx);
+      obj->cc_trace.m_instrs.push_back({*instr, ctx});
 
-    // -- free the trace since we will start a new one...
-    std::for_each(obj->cc_trace.m_instrs.begin(), obj->cc_trace.m_instrs.end(),
-                  [&](const vm::instrs::emu_instr_t& instr) {
-                    uc_context_free(instr.m_cpu);
-                  });
+      // RET or JMP REG means the end of a vm handler...
+      if (!hndlr_end(*instr)) return true;
 
-    delete[] obj->cc_trace.m_stack;
-    obj->cc_trace.m_instrs.clear();
+      vinstr = obj->determine();
+    }
+  }
 
-    if (vinstr.mnemonic != vm::instrs::mnemonic_t::jmp) {
-      if (vinstr.mnemonic != vm::instrs::mnemonic_t::sreg) uc_emu_stop(uc);
+  if (vinstr->mnemonic != vm::instrs::mnemonic_t::jmp) {
+    if (vinstr->mnemonic != vm::instrs::mnemonic_t::sreg) uc_emu_stop(uc);
 
-      if (!vinstr.imm.has_imm) uc_emu_stop(uc);
+    if (!vinstr->imm.has_imm) uc_emu_stop(uc);
 
-      if (vinstr.imm.size != 8 || vinstr.imm.val > 8 * VIRTUAL_REGISTER_COUNT)
-        uc_emu_stop(uc);
+    if (vinstr->imm.size != 8 || vinstr->imm.val > 8 * VIRTUAL_REGISTER_COUNT)
+      uc_emu_stop(uc);
 
-      // -- stop after 10 legit SREG's...
-      if (++obj->m_sreg_cnt == 10) uc_emu_stop(uc);
-    }
+    // -- stop after 10 legit SREG's...
+    if (++obj->m_sreg_cnt == 10) uc_emu_stop(uc);
   }
+
+  // -- free the trace since we will start a new one...
+  obj->reset_trace();
   return true;
 }
 
 bool emu_t::code_exec_callback(uc_engine* uc, uint64_t address, uint32_t size,
                                emu_t* obj) {
   uc_err err;
-  static thread_local zydis_decoded_instr_t instr;
-  if (!ZYAN_SUCCESS(ZydisDecoderDecodeBuffer(vm::utils::g_decoder.get(),
-                                             reinterpret_cast<void*>(address),
-                                             PAGE_4KB, &instr))) {
-    std::printf("> failed to decode instruction at = 0x%p\n", address);
+  const auto instr = obj->m_decoder->decode(address);
+  if (!instr) {
+    VMEMU_ERROR("> failed to decode instruction at = 0x%llx\n",
+                static_cast<unsigned long long>(address));
     if ((err = uc_emu_stop(uc))) {
-      std::printf("> failed to stop emulation, exiting... reason = %d\n", err);
+      VMEMU_ERROR("> failed to stop emulation, exiting... reason = %d\n", err);
       exit(0);
     }
     return false;
   }
 
-  if (instr.mnemonic == ZYDIS_MNEMONIC_INVALID) return false;
-
-  uc_context* ctx;
-  uc_context_alloc(uc, &ctx);
-  uc_context_save(uc, ctx);
+  if (instr->mnemonic == ZYDIS_MNEMONIC_INVALID) return false;
 
   // if this is the first instruction of this handler then save the stack...
-  if (!obj->cc_trace.m_instrs.size()) {
-    obj->cc_trace.m_stack = new std::uint8_t[STACK_SIZE];
+  if (obj->cc_addrs.empty()) {
+    obj->m_stack.sync();
+    obj->cc_trace.m_stack = obj->m_stack.mirror();
     obj->cc_trace.m_begin = address;
-    uc_mem_read(uc, STACK_BASE, obj->cc_trace.m_stack, STACK_SIZE);
+
+    // vm handlers which have been profiled before are not traced... the first
+    // handler of a block always is since its trace is used to find the vip of
+    // the block...
+    // a retrace is over once the next vm handler starts...
+    if (obj->cc_retrace && std::exchange(obj->cc_retraced, true)) {
+      uc_emu_stop(uc);
+      return true;
+    }
+
+    obj->cc_hndlr = !obj->cc_uncached && obj->cc_blk->m_vip.rva &&
+                            obj->cc_blk->m_vip.img_base
+                        ? obj->m_hndlr_cache.get(obj->hndlr_key())
+                        : nullptr;
+
+    if (const auto vinstr = obj->native_step(address); vinstr) {
+      print_vinstr(vinstr.value());
+      obj->cc_blk->m_vinstrs.push_back(vinstr.value());
+      return true;
+    }
   }
 
-  obj->cc_trace.m_instrs.push_back({instr, ctx});
+  obj->cc_addrs.push_back(address);
 
-  // RET or JMP REG means the end of a vm handler...
-  if (instr.mnemonic == ZYDIS_MNEMONIC_RET ||
-      (instr.mnemonic == ZYDIS_MNEMONIC_JMP &&
-       instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER)) {
-    // deobfuscate the instruction stream before profiling...
-    // makes it easier for profiles to be correct...
-    vm::instrs::deobfuscate(obj->cc_trace);
-
-    // find the last MOV REG, DWORD PTR [VIP] in the instruction stream, then
-    // remove any instructions from this instruction to the JMP/RET...
-    const auto rva_fetch = std::find_if(
-        obj->cc_trace.m_instrs.rbegin(), obj->cc_trace.m_instrs.rend(),
-        [& vip = obj->cc_trace.m_vip](
-            const vm::instrs::emu_instr_t& instr) -> bool {
-          const auto& i = instr.m_instr;
-          return i.mnemonic == ZYDIS_MNEMONIC_MOV &&
-                 i.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
-                 i.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY &&
-                 i.operands[1].mem.base == vip && i.operands[1].size == 32;
-        });
-
-    if (rva_fetch != obj->cc_trace.m_instrs.rend())
-      obj->cc_trace.m_instrs.erase((rva_fetch + 1).base(),
-                                   obj->cc_trace.m_instrs.end());
+  if (obj->cc_hndlr) {
+    if (const auto vinstr = obj->cached_step(address, *instr); vinstr) {
+      print_vinstr(vinstr.value());
+      obj->cc_blk->m_vinstrs.push_back(vinstr.value());
+    }
+    return true;
+  }
+
+  const auto ctx = obj->m_ctx_pool.save();
+  obj->cc_ctxs.push_back(ctx);
+  obj->cc_trace.m_instrs.push_back({*instr, ctx});
 
+  // RET or JMP REG means the end of a vm handler...
+  if (hndlr_end(*instr)) {
     // set the virtual code block vip address information...
     if (!obj->cc_blk->m_vip.rva || !obj->cc_blk->m_vip.img_base) {
+      obj->deobfuscate();
+
       // find the last write done to VIP...
       auto vip_write = std::find_if(
           obj->cc_trace.m_instrs.rbegin(), obj->cc_trace.m_instrs.rend(),
@@ -384,9 +658,7 @@ bool emu_t::code_exec_callback(uc_engine* uc, uint64_t address, uint32_t size,
                    i.operands[0].reg.value == vip;
           });
 
-      uc_context* backup;
-      uc_context_alloc(uc, &backup);
-      uc_context_save(uc, backup);
+      const auto backup = obj->m_ctx_pool.save();
       uc_context_restore(uc, (--vip_write)->m_cpu);
 
       std::uintptr_t vip_addr = 0ull;
@@ -396,17 +668,11 @@ bool emu_t::code_exec_callback(uc_engine* uc, uint64_t address, uint32_t size,
       obj->cc_blk->m_vip.img_base = vip_addr += obj->m_vm->m_image_base;
 
       uc_context_restore(uc, backup);
-      uc_context_free(backup);
+      obj->m_ctx_pool.release(backup);
     } else {
-      const auto vinstr = vm::instrs::determine(obj->cc_trace);
+      const auto vinstr = obj->determine();
       if (vinstr.mnemonic != vm::instrs::mnemonic_t::unknown) {
-        if (vinstr.imm.has_imm)
-          std::printf("> %s %p\n",
-                      vm::instrs::get_profile(vinstr.mnemonic)->name.c_str(),
-                      vinstr.imm.val);
-        else
-          std::printf("> %s\n",
-                      vm::instrs::get_profile(vinstr.mnemonic)->name.c_str());
+        print_vinstr(vinstr);
       } else {
         zydis_rtn_t inst_stream;
         std::for_each(obj->cc_trace.m_instrs.begin(),
@@ -415,40 +681,41 @@ bool emu_t::code_exec_callback(uc_engine* uc, uint64_t address, uint32_t size,
                         inst_stream.push_back({instr.m_instr});
                       });
 
-        std::printf(
-            "> err: please define the following vm handler (at = %p):\n",
-            (obj->cc_trace.m_begin - obj->m_vm->m_module_base) +
-                obj->m_vm->m_image_base);
+        VMEMU_ERROR(
+            "> err: please define the following vm handler (at = 0x%llx):\n",
+            static_cast<unsigned long long>(
+                (obj->cc_trace.m_begin - obj->m_vm->m_module_base) +
+                obj->m_vm->m_image_base));
 
+        // vm::utils::print writes to stdout directly...
+        vm::logger_t::get().flush();
         vm::utils::print(inst_stream);
+        obj->reset_trace();
         uc_emu_stop(uc);
         return false;
       }
 
       if (obj->cc_blk->m_vinstrs.size()) {
         if (vinstr.mnemonic == vm::instrs::mnemonic_t::jmp) {
-          uc_context *backup, *copy;
-
-          // backup current unicorn-engine context...
-          uc_context_alloc(uc, &backup);
-          uc_context_alloc(uc, &copy);
-          uc_context_save(uc, backup);
-
-          // make a copy of the first cpu context of the jmp handler...
-          uc_context_restore(uc, obj->cc_trace.m_instrs.begin()->m_cpu);
-          uc_context_save(uc, copy);
-
-          // restore the unicorn-engine context... also free the backup...
-          uc_context_restore(uc, backup);
-          uc_context_free(backup);
+          // take ownership of the first cpu context of the jmp handler so
+          // that it does not go back into the pool with the rest of the
+          // trace...
+          const auto jmp_ctx = obj->cc_trace.m_instrs.begin()->m_cpu;
+          obj->cc_ctxs.erase(
+              std::find(obj->cc_ctxs.begin(), obj->cc_ctxs.end(), jmp_ctx));
 
           // set current code block virtual jmp instruction information...
-          obj->cc_blk->m_jmp.ctx = copy;
+          obj->cc_blk->m_jmp.ctx = jmp_ctx;
           obj->cc_blk->m_jmp.rip = obj->cc_trace.m_begin;
-          obj->cc_blk->m_jmp.stack = new std::uint8_t[STACK_SIZE];
           obj->cc_blk->m_jmp.m_vm = {obj->cc_trace.m_vip, obj->cc_trace.m_vsp};
-          std::memcpy(obj->cc_blk->m_jmp.stack, obj->cc_trace.m_stack,
-                      STACK_SIZE);
+
+          // the stack mirror has not been synced since the first instruction
+          // of this handler so it still holds the stack of the jmp handler...
+          auto& stack =
+              obj->jmp_stack(obj->cc_blk - obj->cc_vrtn->m_blks.data());
+          obj->m_jmp_bytes -= stack.size();
+          obj->m_stack.snapshot(stack);
+          obj->m_jmp_bytes += stack.size();
         }
 
         if (vinstr.mnemonic == vm::instrs::mnemonic_t::jmp ||
@@ -460,88 +727,813 @@ bool emu_t::code_exec_callback(uc_engine* uc, uint64_t address, uint32_t size,
     }
 
     // -- free the trace since we will start a new one...
-    std::for_each(obj->cc_trace.m_instrs.begin(), obj->cc_trace.m_instrs.end(),
-                  [&](const vm::instrs::emu_instr_t& instr) {
-                    uc_context_free(instr.m_cpu);
-                  });
+    obj->reset_trace();
+  }
+  return true;
+}
+
+void emu_t::block_callback(uc_engine* uc, uint64_t address, uint32_t size,
+                           emu_t* obj) {
+  VMEMU_STAT_INC(obj->m_stats, blocks_hooked);
+  if (!obj->cc_in_hndlr) {
+    obj->cc_in_hndlr = true;
+    if (!obj->hndlr_begin(address)) {
+      // the handler ran on the host or emulation was stopped, either way
+      // the next block unicorn-engine executes is the start of a handler...
+      obj->cc_in_hndlr = false;
+      return;
+    }
+  }
+
+  // the last instruction of the block tells if the next one starts a new vm
+  // handler...
+  const zydis_decoded_instr_t* instr = nullptr;
+  auto instrs = 0u;
+  for (auto addr = address; addr < address + size; addr += instr->length) {
+    if (!(instr = obj->m_decoder->decode(addr))) {
+      VMEMU_ERROR("> failed to decode instruction at = 0x%llx\n",
+                  static_cast<unsigned long long>(addr));
+      uc_emu_stop(uc);
+      return;
+    }
+    ++instrs;
+  }
+
+  if (!obj->charge(instrs)) return;
+
+  obj->cc_in_hndlr = !instr || !hndlr_end(*instr);
+}
+
+bool emu_t::hndlr_begin(std::uintptr_t address) {
+  // unicorn-engine just finished the vm handler run on the host before...
+  cross_check(address);
+  cc_trace.m_begin = address;
+  cc_hndlr_instrs = 0u;
 
-    delete[] obj->cc_trace.m_stack;
-    obj->cc_trace.m_instrs.clear();
+  const auto tracer = fork(tracer_fork);
+  if (!tracer) {
+    VMEMU_ERROR("> failed to fork the tracer...\n");
+    uc_emu_stop(uc);
+    return false;
   }
+
+  // vm handlers the tracer trusts are run on the host... in cross_check
+  // unicorn-engine runs them as well and the host run is compared against it
+  // at the next vm handler, the vm instruction is traced as usual...
+  const bool vip_known = cc_blk->m_vip.rva && cc_blk->m_vip.img_base;
+  if (const auto entry = vip_known && m_cfg.native != native_mode_t::off
+                             ? tracer->m_hndlr_cache.get(hndlr_key())
+                             : nullptr;
+      entry) {
+    std::uint64_t imm = 0ull;
+    if (const auto prog = m_native.prog(*entry);
+        prog && m_native.run(*prog, *entry, imm)) {
+      if (m_cfg.native == native_mode_t::cross_check) {
+        cc_native = entry;
+        cc_native_imm = imm;
+      } else {
+        const auto vinstr = hndlr_cache_t::vinstr(*entry, imm);
+        VMEMU_STAT_INC(m_stats, hndlrs_native);
+        print_vinstr(vinstr);
+        cc_blk->m_vinstrs.push_back(vinstr);
+        m_native.commit(m_stack);
+        return false;
+      }
+    }
+  }
+
+  // anything else is traced on the tracer from the current cpu and stack...
+  m_stack.sync();
+  m_stack.snapshot(m_hndlr_stack);
+  const auto ctx = m_ctx_pool.save();
+
+  const auto vinstr = tracer->retrace(ctx, m_hndlr_stack, *cc_blk);
+  cc_trace.m_vip = tracer->cc_trace.m_vip;
+  cc_trace.m_vsp = tracer->cc_trace.m_vsp;
+
+  if (vinstr && cc_native && cc_native->vinstr.imm.has_imm &&
+      hndlr_cache_t::vinstr(*cc_native, cc_native_imm).imm.val !=
+          vinstr->imm.val)
+    native_mismatch("operand");
+
+  // a budget of the tracer is one of the routine...
+  if (tracer->m_status != emu_status_t::ok) {
+    m_status = tracer->m_status;
+    m_ctx_pool.release(ctx);
+    uc_emu_stop(uc);
+    return false;
+  }
+
+  // the first vm handler of a block only yields the vip of the block...
+  if (!vinstr) {
+    m_ctx_pool.release(ctx);
+    if (vip_known || !cc_blk->m_vip.rva || !cc_blk->m_vip.img_base) {
+      VMEMU_ERROR("> failed to trace vm handler at = 0x%llx\n",
+                  static_cast<unsigned long long>(address));
+      uc_emu_stop(uc);
+      return false;
+    }
+    return true;
+  }
+
+  if (!cc_blk->m_vinstrs.empty() &&
+      (vinstr->mnemonic == vm::instrs::mnemonic_t::jmp ||
+       vinstr->mnemonic == vm::instrs::mnemonic_t::vmexit)) {
+    // the cpu and stack the handler was traced from are those of the virtual
+    // jmp... the tracer already filled in the rest of cc_blk->m_jmp...
+    if (vinstr->mnemonic == vm::instrs::mnemonic_t::jmp) {
+      auto& stack = jmp_stack(cc_blk - cc_vrtn->m_blks.data());
+      cc_blk->m_jmp.ctx = ctx;
+      m_jmp_bytes -= stack.size();
+      stack = m_hndlr_stack;
+      m_jmp_bytes += stack.size();
+    } else
+      m_ctx_pool.release(ctx);
+
+    cc_blk->m_vinstrs.push_back(vinstr.value());
+    uc_emu_stop(uc);
+    return false;
+  }
+
+  m_ctx_pool.release(ctx);
+  cc_blk->m_vinstrs.push_back(vinstr.value());
   return true;
 }
 
-void emu_t::invalid_mem(uc_engine* uc, uc_mem_type type, uint64_t address,
+std::optional<vm::instrs::vinstr_t> emu_t::retrace(
+    uc_context* ctx, const stack_snapshot_t& stack,
+    vm::instrs::vblk_t& vblk) {
+  uc_context_restore(uc, ctx);
+  m_stack.restore(stack);
+
+  // trace into a scratch block that looks like vblk as far as
+  // code_exec_callback is concerned...
+  vm::instrs::vrtn_t rtn;
+  auto& blk = rtn.m_blks.emplace_back();
+  blk.m_vip = vblk.m_vip;
+  if (!vblk.m_vinstrs.empty()) blk.m_vinstrs.push_back(vblk.m_vinstrs.back());
+
+  const auto vinstr_cnt = blk.m_vinstrs.size();
+  cc_vrtn = &rtn;
+  cc_blk = &blk;
+  cc_trace.m_vip = vblk.m_vm.vip;
+  cc_trace.m_vsp = vblk.m_vm.vsp;
+
+  std::uintptr_t rip = 0ull;
+  uc_reg_read(uc, UC_X86_REG_RIP, &rip);
+
+  cc_retrace = true;
+  cc_retraced = false;
+  m_status = emu_status_t::ok;
+  cc_hndlr_instrs = cc_blk_instrs = 0u;
+  uc_emu_start(uc, rip, 0ull, 0ull, 0ull);
+  cc_retrace = false;
+
+  reset_trace();
+  m_jmp_stacks.clear();
+  m_jmp_bytes = 0u;
+
+  vblk.m_vip = blk.m_vip;
+  if (blk.m_jmp.ctx) {
+    m_ctx_pool.release(blk.m_jmp.ctx);
+    vblk.m_jmp.rip = blk.m_jmp.rip;
+    vblk.m_jmp.m_vm = blk.m_jmp.m_vm;
+  }
+
+  cc_vrtn = nullptr;
+  cc_blk = nullptr;
+
+  if (blk.m_vinstrs.size() == vinstr_cnt) return {};
+  return blk.m_vinstrs.back();
+}
+
+bool emu_t::hndlr_end(const zydis_decoded_instr_t& instr) {
+  return instr.mnemonic == ZYDIS_MNEMONIC_RET ||
+         (instr.mnemonic == ZYDIS_MNEMONIC_JMP &&
+          instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER);
+}
+
+void emu_t::print_vinstr(const vm::instrs::vinstr_t& vinstr) {
+  if (vinstr.imm.has_imm)
+    VMEMU_TRACE("> %s 0x%llx\n",
+                vm::instrs::get_profile(vinstr.mnemonic)->name.c_str(),
+                static_cast<unsigned long long>(vinstr.imm.val));
+  else
+    VMEMU_TRACE("> %s\n",
+                vm::instrs::get_profile(vinstr.mnemonic)->name.c_str());
+}
+
+void emu_t::deobfuscate() {
+  VMEMU_STAT_TIME(m_stats, deobfuscate_ns);
+
+  // deobfuscate the instruction stream before profiling...
+  // makes it easier for profiles to be correct...
+  vm::instrs::deobfuscate(cc_trace);
+
+  // find the last MOV REG, DWORD PTR [VIP] in the instruction stream, then
+  // remove any instructions from this instruction to the JMP/RET...
+  const auto rva_fetch = std::find_if(
+      cc_trace.m_instrs.rbegin(), cc_trace.m_instrs.rend(),
+      [& vip = cc_trace.m_vip](const vm::instrs::emu_instr_t& instr) -> bool {
+        const auto& i = instr.m_instr;
+        return i.mnemonic == ZYDIS_MNEMONIC_MOV &&
+               i.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
+               i.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY &&
+               i.operands[1].mem.base == vip && i.operands[1].size == 32;
+      });
+
+  if (rva_fetch != cc_trace.m_instrs.rend())
+    cc_trace.m_instrs.erase((rva_fetch + 1).base(), cc_trace.m_instrs.end());
+}
+
+vm::instrs::vinstr_t emu_t::determine() {
+  deobfuscate();
+  VMEMU_STAT_INC(m_stats, hndlrs_traced);
+  const auto vinstr = [&] {
+    VMEMU_STAT_TIME(m_stats, determine_ns);
+    return vm::instrs::determine(cc_trace);
+  }();
+
+  m_hndlr_cache.learn(uc, m_ctx_pool, hndlr_key(), vinstr, cc_trace.m_instrs,
+                      cc_ctxs, cc_addrs);
+  return vinstr;
+}
+
+std::optional<vm::instrs::vinstr_t> emu_t::cached_step(
+    std::uintptr_t address, const zydis_decoded_instr_t& instr) {
+  // the cpu the handler starts with is kept around in case it never reaches
+  // the native instruction its operand is read at...
+  if (cc_hndlr->vinstr.imm.has_imm && cc_addrs.size() == 1u)
+    cc_hndlr_ctx = m_ctx_pool.save();
+
+  // the operand is read right before the native instruction it was learned at
+  // executes...
+  if (cc_hndlr->vinstr.imm.has_imm && address == cc_hndlr->imm.addr) {
+    uc_reg_read(uc, cc_hndlr->imm.reg, &cc_imm);
+    cc_imm_read = true;
+  }
+
+  if (!hndlr_end(instr)) return {};
+
+  // the handler took a path it was not learned on, whatever cc_imm holds is
+  // not its operand...
+  if (cc_hndlr->vinstr.imm.has_imm && !cc_imm_read) {
+    trace_uncached();
+    return {};
+  }
+
+  if (cc_native == cc_hndlr && cc_hndlr->vinstr.imm.has_imm &&
+      cc_native_imm != cc_imm)
+    native_mismatch("operand");
+
+  const auto vinstr = hndlr_cache_t::vinstr(*cc_hndlr, cc_imm);
+  VMEMU_STAT_INC(m_stats, hndlrs_cached);
+  reset_trace();
+  return vinstr;
+}
+
+std::optional<vm::instrs::vinstr_t> emu_t::native_step(
+    std::uintptr_t address) {
+  cross_check(address);
+  if (m_cfg.native == native_mode_t::off || !cc_hndlr) return {};
+
+  const auto prog = m_native.prog(*cc_hndlr);
+  std::uint64_t imm = 0ull;
+  if (!prog || !m_native.run(*prog, *cc_hndlr, imm)) return {};
+
+  if (m_cfg.native == native_mode_t::cross_check) {
+    cc_native = cc_hndlr;
+    cc_native_imm = imm;
+    return {};
+  }
+
+  m_native.commit(m_stack);
+  const auto vinstr = hndlr_cache_t::vinstr(*cc_hndlr, imm);
+  VMEMU_STAT_INC(m_stats, hndlrs_native);
+  reset_trace();
+  return vinstr;
+}
+
+void emu_t::cross_check(std::uintptr_t address) {
+  if (!cc_native) return;
+  if (!m_native.check(address)) return native_mismatch("cpu or memory");
+  cc_native = nullptr;
+}
+
+void emu_t::native_mismatch(const char* reason) {
+  VMEMU_WARN(
+      "[!] host run of vm handler at = 0x%llx does not match unicorn-engine "
+      "(%s), it will no longer be run on the host...\n",
+      static_cast<unsigned long long>(
+          (cc_native->trace.front() - m_vm->m_module_base) +
+          m_vm->m_image_base),
+      reason);
+
+  m_native.reject(*cc_native);
+  cc_native = nullptr;
+}
+
+void emu_t::trace_uncached() {
+  VMEMU_DEBUG(
+      "> cached vm handler at = 0x%llx did not read its operand, tracing "
+      "it...\n",
+      static_cast<unsigned long long>(
+          (cc_trace.m_begin - m_vm->m_module_base) + m_vm->m_image_base));
+
+  if (!cc_hndlr_ctx) {
+    VMEMU_ERROR("> failed to save the cpu of a cached vm handler...\n");
+    m_status = emu_status_t::error;
+    uc_emu_stop(uc);
+    return;
+  }
+
+  uc_context_restore(uc, cc_hndlr_ctx);
+  m_stack.revert();
+
+  // the host run of the handler (if any) took another path as well...
+  cc_native = nullptr;
+  cc_retraced = false;
+
+  const auto begin = cc_trace.m_begin;
+  reset_trace();
+  cc_uncached = true;
+
+  // writing rip from inside of a code hook makes unicorn-engine continue at
+  // the start of the handler instead of executing this instruction...
+  uc_reg_write(uc, UC_X86_REG_RIP, &begin);
+}
+
+void emu_t::reset_trace() {
+  m_ctx_pool.release(cc_ctxs);
+  m_ctx_pool.release(std::exchange(cc_hndlr_ctx, nullptr));
+  cc_trace.m_instrs.clear();
+  cc_addrs.clear();
+  cc_hndlr = nullptr;
+  cc_hndlr_instrs = 0u;
+  cc_imm = 0ull;
+  cc_imm_read = cc_uncached = false;
+}
+
+bool emu_t::charge(std::uint32_t instrs) {
+  // unicorn-engine only stops at the end of the current translation block...
+  if (m_status != emu_status_t::ok) return false;
+
+  cc_hndlr_instrs += instrs;
+  cc_blk_instrs += instrs;
+
+  // speculative execution is charged to the routine on no engine, forks do
+  // not even know the routine budget...
+  if (m_mode != mode_t::speculative) cc_rtn_instrs += instrs;
+
+  if (m_cfg.hndlr_budget && cc_hndlr_instrs > m_cfg.hndlr_budget)
+    m_status = emu_status_t::hndlr_budget;
+  else if (m_cfg.blk_budget && cc_blk_instrs > m_cfg.blk_budget)
+    m_status = emu_status_t::blk_budget;
+  else if (m_cfg.rtn_budget && cc_rtn_instrs > m_cfg.rtn_budget)
+    m_status = emu_status_t::rtn_budget;
+  else if ((cc_clock_instrs += instrs) < clock_interval || in_time())
+    return true;
+
+  cc_clock_instrs = 0u;
+  uc_emu_stop(uc);
+  return false;
+}
+
+bool emu_t::in_time() {
+  cc_clock_instrs = 0u;
+  if (m_cfg.cancel && m_cfg.cancel->load(std::memory_order_relaxed))
+    m_status = emu_status_t::cancelled;
+  else if (m_cfg.time_budget && std::chrono::steady_clock::now() > m_deadline)
+    m_status = emu_status_t::time_budget;
+  else
+    return true;
+
+  return false;
+}
+
+const char* emu_t::status_name(emu_status_t status) {
+  switch (status) {
+    case emu_status_t::ok:
+      return "ok";
+    case emu_status_t::error:
+      return "error";
+    case emu_status_t::hndlr_budget:
+      return "vm handler budget exceeded";
+    case emu_status_t::blk_budget:
+      return "block budget exceeded";
+    case emu_status_t::rtn_budget:
+      return "routine budget exceeded";
+    case emu_status_t::time_budget:
+      return "time budget exceeded";
+    case emu_status_t::cancelled:
+      return "cancelled";
+    default:
+      return "unknown";
+  }
+}
+
+bool emu_t::invalid_mem(uc_engine* uc, uc_mem_type type, uint64_t address,
                         int size, int64_t value, emu_t* obj) {
+  VMEMU_STAT_INC(obj->m_stats, mem_faults);
+  ++obj->m_ws.faults;
+
+  // lazily mapped image... an access can straddle two chunks. image memory
+  // which cannot be mapped must never be zero filled, emulation stops...
+  const auto first_in = obj->in_image(address),
+             last_in = obj->in_image(address + size - 1);
+  if (obj->m_cfg.lazy_chunk && (first_in || last_in)) {
+    if ((!first_in || obj->map_chunk(address)) &&
+        (!last_in || obj->map_chunk(address + size - 1)))
+      return true;
+
+    obj->m_status = emu_status_t::error;
+    uc_emu_stop(uc);
+    return false;
+  }
+
   switch (type) {
     case UC_MEM_READ_UNMAPPED: {
       uc_mem_map(uc, address & ~0xFFFull, PAGE_4KB, UC_PROT_ALL);
-      std::printf(">>> reading invalid memory at address = %p, size = 0x%x\n",
-                  address, size);
-      break;
+      obj->m_zero_pages.push_back(address & ~0xFFFull);
+      ++obj->m_ws.zero_pages;
+      VMEMU_TRACE(
+          ">>> reading invalid memory at address = 0x%llx, size = 0x%x\n",
+          static_cast<unsigned long long>(address), size);
+      return true;
     }
     case UC_MEM_WRITE_UNMAPPED: {
       uc_mem_map(uc, address & ~0xFFFull, PAGE_4KB, UC_PROT_ALL);
-      std::printf(
-          ">>> writing invalid memory at address = %p, size = 0x%x, val = "
-          "0x%x\n",
-          address, size, value);
-      break;
+      obj->m_zero_pages.push_back(address & ~0xFFFull);
+      ++obj->m_ws.zero_pages;
+      VMEMU_TRACE(
+          ">>> writing invalid memory at address = 0x%llx, size = 0x%x, val = "
+          "0x%llx\n",
+          static_cast<unsigned long long>(address), size,
+          static_cast<unsigned long long>(value));
+      return true;
     }
     case UC_MEM_FETCH_UNMAPPED: {
-      std::printf(">>> fetching invalid instructions at address = %p\n",
-                  address);
-      break;
+      VMEMU_DEBUG(">>> fetching invalid instructions at address = 0x%llx\n",
+                  static_cast<unsigned long long>(address));
+      return false;
     }
     default:
-      break;
+      return false;
   }
 }
 
-bool emu_t::legit_branch(vm::instrs::vblk_t& vblk, std::uintptr_t branch_addr) {
-  // remove normal execution callback...
-  uc_hook_del(uc, code_exec_hook);
+void emu_t::image_write(uc_engine* uc, uc_mem_type type, uint64_t address,
+                        int size, int64_t value, emu_t* obj) {
+  const auto first = (address - obj->m_vm->m_module_base) / PAGE_4KB;
+  const auto last = std::min<std::size_t>(
+      (address + size - 1 - obj->m_vm->m_module_base) / PAGE_4KB,
+      obj->m_image_dirty.size() - 1);
+
+  for (auto page = first; page <= last; ++page) {
+    if (obj->m_image_dirty[page]) continue;
+    obj->m_image_dirty[page] = true;
+    obj->m_image_pages.push_back(page);
+  }
+}
 
-  // add branch pred hook...
-  uc_hook_add(uc, &branch_pred_hook, UC_HOOK_CODE,
-              (void*)&vm::emu_t::branch_pred_spec_exec, this,
-              m_vm->m_module_base, m_vm->m_module_base + m_vm->m_image_size);
+bool emu_t::in_image(std::uintptr_t address) const {
+  return address >= m_vm->m_module_base &&
+         address < m_vm->m_module_base + image_map_size();
+}
+
+bool emu_t::map_chunk(std::uintptr_t address) {
+  if (!in_image(address)) return false;
+
+  const auto idx = (address - m_vm->m_module_base) / m_cfg.lazy_chunk;
+  if (m_chunks[idx]) return true;
+
+  const auto offset = idx * m_cfg.lazy_chunk;
+  const auto size =
+      std::min<std::size_t>(m_cfg.lazy_chunk, image_map_size() - offset);
+
+  uc_err err;
+  if (m_view) {
+    err = uc_mem_map_ptr(uc, m_vm->m_module_base + offset, size, UC_PROT_ALL,
+                         reinterpret_cast<std::uint8_t*>(m_view) + offset);
+  } else if (!(err = uc_mem_map(uc, m_vm->m_module_base + offset, size,
+                                UC_PROT_ALL))) {
+    err = uc_mem_write(uc, m_vm->m_module_base + offset,
+                       reinterpret_cast<void*>(m_vm->m_module_base + offset),
+                       size);
+  }
+
+  if (err) {
+    VMEMU_ERROR("> failed to map image chunk at = 0x%llx, reason = %d\n",
+                static_cast<unsigned long long>(m_vm->m_module_base + offset),
+                err);
+    return false;
+  }
+
+  m_chunks[idx] = true;
+  ++m_ws.chunks;
+  ++m_ws.run_chunks;
+  return true;
+}
+
+void emu_t::restore_memory() {
+  // the host image is never written to, it is what every page started as...
+  for (const auto page : m_image_pages) {
+    const auto offset = static_cast<std::size_t>(page) * PAGE_4KB;
+    uc_mem_write(uc, m_vm->m_module_base + offset,
+                 reinterpret_cast<void*>(m_vm->m_module_base + offset),
+                 std::min<std::size_t>(PAGE_4KB, image_map_size() - offset));
+    m_image_dirty[page] = false;
+  }
+
+  for (const auto page : m_zero_pages) uc_mem_unmap(uc, page, PAGE_4KB);
+
+  m_image_pages.clear();
+  m_zero_pages.clear();
+}
+
+bool emu_t::clone_memory(const emu_t& other) {
+  std::uint8_t page_buf[PAGE_4KB];
+
+  // pages only this engine wrote to go back to what the image holds...
+  auto kept = 0u;
+  for (const auto page : m_image_pages) {
+    if (other.m_image_dirty[page]) {
+      m_image_pages[kept++] = page;
+      continue;
+    }
+
+    const auto offset = static_cast<std::size_t>(page) * PAGE_4KB;
+    uc_mem_write(uc, m_vm->m_module_base + offset,
+                 reinterpret_cast<void*>(m_vm->m_module_base + offset),
+                 std::min<std::size_t>(PAGE_4KB, image_map_size() - offset));
+    m_image_dirty[page] = false;
+  }
+  m_image_pages.resize(kept);
+
+  for (const auto page : other.m_image_pages) {
+    const auto offset = static_cast<std::size_t>(page) * PAGE_4KB;
+    const auto addr = m_vm->m_module_base + offset;
+    const auto size =
+        std::min<std::size_t>(PAGE_4KB, image_map_size() - offset);
+
+    if (m_cfg.lazy_chunk && !map_chunk(addr)) return false;
+    uc_mem_read(other.uc, addr, page_buf, size);
+    uc_mem_write(uc, addr, page_buf, size);
+
+    if (!m_image_dirty[page]) {
+      m_image_dirty[page] = true;
+      m_image_pages.push_back(page);
+    }
+  }
+
+  // zero filled pages are unmapped unless the other engine has them too...
+  kept = 0u;
+  for (const auto page : m_zero_pages) {
+    if (std::find(other.m_zero_pages.begin(), other.m_zero_pages.end(),
+                  page) != other.m_zero_pages.end())
+      m_zero_pages[kept++] = page;
+    else
+      uc_mem_unmap(uc, page, PAGE_4KB);
+  }
+  m_zero_pages.resize(kept);
+
+  for (const auto page : other.m_zero_pages) {
+    if (std::find(m_zero_pages.begin(), m_zero_pages.end(), page) ==
+        m_zero_pages.end()) {
+      if (uc_mem_map(uc, page, PAGE_4KB, UC_PROT_ALL)) return false;
+      m_zero_pages.push_back(page);
+    }
+
+    uc_mem_read(other.uc, page, page_buf, PAGE_4KB);
+    uc_mem_write(uc, page, page_buf, PAGE_4KB);
+  }
+
+  return true;
+}
+
+std::size_t emu_t::image_map_size() const {
+  return m_cfg.image ? m_cfg.image->map_size()
+                     : (m_vm->m_image_size + 0xFFFull) & ~0xFFFull;
+}
+
+stack_snapshot_t& emu_t::jmp_stack(std::size_t blk_idx) {
+  if (m_jmp_stacks.size() <= blk_idx) m_jmp_stacks.resize(blk_idx + 1);
+  return m_jmp_stacks[blk_idx];
+}
+
+bool emu_t::legit_branch(vm::instrs::vblk_t& vblk,
+                         const stack_snapshot_t& jmp_stack,
+                         std::uintptr_t branch_addr) {
+  VMEMU_STAT_INC(m_stats, legit_branches);
+
+  // switch the code hook over to branch prediction... the hook itself stays
+  // so that unicorn-engine keeps the translated blocks of the image...
+  const auto mode = m_mode;
+  m_mode = mode_t::speculative;
+  cc_native = nullptr;
 
   // make a backup of the current emulation state...
-  uc_context* backup;
-  uc_context_alloc(uc, &backup);
-  uc_context_save(uc, backup);
-  std::uint8_t* stack = new std::uint8_t[STACK_SIZE];
-  uc_mem_read(uc, STACK_BASE, stack, STACK_SIZE);
+  const auto backup = m_ctx_pool.save();
+  m_stack.sync();
+  m_stack.snapshot(m_spec_stack);
 
   // restore cpu and stack back to the virtual jump handler...
   uc_context_restore(uc, vblk.m_jmp.ctx);
-  uc_mem_write(uc, STACK_BASE, vblk.m_jmp.stack, STACK_SIZE);
+  m_stack.restore(jmp_stack);
+
+  // the virtual jmp handler is what cc_trace was last set to by the main
+  // emulation, a fork has to be told...
+  cc_trace.m_vip = vblk.m_jmp.m_vm.vip;
+  cc_trace.m_vsp = vblk.m_jmp.m_vm.vsp;
 
   // force the virtual machine to try and emulate the branch address...
   std::uintptr_t vsp = 0ull, rip = 0ull;
   uc_reg_read(uc, UC_X86_REG_RIP, &rip);
   uc_reg_read(uc, vm::instrs::reg_map[vblk.m_vm.vsp], &vsp);
-  uc_mem_write(uc, vsp, &branch_addr, sizeof branch_addr);
+  m_stack.write(vsp, &branch_addr, sizeof branch_addr);
 
+  // an error of an earlier branch stops this one too, see join...
   m_sreg_cnt = 0u;
+  cc_hndlr_instrs = cc_blk_instrs = 0u;
   uc_emu_start(uc, rip, 0ull, 0ull, 0ull);
 
+  // a branch that runs out of the handler or block budget is not legit, the
+  // other budgets stop the routine...
+  const auto runaway = m_status == emu_status_t::hndlr_budget ||
+                       m_status == emu_status_t::blk_budget;
+  if (runaway) m_status = emu_status_t::ok;
+
+  // speculative execution can stop in the middle of a vm handler...
+  reset_trace();
+
   // restore original cpu and stack...
-  uc_mem_write(uc, STACK_BASE, stack, STACK_SIZE);
+  m_stack.restore(m_spec_stack);
   uc_context_restore(uc, backup);
-  uc_context_free(backup);
-  delete[] stack;
+  m_ctx_pool.release(backup);
 
-  // add normal execution callback back...
-  uc_hook_del(uc, branch_pred_hook);
-  uc_hook_add(uc, &code_exec_hook, UC_HOOK_CODE,
-              (void*)&vm::emu_t::code_exec_callback, this, m_vm->m_module_base,
-              m_vm->m_module_base + m_vm->m_image_size);
+  m_mode = mode;
+  cc_native = nullptr;
 
   // we will consider this a legit branch if there is at least 10
   // SREG instructions...
-  return m_sreg_cnt == 10;
+  return !runaway && m_sreg_cnt == 10;
+}
+
+std::pair<bool, bool> emu_t::legit_branches(vm::instrs::vblk_t& vblk,
+                                            const stack_snapshot_t& jmp_stack,
+                                            std::uintptr_t br1,
+                                            std::uintptr_t br2,
+                                            bool serial) {
+  const auto parallel = m_cfg.parallel_spec && !serial;
+
+  // an engine without a code hook cannot do branch prediction itself...
+  if (!parallel && m_cfg.block_hooks) {
+    const auto spec = fork(0u);
+    if (!spec) {
+      VMEMU_ERROR("> failed to fork...\n");
+      return {false, false};
+    }
+
+    const std::pair<bool, bool> legit = {
+        spec->legit_branch(vblk, jmp_stack, br1),
+        spec->legit_branch(vblk, jmp_stack, br2)};
+    join(*spec);
+    return legit;
+  }
+
+  if (!parallel)
+    return {legit_branch(vblk, jmp_stack, br1),
+            legit_branch(vblk, jmp_stack, br2)};
+
+  const auto br1_fork = fork(0u);
+  const auto br2_fork = fork(1u);
+  if (!br1_fork || !br2_fork) {
+    VMEMU_WARN("> failed to fork, validating branches one by one...\n");
+    return legit_branches(vblk, jmp_stack, br1, br2, true);
+  }
+
+  // both candidates start from the same virtual jmp snapshot which the forks
+  // only ever read from...
+  bool br1_legit = false;
+  spec_pool().submit([&](std::size_t) {
+    br1_legit = br1_fork->legit_branch(vblk, jmp_stack, br1);
+  });
+
+  const auto br2_legit = br2_fork->legit_branch(vblk, jmp_stack, br2);
+  m_spec_pool->wait();
+  join(*br1_fork);
+  join(*br2_fork);
+  return {br1_legit, br2_legit};
+}
+
+void emu_t::legit_targets(vm::instrs::vblk_t& vblk,
+                          const stack_snapshot_t& jmp_stack,
+                          std::vector<std::uintptr_t>& targets,
+                          bool serial) {
+  std::vector<std::uint8_t> legit(targets.size());
+  if (!m_cfg.parallel_spec || serial) {
+    // an engine without a code hook cannot do branch prediction itself...
+    const auto spec = m_cfg.block_hooks ? fork(0u) : this;
+    if (!spec) {
+      VMEMU_ERROR("> failed to fork...\n");
+      targets.clear();
+      return;
+    }
+
+    for (auto idx = 0u; idx < targets.size(); ++idx)
+      legit[idx] = spec->legit_branch(vblk, jmp_stack, targets[idx]);
+    join(*spec);
+  } else {
+    emu_t* const forks[] = {fork(0u), fork(1u)};
+    if (!forks[0] || !forks[1]) {
+      VMEMU_WARN("> failed to fork, validating branches one by one...\n");
+      return legit_targets(vblk, jmp_stack, targets, true);
+    }
+
+    // both forks take the next unvalidated entry until there are none left,
+    // all of them start from the same virtual jmp snapshot...
+    std::atomic<std::size_t> next = 0u;
+    const auto validate = [&](emu_t* spec) {
+      for (auto idx = next++; idx < targets.size(); idx = next++)
+        legit[idx] = spec->legit_branch(vblk, jmp_stack, targets[idx]);
+    };
+
+    spec_pool().submit([&](std::size_t) { validate(forks[1]); });
+    validate(forks[0]);
+    m_spec_pool->wait();
+    join(*forks[0]);
+    join(*forks[1]);
+  }
+
+  auto kept = 0u;
+  for (auto idx = 0u; idx < targets.size(); ++idx)
+    if (legit[idx]) targets[kept++] = targets[idx];
+
+  targets.resize(kept);
+}
+
+void emu_t::join(const emu_t& spec) {
+  // legit_branch already took back the handler and block budgets...
+  if (&spec != this && spec.m_status != emu_status_t::ok &&
+      m_status == emu_status_t::ok)
+    m_status = spec.m_status;
+}
+
+thread_pool_t& emu_t::spec_pool() {
+  if (!m_spec_pool) m_spec_pool = std::make_unique<thread_pool_t>(1u);
+  return *m_spec_pool;
+}
+
+emu_stats_t emu_t::stats() const {
+  auto stats = m_stats;
+  stats += m_ctx_pool.stats();
+  stats += m_stack.stats();
+
+  for (const auto& fork : m_forks)
+    if (fork) stats += fork->stats();
+
+  return stats;
+}
+
+void emu_t::profiles(std::vector<hndlr_profile_t>& profiles) const {
+  m_hndlr_cache.trusted(profiles);
+}
+
+emu_t* emu_t::fork(std::size_t idx) {
+  // a fork sees the image writes and zero filled pages of this engine, what
+  // it wrote itself last time is thrown away... the tracer is handed out for
+  // every vm handler and is left as is, it only retraces the handler from the
+  // cpu and stack of this engine...
+  if (auto& fork = m_forks[idx]; fork) {
+    fork->m_deadline = m_deadline;
+    fork->m_status = emu_status_t::ok;
+    return idx == tracer_fork || fork->clone_memory(*this) ? fork.get()
+                                                           : nullptr;
+  }
+
+  // the tracer exists to trace, it never runs vm handlers on the host...
+  emu_cfg_t cfg;
+  cfg.decode_cache = m_decoder;
+  cfg.hndlr_kb = m_hndlr_kb;
+  cfg.image = m_cfg.image;
+  cfg.lazy_chunk = m_cfg.lazy_chunk;
+  cfg.native = idx == tracer_fork ? native_mode_t::off : m_cfg.native;
+
+  // forks never emulate a routine of their own, only the budgets of the
+  // handlers and blocks they run apply... the routine budget is charged by
+  // this engine alone, see charge...
+  cfg.hndlr_budget = m_cfg.hndlr_budget;
+  cfg.blk_budget = m_cfg.blk_budget;
+  cfg.time_budget = m_cfg.time_budget;
+  cfg.cancel = m_cfg.cancel;
+
+  auto fork = std::make_unique<emu_t>(const_cast<vm::vmctx_t*>(m_vm), cfg);
+  if (!fork->init()) return nullptr;
+
+  fork->m_deadline = m_deadline;
+  if (idx != tracer_fork && !fork->clone_memory(*this)) return nullptr;
+
+  return (m_forks[idx] = std::move(fork)).get();
 }
 
 std::optional<std::pair<std::uintptr_t, std::uintptr_t>> emu_t::could_have_jcc(
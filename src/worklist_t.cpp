@@ -0,0 +1,49 @@
+#include <worklist_t.hpp>
+
+namespace vm {
+worklist_t::worklist_t(order_t order)
+    : m_order(order), m_queue(cmp_t{order}) {}
+
+bool worklist_t::visit(std::uintptr_t target) {
+  return m_visited.insert(target).second;
+}
+
+bool worklist_t::push(const work_item_t& item) {
+  if (!visit(item.target)) return false;
+  m_queue.push({item, m_seq++});
+  return true;
+}
+
+std::optional<work_item_t> worklist_t::pop() {
+  if (m_queue.empty()) return {};
+  const auto item = m_queue.top().item;
+  m_queue.pop();
+  return item;
+}
+
+void worklist_t::clear() {
+  m_queue = decltype(m_queue)(cmp_t{m_order});
+  m_visited.clear();
+  m_seq = 0ull;
+}
+
+void worklist_t::order(order_t order) {
+  m_order = order;
+  clear();
+}
+
+bool worklist_t::cmp_t::operator()(const entry_t& a, const entry_t& b) const {
+  // std::priority_queue pops the greatest entry, thus a < b means b is
+  // emulated before a...
+  switch (order) {
+    case order_t::dfs:
+      return a.seq < b.seq;
+    case order_t::depth:
+      if (a.item.depth != b.item.depth) return a.item.depth < b.item.depth;
+      [[fallthrough]];
+    case order_t::bfs:
+    default:
+      return a.seq > b.seq;
+  }
+}
+}  // namespace vm
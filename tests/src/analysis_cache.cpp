@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <analysis_cache_t.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#include "fixture_image.hpp"
+#include "test.hpp"
+
+// a cache directory of its own, removed again on scope exit so that a failed
+// check does not leave it behind...
+struct cache_dir_t {
+  cache_dir_t()
+      : path((std::filesystem::temp_directory_path() /
+              ("vmemu-tests-" + std::to_string(std::random_device{}()) +
+               ".cache"))
+                 .string()) {}
+
+  ~cache_dir_t() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+
+  // path of the handler profiles of a binary, see analysis_cache_t...
+  std::string hndlrs(const vm::analysis_cache_t& cache) const {
+    char name[17];
+    std::snprintf(name, sizeof name, "%016llx",
+                  static_cast<unsigned long long>(cache.hash()));
+    return (std::filesystem::path(path) / name / "hndlrs.vhnd").string();
+  }
+
+  std::string path;
+};
+
+// a profiled vm handler at an rva of the image...
+static vm::hndlr_profile_t make_profile(std::uintptr_t module_base,
+                                        std::uint32_t rva, bool has_imm) {
+  vm::hndlr_profile_t profile{};
+  auto& [key, entry] = profile;
+  key = {module_base + rva, ZYDIS_REGISTER_RSI, ZYDIS_REGISTER_RBP};
+
+  entry.vinstr.mnemonic =
+      has_imm ? vm::instrs::mnemonic_t::lconst : vm::instrs::mnemonic_t::add;
+  entry.vinstr.imm.has_imm = has_imm;
+  entry.vinstr.imm.size = has_imm ? 32u : 0u;
+  for (auto idx = 0u; idx < 5u; ++idx)
+    entry.trace.push_back(module_base + rva + idx * 4u);
+
+  if (has_imm) entry.imm = {module_base + rva + 8u, UC_X86_REG_RAX, true};
+  entry.runs = vm::hndlr_cache_t::verify_runs;
+  entry.trusted = true;
+  return profile;
+}
+
+static std::vector<std::uint8_t> read_file(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(input), {}};
+}
+
+static bool write_file(const std::string& path,
+                       const std::vector<std::uint8_t>& data) {
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  return !!output.write(reinterpret_cast<const char*>(data.data()),
+                        data.size());
+}
+
+// trusted profiles stored for a binary load back the same, duplicates and
+// profiles which are not trusted are dropped...
+VMEMU_TEST(analysis_cache_hndlrs_round_trip) {
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 1u, .blocks = 2u}));
+
+  cache_dir_t dir;
+  vm::analysis_cache_t cache;
+  VMEMU_CHECK(cache.open(dir.path, fixture.image));
+
+  const auto base = fixture.image.module_base();
+  std::vector<vm::hndlr_profile_t> stored = {make_profile(base, 0x1000, true),
+                                             make_profile(base, 0x1100, false),
+                                             make_profile(base, 0x1000, true),
+                                             make_profile(base, 0x1200, true)};
+  stored.back().second.trusted = false;
+  VMEMU_CHECK(cache.store_hndlrs(stored));
+
+  // a second cache of the same binary finds them...
+  vm::analysis_cache_t reopened;
+  VMEMU_CHECK(reopened.open(dir.path, fixture.image));
+  VMEMU_CHECK(reopened.hash() == cache.hash());
+
+  std::vector<vm::hndlr_profile_t> loaded;
+  VMEMU_CHECK(reopened.load_hndlrs(loaded));
+  VMEMU_CHECK(loaded.size() == 2u);
+
+  std::sort(loaded.begin(), loaded.end(), [](const auto& a, const auto& b) {
+    return a.first.begin < b.first.begin;
+  });
+
+  for (auto idx = 0u; idx < loaded.size(); ++idx) {
+    const auto& [key, entry] = loaded[idx];
+    const auto& [stored_key, stored_entry] = stored[idx];
+    VMEMU_CHECK(key == stored_key);
+    VMEMU_CHECK(entry.vinstr.mnemonic == stored_entry.vinstr.mnemonic);
+    VMEMU_CHECK(entry.vinstr.imm.has_imm == stored_entry.vinstr.imm.has_imm);
+    VMEMU_CHECK(entry.vinstr.imm.size == stored_entry.vinstr.imm.size);
+    VMEMU_CHECK(entry.trace == stored_entry.trace);
+    VMEMU_CHECK(entry.trusted && !entry.poisoned);
+
+    if (entry.vinstr.imm.has_imm)
+      VMEMU_CHECK(entry.imm.addr == stored_entry.imm.addr &&
+                  entry.imm.reg == stored_entry.imm.reg &&
+                  entry.imm.sext == stored_entry.imm.sext);
+  }
+
+  return true;
+}
+
+// profiles of another binary, of another format version or in a truncated or
+// corrupt file are a cache miss and leave the list alone...
+VMEMU_TEST(analysis_cache_hndlrs_rejected) {
+  test::fixture_image_t fixture, other;
+  VMEMU_CHECK(fixture.load({.entries = 1u, .blocks = 2u}));
+  VMEMU_CHECK(other.load({.entries = 1u, .blocks = 2u, .seed = 0x7331u}));
+
+  cache_dir_t dir;
+  vm::analysis_cache_t cache, other_cache;
+  VMEMU_CHECK(cache.open(dir.path, fixture.image));
+  VMEMU_CHECK(other_cache.open(dir.path, other.image));
+  VMEMU_CHECK(cache.hash() != other_cache.hash());
+
+  const auto base = fixture.image.module_base();
+  VMEMU_CHECK(cache.store_hndlrs({make_profile(base, 0x1000, true),
+                                  make_profile(base, 0x1100, false)}));
+
+  std::vector<vm::hndlr_profile_t> profiles = {
+      make_profile(base, 0x2000, false)};
+  VMEMU_CHECK(!other_cache.load_hndlrs(profiles));
+  VMEMU_CHECK(profiles.size() == 1u);
+
+  const auto path = dir.hndlrs(cache);
+  const auto data = read_file(path);
+  VMEMU_CHECK(data.size() == sizeof(vm::file::hndlr_hdr_t) +
+                                 2u * sizeof(vm::file::hndlr_t) +
+                                 10u * sizeof(std::uint32_t));
+
+  const auto rejected = [&](auto&& fn) {
+    auto bytes = data;
+    auto& hdr = *reinterpret_cast<vm::file::hndlr_hdr_t*>(bytes.data());
+    auto* hndlrs =
+        reinterpret_cast<vm::file::hndlr_t*>(bytes.data() + hdr.hndlr_tbl);
+    fn(bytes, hdr, hndlrs);
+    return write_file(path, bytes) && !cache.load_hndlrs(profiles) &&
+           profiles.size() == 1u;
+  };
+
+  using hdr_t = vm::file::hndlr_hdr_t;
+  using hndlr_t = vm::file::hndlr_t;
+  using bytes_t = std::vector<std::uint8_t>;
+
+  VMEMU_CHECK(rejected([](bytes_t&, hdr_t& hdr, hndlr_t*) { ++hdr.version; }));
+  VMEMU_CHECK(rejected([](bytes_t&, hdr_t& hdr, hndlr_t*) { hdr.magic = 0u; }));
+  VMEMU_CHECK(
+      rejected([](bytes_t&, hdr_t& hdr, hndlr_t*) { hdr.hndlr_cnt = ~0u; }));
+  VMEMU_CHECK(
+      rejected([](bytes_t&, hdr_t& hdr, hndlr_t*) { hdr.hndlr_tbl += 4u; }));
+
+  // a broken second handler drops the first one too...
+  VMEMU_CHECK(rejected(
+      [](bytes_t&, hdr_t&, hndlr_t* hndlrs) { hndlrs[1].trace_cnt = 0u; }));
+  VMEMU_CHECK(rejected([](bytes_t&, hdr_t&, hndlr_t* hndlrs) {
+    hndlrs[1].trace_tbl = ~0ull - 3u;
+  }));
+  VMEMU_CHECK(
+      rejected([](bytes_t& bytes, hdr_t&, hndlr_t*) { bytes.pop_back(); }));
+  VMEMU_CHECK(rejected([](bytes_t& bytes, hdr_t&, hndlr_t*) {
+    bytes.resize(sizeof(hdr_t) - 1u);
+  }));
+
+  // the file as written still loads...
+  VMEMU_CHECK(write_file(path, data) && cache.load_hndlrs(profiles));
+  VMEMU_CHECK(profiles.size() == 3u);
+  return true;
+}
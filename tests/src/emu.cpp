@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <iterator>
+#include <vmemu_t.hpp>
+
+#include "fixture_image.hpp"
+#include "test.hpp"
+
+// emulate every vm entry of a fixture with the configuration given...
+static bool emulate(test::fixture_image_t& fixture, vm::emu_cfg_t cfg,
+                    std::vector<vm::instrs::vrtn_t>& vrtns) {
+  cfg.image = &fixture.image;
+  vm::emu_t emu(fixture.vmctxs[0].get(), cfg);
+  if (!emu.init()) return false;
+
+  for (auto idx = 0u; idx < fixture.vmctxs.size(); ++idx) {
+    auto& vrtn = vrtns.emplace_back();
+    if (!emu.reset(fixture.vmctxs[idx].get()) ||
+        !emu.emulate(fixture.fixture.vm_entries[idx], vrtn))
+      return false;
+  }
+
+  return true;
+}
+
+// branches validated on forks running in parallel are the ones validated on
+// the engine itself...
+VMEMU_TEST(emu_parallel_spec_agrees) {
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 2u, .blocks = 8u}));
+
+  std::vector<vm::instrs::vrtn_t> serial, parallel;
+  vm::emu_cfg_t cfg;
+  VMEMU_CHECK(emulate(fixture, cfg, serial));
+
+  cfg.parallel_spec = true;
+  VMEMU_CHECK(emulate(fixture, cfg, parallel));
+
+  for (auto idx = 0u; idx < serial.size(); ++idx) {
+    const auto& lhs = serial[idx].m_blks;
+    const auto& rhs = parallel[idx].m_blks;
+    VMEMU_CHECK(lhs.size() == fixture.fixture.blocks);
+    VMEMU_CHECK(lhs.size() == rhs.size());
+
+    for (auto blk = 0u; blk < lhs.size(); ++blk) {
+      VMEMU_CHECK(lhs[blk].m_vip.rva == rhs[blk].m_vip.rva);
+      VMEMU_CHECK(lhs[blk].branch_type == rhs[blk].branch_type);
+      VMEMU_CHECK(lhs[blk].branches == rhs[blk].branches);
+      VMEMU_CHECK(lhs[blk].m_vinstrs.size() == rhs[blk].m_vinstrs.size());
+    }
+  }
+
+  return true;
+}
+
+// every stack snapshot of a virtual jmp is given back once a routine is
+// emulated, whether or not it was spilled along the way...
+VMEMU_TEST(emu_jmp_bytes_released) {
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 2u, .blocks = 16u}));
+
+  for (const auto budget : {0u, 1u}) {
+    vm::emu_cfg_t cfg;
+    cfg.image = &fixture.image;
+    cfg.snapshot_budget = budget;
+
+    vm::emu_t emu(fixture.vmctxs[0].get(), cfg);
+    VMEMU_CHECK(emu.init());
+
+    for (auto idx = 0u; idx < fixture.vmctxs.size(); ++idx) {
+      vm::instrs::vrtn_t vrtn;
+      VMEMU_CHECK(emu.reset(fixture.vmctxs[idx].get()));
+      VMEMU_CHECK(emu.emulate(fixture.fixture.vm_entries[idx], vrtn));
+      VMEMU_CHECK(vrtn.m_blks.size() == fixture.fixture.blocks);
+      VMEMU_CHECK(emu.jmp_bytes() == 0u);
+    }
+  }
+
+  return true;
+}
+
+// the vm handlers of the fixture are the ones vmprofiler matches, with the
+// operands the generator encrypted...
+VMEMU_TEST(emu_fixture_hndlrs) {
+  using vm::instrs::mnemonic_t;
+  constexpr mnemonic_t expected[] = {
+      mnemonic_t::sreg,
+      mnemonic_t::lreg,
+      mnemonic_t::lconst,
+      mnemonic_t::add,
+      mnemonic_t::pushvsp,
+      mnemonic_t::read,
+      mnemonic_t::jmp,
+      mnemonic_t::vmexit,
+  };
+
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 1u, .blocks = 4u}));
+
+  std::vector<vm::instrs::vrtn_t> vrtns;
+  VMEMU_CHECK(emulate(fixture, {}, vrtns));
+
+  std::vector<mnemonic_t> found;
+  for (const auto& vblk : vrtns[0].m_blks) {
+    VMEMU_CHECK(!vblk.m_vinstrs.empty());
+    for (const auto& vinstr : vblk.m_vinstrs) {
+      VMEMU_CHECK(std::find(std::begin(expected), std::end(expected),
+                            vinstr.mnemonic) != std::end(expected));
+      if (std::find(found.begin(), found.end(), vinstr.mnemonic) ==
+          found.end())
+        found.push_back(vinstr.mnemonic);
+    }
+
+    // every block but the last ends in a virtual jcc...
+    const auto last = vblk.m_vinstrs.back().mnemonic;
+    VMEMU_CHECK(last == mnemonic_t::jmp || last == mnemonic_t::vmexit);
+    if (last == mnemonic_t::jmp) {
+      VMEMU_CHECK(vblk.branch_type == vm::instrs::vbranch_type::jcc);
+      VMEMU_CHECK(vblk.branches.size() == 2u);
+    }
+  }
+  VMEMU_CHECK(found.size() == std::size(expected));
+
+  // the first block stores everything vm enter pushed, one register after
+  // the other...
+  const auto& entry = vrtns[0].m_blks[0].m_vinstrs;
+  VMEMU_CHECK(entry.size() > 17u);
+  for (auto vreg = 0u; vreg <= 16u; ++vreg) {
+    VMEMU_CHECK(entry[vreg].mnemonic == mnemonic_t::sreg);
+    VMEMU_CHECK(entry[vreg].imm.has_imm && entry[vreg].imm.val == vreg * 8u);
+  }
+
+  return true;
+}
@@ -0,0 +1,51 @@
+#include "fixture_image.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+test::fixture_image_t::~fixture_image_t() {
+  // the image maps the file, windows does not remove mapped files...
+  vmctxs.clear();
+  image.unload();
+
+  std::error_code ec;
+  if (!path.empty()) std::filesystem::remove(path, ec);
+}
+
+bool test::fixture_image_t::load(const bench::fixture_cfg_t& cfg) {
+  fixture = bench::gen_fixture(cfg);
+
+  // ctest may run tests in parallel, every fixture gets a file of its own...
+  path = (std::filesystem::temp_directory_path() /
+          ("vmemu-tests-" + std::to_string(std::random_device{}()) + ".bin"))
+             .string();
+
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  if (!output.write(reinterpret_cast<const char*>(fixture.file.data()),
+                    fixture.file.size())) {
+    std::printf("[!] failed to write fixture to %s...\n", path.c_str());
+    return false;
+  }
+  output.close();
+
+  if (!image.load(path)) {
+    std::printf("[!] failed to load fixture...\n");
+    return false;
+  }
+
+  for (const auto vm_entry_rva : fixture.vm_entries) {
+    vmctxs.push_back(std::make_unique<vm::vmctx_t>(
+        image.module_base(), image.image_base(), image.image_size(),
+        vm_entry_rva));
+
+    if (!vmctxs.back()->init()) {
+      std::printf("[!] failed to init vmctx of vm entry %x...\n",
+                  vm_entry_rva);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <fixture.hpp>
+#include <memory>
+#include <pe_image_t.hpp>
+#include <string>
+#include <vector>
+#include <vmemu_t.hpp>
+
+namespace test {
+/// <summary>
+/// a fixture binary of vmemu-bench written to a temporary file, loaded and
+/// with a vmctx for each of its vm entries... the file is removed again when
+/// the fixture is destroyed...
+/// </summary>
+struct fixture_image_t {
+  ~fixture_image_t();
+
+  /// <summary>
+  /// generate, write and load a fixture binary...
+  /// </summary>
+  /// <param name="cfg">shape of the fixture...</param>
+  /// <returns>returns false if the fixture could not be loaded...</returns>
+  bool load(const bench::fixture_cfg_t& cfg);
+
+  bench::fixture_t fixture;
+  std::string path;
+  vm::pe_image_t image;
+  std::vector<std::unique_ptr<vm::vmctx_t>> vmctxs;
+};
+}  // namespace test
@@ -0,0 +1,132 @@
+#include <cstring>
+#include <jmp_table_t.hpp>
+
+#include "fixture_image.hpp"
+#include "test.hpp"
+
+// virtual registers of the blocks below...
+static constexpr auto idx_reg = 0x10u, delta_reg = 0x28u, flags_reg = 0x30u;
+
+// tables are written into the slack of .text behind the vm entry stubs...
+static constexpr auto table_rva = 0x1800u;
+
+static vm::instrs::vinstr_t vinstr(vm::instrs::mnemonic_t mnemonic,
+                                   std::uint64_t imm = 0ull,
+                                   std::uint8_t stack_size = 64u) {
+  vm::instrs::vinstr_t result{};
+  result.mnemonic = mnemonic;
+  result.imm.has_imm = mnemonic == vm::instrs::mnemonic_t::lconst ||
+                       mnemonic == vm::instrs::mnemonic_t::lreg ||
+                       mnemonic == vm::instrs::mnemonic_t::sreg;
+  result.imm.size = result.imm.has_imm ? 64u : 0u;
+  result.imm.val = imm;
+  result.stack_size = stack_size;
+  return result;
+}
+
+// jmp [base + idx << shift] (+ delta if rebased, + adjust otherwise)... the
+// shift count goes on the stack before the value it shifts and every
+// arithmetic vinstr leaves its flags on top, both as vmprotect does it...
+static std::vector<vm::instrs::vinstr_t> table_blk(std::uint64_t base,
+                                                   std::uint8_t shift,
+                                                   std::uint8_t size,
+                                                   bool rebased,
+                                                   std::uint64_t adjust = 0u) {
+  using vm::instrs::mnemonic_t;
+  std::vector<vm::instrs::vinstr_t> vinstrs = {
+      vinstr(mnemonic_t::lconst, shift),
+      vinstr(mnemonic_t::lreg, idx_reg),
+      vinstr(mnemonic_t::shl),
+      vinstr(mnemonic_t::sreg, flags_reg),
+      vinstr(mnemonic_t::lconst, base),
+      vinstr(mnemonic_t::add),
+      vinstr(mnemonic_t::sreg, flags_reg),
+      vinstr(mnemonic_t::read, 0ull, size * 8u)};
+
+  vinstrs.push_back(rebased ? vinstr(mnemonic_t::lreg, delta_reg)
+                            : vinstr(mnemonic_t::lconst, adjust));
+  vinstrs.push_back(vinstr(mnemonic_t::add));
+  vinstrs.push_back(vinstr(mnemonic_t::sreg, flags_reg));
+  vinstrs.push_back(vinstr(mnemonic_t::jmp));
+  return vinstrs;
+}
+
+// an image based table of image based entries rebased by the bytecode and a
+// table of 32bit rva's with the module base added as a constant both give
+// the executable entries up to the first one outside of the image...
+VMEMU_TEST(jmp_table_find) {
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 1u, .blocks = 2u}));
+
+  const auto& vm = *fixture.vmctxs[0];
+  const auto image_base = vm.m_image_base, module_base = vm.m_module_base;
+
+  const std::uint64_t entries[] = {image_base + 0x1000, image_base + 0x1008,
+                                   image_base + 0x1000,
+                                   image_base + vm.m_image_size};
+  std::memcpy(reinterpret_cast<void*>(module_base + table_rva), entries,
+              sizeof entries);
+
+  const auto table = vm::jmp_table_t::find(
+      table_blk(image_base + table_rva, 3u, 8u, true));
+  VMEMU_CHECK(table);
+
+  const std::vector<std::uintptr_t> expected = {module_base + 0x1000,
+                                                module_base + 0x1008};
+  VMEMU_CHECK(table->targets(vm, 16u) == expected);
+  VMEMU_CHECK(table->targets(vm, 1u).size() == 1u);
+
+  const std::uint32_t rvas[] = {0x1000, 0x1008, 0x1000,
+                               static_cast<std::uint32_t>(vm.m_image_size)};
+  std::memcpy(reinterpret_cast<void*>(module_base + table_rva), rvas,
+              sizeof rvas);
+
+  const auto rva_table = vm::jmp_table_t::find(
+      table_blk(image_base + table_rva, 2u, 4u, false, module_base));
+  VMEMU_CHECK(rva_table);
+  VMEMU_CHECK(rva_table->targets(vm, 16u) == expected);
+  return true;
+}
+
+// targets which do not come out of a table indexed by a virtual register are
+// not taken for one...
+VMEMU_TEST(jmp_table_rejected) {
+  using vm::instrs::mnemonic_t;
+  const auto base = 0x140001800ull;
+  VMEMU_CHECK(!vm::jmp_table_t::find({}));
+
+  // a constant target...
+  VMEMU_CHECK(!vm::jmp_table_t::find(
+      {vinstr(mnemonic_t::lconst, base), vinstr(mnemonic_t::jmp)}));
+
+  // a virtual register read as is, not scaled or moved...
+  VMEMU_CHECK(!vm::jmp_table_t::find({vinstr(mnemonic_t::lreg, idx_reg),
+                                      vinstr(mnemonic_t::read),
+                                      vinstr(mnemonic_t::jmp)}));
+
+  // the relocation delta added twice...
+  auto vinstrs = table_blk(base, 3u, 8u, true);
+  vinstrs.insert(vinstrs.end() - 1,
+                 {vinstr(mnemonic_t::lreg, delta_reg), vinstr(mnemonic_t::add),
+                  vinstr(mnemonic_t::sreg, flags_reg)});
+  VMEMU_CHECK(!vm::jmp_table_t::find(vinstrs));
+
+  // the count and value of the shift swapped...
+  vinstrs = table_blk(base, 3u, 8u, true);
+  std::swap(vinstrs[0], vinstrs[1]);
+  VMEMU_CHECK(!vm::jmp_table_t::find(vinstrs));
+
+  // an entry size which is neither 4 nor 8 bytes...
+  VMEMU_CHECK(!vm::jmp_table_t::find(table_blk(base, 1u, 2u, true)));
+
+  // a vinstr whose stack effects are not modeled...
+  vinstrs = table_blk(base, 3u, 8u, true);
+  vinstrs.insert(vinstrs.begin(), vinstr(mnemonic_t::vmexit));
+  VMEMU_CHECK(!vm::jmp_table_t::find(vinstrs));
+
+  // a block which does not end in the jmp...
+  vinstrs = table_blk(base, 3u, 8u, true);
+  vinstrs.push_back(vinstr(mnemonic_t::lconst, 0ull));
+  VMEMU_CHECK(!vm::jmp_table_t::find(vinstrs));
+  return true;
+}
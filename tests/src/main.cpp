@@ -0,0 +1,35 @@
+#include <cstring>
+#include <logger_t.hpp>
+#include <vmprofiler.hpp>
+
+#include "test.hpp"
+
+std::map<std::string, test::fn_t>& test::registry() {
+  static std::map<std::string, fn_t> tests;
+  return tests;
+}
+
+// vmemu-tests [name]... runs a single test or every test...
+int main(int argc, const char* argv[]) {
+  // the decoder vmprofiler matches vm handlers with, emulation logs warnings
+  // and errors only...
+  vm::utils::init();
+  vm::logger_t::level(vm::log_level_t::warn);
+
+  auto failed = 0u, ran = 0u;
+  for (const auto& [name, fn] : test::registry()) {
+    if (argc > 1 && std::strcmp(argv[1], name.c_str())) continue;
+
+    ++ran;
+    const auto passed = fn();
+    failed += !passed;
+    std::printf("> %s... %s\n", name.c_str(), passed ? "passed" : "failed");
+  }
+
+  if (!ran) {
+    std::printf("[!] no test named %s...\n", argc > 1 ? argv[1] : "");
+    return -1;
+  }
+
+  return failed ? -1 : 0;
+}
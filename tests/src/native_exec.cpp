@@ -0,0 +1,197 @@
+#include <unicorn/unicorn.h>
+
+#include <cstring>
+#include <decode_cache_t.hpp>
+#include <native_exec_t.hpp>
+#include <vector>
+
+#include "test.hpp"
+
+// hand assembled vm handlers, each ends the way a vm handler does...
+static const std::uint8_t partial_regs_hndlr[] = {
+    0xB0, 0x12,                          // mov al, 0x12
+    0xB4, 0x34,                          // mov ah, 0x34
+    0x88, 0xEF,                          // mov bh, ch
+    0x66, 0x05, 0x01, 0x01,              // add ax, 0x101
+    0x89, 0xCA,                          // mov edx, ecx
+    0x48, 0x0F, 0xBE, 0xF1,              // movsx rsi, cl
+    0x0F, 0xB6, 0xFC,                    // movzx edi, ah
+    0xC1, 0xE0, 0x21,                    // shl eax, 0x21
+    0x66, 0xC1, 0xC1, 0x11,              // rol cx, 0x11
+    0xC0, 0xFB, 0x07,                    // sar bl, 0x7
+    0x41, 0xC1, 0xC8, 0x05,              // ror r8d, 0x5
+    0x66, 0x41, 0xF7, 0xD1,              // not r9w
+    0x41, 0xF6, 0xDA,                    // neg r10b
+    0x41, 0x0F, 0xCB,                    // bswap r11d
+    0x86, 0xDC,                          // xchg ah, bl
+    0x44, 0x8D, 0x64, 0x48, 0x10,        // lea r12d, [rax+rcx*2+0x10]
+    0x50,                                // push rax
+    0xC6, 0x44, 0x24, 0x01, 0x55,        // mov byte ptr [rsp+0x1], 0x55
+    0x4C, 0x8B, 0x2C, 0x24,              // mov r13, qword ptr [rsp]
+    0x41, 0x5E,                          // pop r14
+    0x4D, 0x63, 0xFF,                    // movsxd r15, r15d
+    0xC2, 0x08, 0x00};                   // ret 0x8
+
+static const std::uint8_t overlay_hndlr[] = {
+    0xB9, 0x43, 0x00, 0x00, 0x00,              // mov ecx, 0x43
+    0x48, 0xD3, 0xEA,                          // shr rdx, cl
+    0x66, 0xD3, 0xF8,                          // sar ax, cl
+    0x41, 0xD2, 0xC0,                          // rol r8b, cl
+    0x66, 0xC7, 0x44, 0x24, 0xF0, 0xEF,
+    0xBE,                                // mov word ptr [rsp-0x10], 0xbeef
+    0xC7, 0x44, 0x24, 0xF1, 0xBE, 0xBA, 0xFE,
+    0xCA,                                // mov dword ptr [rsp-0xf], 0xcafebabe
+    0x44, 0x0F, 0xB7, 0x4C, 0x24, 0xF0,  // movzx r9d, word ptr [rsp-0x10]
+    0x4C, 0x8B, 0x54, 0x24, 0xF0,        // mov r10, qword ptr [rsp-0x10]
+    0x4C, 0x03, 0x5C, 0x24, 0xF0,        // add r11, qword ptr [rsp-0x10]
+    0x66, 0x41, 0x81, 0xEC, 0xFF, 0x7F,  // sub r12w, 0x7fff
+    0x41, 0xFE, 0xC5,                    // inc r13b
+    0x48, 0x98,                          // cdqe
+    0x98,                                // cwde
+    0x48, 0x99,                          // cqo
+    0x48, 0x8D, 0x05, 0x00, 0x01, 0x00, 0x00,  // lea rax, [rip+0x100]
+    0xFF, 0xE0};                               // jmp rax
+
+static int uc_regs[] = {
+    UC_X86_REG_RAX, UC_X86_REG_RCX, UC_X86_REG_RDX, UC_X86_REG_RBX,
+    UC_X86_REG_RSP, UC_X86_REG_RBP, UC_X86_REG_RSI, UC_X86_REG_RDI,
+    UC_X86_REG_R8,  UC_X86_REG_R9,  UC_X86_REG_R10, UC_X86_REG_R11,
+    UC_X86_REG_R12, UC_X86_REG_R13, UC_X86_REG_R14, UC_X86_REG_R15};
+
+static constexpr auto stack_base = 0x10000000ull, stack_size = 0x10000ull;
+
+// the code of a handler has to be at the same address on the host (where it
+// is decoded) and in unicorn-engine (where it runs)...
+alignas(0x1000) static std::uint8_t code[0x1000];
+
+// an engine with a handler mapped and every register set to a value of its
+// own, closed on scope exit so that a failed check does not leak it...
+struct hndlr_engine_t {
+  template <std::size_t N>
+  explicit hndlr_engine_t(const std::uint8_t (&hndlr)[N])
+      : decoder(reinterpret_cast<std::uintptr_t>(code), sizeof code) {
+    std::memset(code, 0xCC, sizeof code);
+    std::memcpy(code, hndlr, N);
+
+    const auto base = reinterpret_cast<std::uintptr_t>(code);
+    if (uc_open(UC_ARCH_X86, UC_MODE_64, &uc) ||
+        uc_mem_map(uc, base, sizeof code, UC_PROT_ALL) ||
+        uc_mem_write(uc, base, code, sizeof code) ||
+        uc_mem_map(uc, stack_base, stack_size, UC_PROT_ALL))
+      return;
+
+    for (auto idx = 0u; idx < sizeof uc_regs / sizeof uc_regs[0]; ++idx) {
+      std::uint64_t val = (0x8182838485868788ull * (idx + 1)) ^ 0x5A5A5A5A5Aull;
+      if (uc_regs[idx] == UC_X86_REG_RSP) val = stack_base + stack_size / 2;
+      uc_reg_write(uc, uc_regs[idx], &val);
+    }
+
+    // the handler returns into the (unused) rest of the code page...
+    const std::uint64_t ret = base + 0x800;
+    const auto rsp = stack_base + stack_size / 2;
+    ready = !uc_mem_write(uc, rsp, &ret, sizeof ret);
+  }
+
+  ~hndlr_engine_t() {
+    if (uc) uc_close(uc);
+  }
+
+  // trusted entry for the handler, the operand is taken from reg right before
+  // the native instruction at imm_offset...
+  vm::hndlr_entry_t entry(std::uintptr_t imm_offset, int reg) {
+    vm::hndlr_entry_t entry{};
+    entry.trusted = true;
+    entry.vinstr.imm.has_imm = true;
+    entry.vinstr.imm.size = 64;
+    entry.imm = {reinterpret_cast<std::uintptr_t>(code) + imm_offset, reg,
+                 false};
+
+    for (auto addr = reinterpret_cast<std::uintptr_t>(code);;) {
+      const auto instr = decoder.decode(addr);
+      if (!instr) break;
+
+      entry.trace.push_back(addr);
+      if (instr->mnemonic == ZYDIS_MNEMONIC_RET ||
+          instr->mnemonic == ZYDIS_MNEMONIC_JMP)
+        break;
+
+      addr += instr->length;
+    }
+
+    return entry;
+  }
+
+  // run a handler on the host and in unicorn-engine and compare the two, same
+  // as native_mode_t::cross_check...
+  bool cross_check(const vm::hndlr_entry_t& entry, std::uint64_t& imm) {
+    vm::native_exec_t native;
+    native.init(uc, &decoder);
+
+    const auto prog = native.prog(entry);
+    if (!prog || !native.run(*prog, entry, imm)) return false;
+
+    std::uintptr_t rip = 0ull;
+    return !uc_emu_start(uc, entry.trace.front(), 0ull, 0ull,
+                         entry.trace.size()) &&
+           !uc_reg_read(uc, UC_X86_REG_RIP, &rip) && native.check(rip);
+  }
+
+  vm::decode_cache_t decoder;
+  uc_engine* uc = nullptr;
+  bool ready = false;
+};
+
+// partial register writes (ah-bh, 8/16bit merges, 32bit zero extension),
+// shift and rotate widths, buffered writes read back and ret imm match
+// unicorn-engine...
+VMEMU_TEST(native_exec_partial_regs) {
+  hndlr_engine_t engine(partial_regs_hndlr);
+  VMEMU_CHECK(engine.ready);
+
+  std::uint64_t r8 = 0ull, imm = 0ull;
+  VMEMU_CHECK(!uc_reg_read(engine.uc, UC_X86_REG_R8, &r8));
+
+  // the operand is r8 right before ror r8d, 0x5...
+  const auto entry = engine.entry(0x1D, UC_X86_REG_R8);
+  VMEMU_CHECK(entry.trace.size() == 22u);
+  VMEMU_CHECK(engine.cross_check(entry, imm));
+  VMEMU_CHECK(imm == r8);
+  return true;
+}
+
+// shifts by cl, overlapping buffered writes read back at other sizes, the
+// sign extending conversions and a jmp reg out of a rip relative lea match
+// unicorn-engine...
+VMEMU_TEST(native_exec_overlay) {
+  hndlr_engine_t engine(overlay_hndlr);
+  VMEMU_CHECK(engine.ready);
+
+  std::uint64_t rdx = 0ull, imm = 0ull;
+  VMEMU_CHECK(!uc_reg_read(engine.uc, UC_X86_REG_RDX, &rdx));
+
+  // the operand is rdx right before shr rdx, cl...
+  const auto entry = engine.entry(0x05, UC_X86_REG_RDX);
+  VMEMU_CHECK(entry.trace.size() == 16u);
+  VMEMU_CHECK(engine.cross_check(entry, imm));
+  VMEMU_CHECK(imm == rdx);
+  return true;
+}
+
+// a handler whose program never gets to the native instruction the operand is
+// read at can not be run on the host...
+VMEMU_TEST(native_exec_imm_not_reached) {
+  hndlr_engine_t engine(partial_regs_hndlr);
+  VMEMU_CHECK(engine.ready);
+
+  vm::native_exec_t native;
+  native.init(engine.uc, &engine.decoder);
+
+  // 0x1 is inside of mov al, 0x12 and never the start of an instruction...
+  const auto entry = engine.entry(0x01, UC_X86_REG_RAX);
+  const auto prog = native.prog(entry);
+  VMEMU_CHECK(prog);
+
+  std::uint64_t imm = 0ull;
+  VMEMU_CHECK(!native.run(*prog, entry, imm));
+  return true;
+}
@@ -0,0 +1,198 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <rtn_file_t.hpp>
+
+#include "test.hpp"
+
+static constexpr auto module_base = 0x7FF600000000ull,
+                      image_base = 0x140000000ull;
+
+// a routine with a jcc block, a table block and an exit block, branches are
+// module based as they are while emulating...
+static vm::instrs::vrtn_t make_rtn() {
+  using vm::instrs::mnemonic_t;
+  vm::instrs::vrtn_t rtn{};
+  rtn.m_rva = 0x1000;
+
+  const auto blk = [&](std::uintptr_t rva, vm::instrs::vbranch_type type,
+                       std::vector<std::uintptr_t> branches) {
+    auto& vblk = rtn.m_blks.emplace_back();
+    vblk.m_vip.rva = rva;
+    vblk.m_vip.img_base = image_base + rva;
+    vblk.branch_type = type;
+    for (const auto br : branches) vblk.branches.push_back(module_base + br);
+    return &vblk;
+  };
+
+  const auto vinstr = [](vm::instrs::vblk_t* vblk, mnemonic_t mnemonic,
+                         std::uint8_t size = 0u, std::uintptr_t val = 0u) {
+    auto& entry = vblk->m_vinstrs.emplace_back();
+    entry.mnemonic = mnemonic;
+    entry.imm.has_imm = size != 0u;
+    entry.imm.size = size;
+    entry.imm.val = val;
+  };
+
+  auto vblk = blk(0x2000, vm::instrs::vbranch_type::jcc, {0x3000, 0x4000});
+  vinstr(vblk, mnemonic_t::sreg, 8u, 0x18);
+  vinstr(vblk, mnemonic_t::lconst, 64u, 0xDEADBEEFCAFEBABEull);
+  vinstr(vblk, mnemonic_t::add);
+  vinstr(vblk, mnemonic_t::jmp);
+
+  vblk = blk(0x3000, vm::instrs::vbranch_type::table,
+             {0x4000, 0x5000, 0x6000});
+  vinstr(vblk, mnemonic_t::lreg, 8u, 0x20);
+  vinstr(vblk, mnemonic_t::jmp);
+
+  vblk = blk(0x4000, vm::instrs::vbranch_type::none, {});
+  vinstr(vblk, mnemonic_t::vmexit);
+  return rtn;
+}
+
+static bool same_rtn(const vm::instrs::vrtn_t& a, const vm::instrs::vrtn_t& b) {
+  if (a.m_rva != b.m_rva || a.m_blks.size() != b.m_blks.size()) return false;
+
+  for (auto idx = 0u; idx < a.m_blks.size(); ++idx) {
+    const auto &x = a.m_blks[idx], &y = b.m_blks[idx];
+    if (x.m_vip.rva != y.m_vip.rva || x.m_vip.img_base != y.m_vip.img_base ||
+        x.branch_type != y.branch_type || x.branches != y.branches ||
+        x.m_vinstrs.size() != y.m_vinstrs.size())
+      return false;
+
+    for (auto vidx = 0u; vidx < x.m_vinstrs.size(); ++vidx) {
+      const auto &v = x.m_vinstrs[vidx], &w = y.m_vinstrs[vidx];
+      if (v.mnemonic != w.mnemonic || v.imm.has_imm != w.imm.has_imm ||
+          v.imm.size != w.imm.size || v.imm.val != w.imm.val)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// a routine written to a file, block by block next to a whole routine, reads
+// back the same and the file holds the same bytes as a writer into memory...
+VMEMU_TEST(rtn_file_round_trip) {
+  const auto rtn = make_rtn();
+  auto second = rtn;
+  second.m_rva = 0x1100;
+
+  const auto path = (std::filesystem::temp_directory_path() /
+                     ("vmemu-tests-" + std::to_string(std::random_device{}()) +
+                      ".vrtn"))
+                        .string();
+
+  const auto write = [&](vm::rtn_writer_t& writer) {
+    const auto id = writer.begin_rtn(static_cast<std::uint32_t>(rtn.m_rva));
+    writer.add_rtn(second);
+    for (const auto& blk : rtn.m_blks) writer.add_blk(id, blk);
+    writer.end_rtn(id);
+
+    // routines still open on close are dropped...
+    writer.add_blk(writer.begin_rtn(0x1200), rtn.m_blks[0]);
+    return writer.close();
+  };
+
+  vm::rtn_writer_t file_writer;
+  VMEMU_CHECK(file_writer.open(path, module_base, image_base));
+  VMEMU_CHECK(file_writer.path() == path);
+  const auto written = write(file_writer);
+
+  std::ifstream input(path, std::ios::binary);
+  const std::vector<std::uint8_t> data(std::istreambuf_iterator<char>(input),
+                                       {});
+  input.close();
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  VMEMU_CHECK(written);
+
+  std::vector<std::uint8_t> buffer;
+  vm::rtn_writer_t mem_writer;
+  VMEMU_CHECK(mem_writer.open(buffer, module_base, image_base));
+  VMEMU_CHECK(mem_writer.path().empty());
+  VMEMU_CHECK(write(mem_writer));
+  VMEMU_CHECK(buffer == data);
+
+  vm::rtn_file_t file;
+  VMEMU_CHECK(file.init(data.data(), data.size()));
+  VMEMU_CHECK(file.hdr().image_base == image_base);
+  VMEMU_CHECK(file.rtns().size() == 2u);
+  VMEMU_CHECK(file.rtns()[0].rva == second.m_rva);
+  VMEMU_CHECK(file.rtns()[1].rva == rtn.m_rva);
+
+  // branches are image based in the file...
+  const auto blks = file.blks(file.rtns()[1]);
+  VMEMU_CHECK(blks.size() == 3u);
+  VMEMU_CHECK(file.branches(blks[0]).size() == 2u &&
+              file.branches(blks[0])[0] == image_base + 0x3000);
+
+  vm::instrs::vrtn_t read;
+  file.to_vrtn(file.rtns()[0], module_base, read);
+  VMEMU_CHECK(same_rtn(read, second));
+  file.to_vrtn(file.rtns()[1], module_base, read);
+  VMEMU_CHECK(same_rtn(read, rtn));
+  return true;
+}
+
+// a truncated or corrupt file is refused by init or gives empty tables, never
+// a span past the end of the file...
+VMEMU_TEST(rtn_file_corrupt) {
+  std::vector<std::uint8_t> data;
+  vm::rtn_writer_t writer;
+  VMEMU_CHECK(writer.open(data, module_base, image_base));
+  writer.add_rtn(make_rtn());
+  VMEMU_CHECK(writer.close());
+
+  // the routine table is last, every truncation cuts into it...
+  vm::rtn_file_t file;
+  for (auto size = 0u; size < data.size(); ++size)
+    VMEMU_CHECK(!file.init(data.data(), size));
+
+  const auto corrupt = [&](auto&& fn) {
+    auto bytes = data;
+    auto& hdr = *reinterpret_cast<vm::file::hdr_t*>(bytes.data());
+    auto& rtn = *reinterpret_cast<vm::file::rtn_t*>(bytes.data() + hdr.rtn_tbl);
+    auto* blks = reinterpret_cast<vm::file::blk_t*>(bytes.data() + rtn.blk_tbl);
+    fn(hdr, rtn, blks);
+    return bytes;
+  };
+
+  using vm::file::blk_t, vm::file::hdr_t, vm::file::rtn_t;
+  auto bytes = corrupt([](hdr_t& hdr, rtn_t&, blk_t*) { hdr.magic ^= 1u; });
+  VMEMU_CHECK(!file.init(bytes.data(), bytes.size()));
+
+  bytes = corrupt([](hdr_t& hdr, rtn_t&, blk_t*) { ++hdr.version; });
+  VMEMU_CHECK(!file.init(bytes.data(), bytes.size()));
+
+  bytes = corrupt([](hdr_t& hdr, rtn_t&, blk_t*) { hdr.rtn_cnt = ~0u; });
+  VMEMU_CHECK(!file.init(bytes.data(), bytes.size()));
+
+  bytes = corrupt([](hdr_t& hdr, rtn_t&, blk_t*) { hdr.rtn_tbl += 4u; });
+  VMEMU_CHECK(!file.init(bytes.data(), bytes.size()));
+
+  bytes = corrupt([](hdr_t& hdr, rtn_t&, blk_t*) { hdr.rtn_tbl = ~0ull; });
+  VMEMU_CHECK(!file.init(bytes.data(), bytes.size()));
+
+  // bad tables below the routine table only empty the table itself...
+  bytes = corrupt([](hdr_t&, rtn_t& rtn, blk_t*) { rtn.blk_cnt = ~0u; });
+  VMEMU_CHECK(file.init(bytes.data(), bytes.size()));
+  VMEMU_CHECK(file.blks(file.rtns()[0]).empty());
+
+  bytes = corrupt([](hdr_t&, rtn_t&, blk_t* blks) {
+    blks[0].vinstr_tbl = ~0ull - 8u;
+    blks[1].branch_tbl += 1u;
+    blks[2].vinstr_cnt = ~0u;
+  });
+  VMEMU_CHECK(file.init(bytes.data(), bytes.size()));
+
+  const auto blks = file.blks(file.rtns()[0]);
+  VMEMU_CHECK(blks.size() == 3u);
+  VMEMU_CHECK(file.vinstrs(blks[0]).empty());
+  VMEMU_CHECK(file.branches(blks[0]).size() == 2u);
+  VMEMU_CHECK(file.branches(blks[1]).empty());
+  VMEMU_CHECK(file.vinstrs(blks[2]).empty());
+  return true;
+}
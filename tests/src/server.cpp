@@ -0,0 +1,134 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <rtn_file_t.hpp>
+#include <server_t.hpp>
+#include <thread>
+#include <thread_pool_t.hpp>
+
+#include "fixture_image.hpp"
+#include "test.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// a server running on a thread of its own, stopped and joined on scope exit
+// so that a failed check does not leave it running...
+struct server_thread_t {
+  explicit server_thread_t(const std::string& path)
+      : server(make_cfg(), pool) {
+    thread = std::thread([this, path] { server.run(path); });
+  }
+
+  ~server_thread_t() {
+    cancel = true;
+    if (thread.joinable()) thread.join();
+  }
+
+  const vm::emu_cfg_t& make_cfg() {
+    emu_cfg.cancel = &cancel;
+    return emu_cfg;
+  }
+
+  std::atomic<bool> cancel = false;
+  vm::emu_cfg_t emu_cfg;
+  vm::thread_pool_t pool{2u};
+  vm::server_t server;
+  std::thread thread;
+};
+
+// connect to the server, it may still be starting up...
+static int connect_to(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+  for (auto attempt = 0u; attempt < 100u; ++attempt) {
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (!::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr))
+      return fd;
+
+    ::close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  return -1;
+}
+
+// send a request and read its reply, see vm::serve...
+static bool request(int fd, const std::vector<std::uint8_t>& req,
+                    std::vector<std::uint8_t>& reply) {
+  const auto size = static_cast<std::uint32_t>(req.size());
+  if (::send(fd, &size, sizeof size, 0) != sizeof size ||
+      ::send(fd, req.data(), req.size(), 0) !=
+          static_cast<ssize_t>(req.size()))
+    return false;
+
+  std::uint32_t reply_size = 0u;
+  if (::recv(fd, &reply_size, sizeof reply_size, MSG_WAITALL) !=
+      sizeof reply_size)
+    return false;
+
+  reply.resize(reply_size);
+  return ::recv(fd, reply.data(), reply_size, MSG_WAITALL) ==
+         static_cast<ssize_t>(reply_size);
+}
+
+// a binary loaded and one of its vm entries emulated over the socket gives
+// back the routine of the vm entry...
+VMEMU_TEST(server_loopback) {
+  test::fixture_image_t fixture;
+  VMEMU_CHECK(fixture.load({.entries = 1u, .blocks = 4u}));
+
+  const auto path = fixture.path + ".sock";
+  {
+    server_thread_t server(path);
+    const auto fd = connect_to(path);
+    VMEMU_CHECK(fd >= 0);
+
+    struct stat st;
+    VMEMU_CHECK(!::lstat(path.c_str(), &st) && (st.st_mode & 0777) == 0600);
+
+    std::vector<std::uint8_t> req, reply;
+    req.push_back(static_cast<std::uint8_t>(vm::serve::op_t::load));
+    req.insert(req.end(), fixture.path.begin(), fixture.path.end());
+
+    VMEMU_CHECK(request(fd, req, reply));
+    VMEMU_CHECK(reply.size() == 5u &&
+                reply[0] == static_cast<std::uint8_t>(vm::serve::reply_t::ok));
+
+    const auto rva = fixture.fixture.vm_entries[0];
+    req.assign(1u, static_cast<std::uint8_t>(vm::serve::op_t::emulate));
+    req.insert(req.end(), reply.begin() + 1, reply.end());
+    req.insert(req.end(), reinterpret_cast<const std::uint8_t*>(&rva),
+               reinterpret_cast<const std::uint8_t*>(&rva) + sizeof rva);
+
+    const auto emulated = request(fd, req, reply);
+    ::close(fd);
+    VMEMU_CHECK(emulated);
+    VMEMU_CHECK(reply.size() > 2u &&
+                reply[0] == static_cast<std::uint8_t>(vm::serve::reply_t::ok) &&
+                reply[1] == static_cast<std::uint8_t>(vm::emu_status_t::ok));
+
+    // the routine file starts after the status, move it to an aligned
+    // buffer...
+    const std::vector<std::uint8_t> rtn_data(reply.begin() + 2, reply.end());
+    vm::rtn_file_t file;
+    VMEMU_CHECK(file.init(rtn_data.data(), rtn_data.size()));
+    VMEMU_CHECK(file.rtns().size() == 1u && file.rtns()[0].rva == rva);
+    VMEMU_CHECK(file.blks(file.rtns()[0]).size() == fixture.fixture.blocks);
+  }
+
+  // the server removes its socket once stopped...
+  VMEMU_CHECK(::access(path.c_str(), F_OK) < 0);
+  return true;
+}
+#else
+// server_t needs unix domain sockets...
+VMEMU_TEST(server_loopback) { return true; }
+#endif
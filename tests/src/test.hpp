@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace test {
+using fn_t = bool (*)();
+
+/// <summary>
+/// every test of the executable by name...
+/// </summary>
+std::map<std::string, fn_t>& registry();
+
+struct register_t {
+  register_t(const char* name, fn_t fn) { registry()[name] = fn; }
+};
+}  // namespace test
+
+// define a test, ctest runs each one by name (see the root cmake.toml)...
+#define VMEMU_TEST(name)                                   \
+  static bool name();                                      \
+  static const test::register_t name##_test(#name, &name); \
+  static bool name()
+
+// fail the test if cond does not hold...
+#define VMEMU_CHECK(cond)                                              \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      std::printf("[!] %s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                  #cond);                                              \
+      return false;                                                    \
+    }                                                                  \
+  } while (0)
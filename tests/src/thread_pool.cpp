@@ -0,0 +1,42 @@
+#include <atomic>
+#include <thread_pool_t.hpp>
+
+#include "test.hpp"
+
+// workers submitting to their own queue while other workers steal from it and
+// idle workers go to sleep and wake up again...
+VMEMU_TEST(thread_pool_reentrant_submit) {
+  constexpr auto rounds = 200u, outer = 64u, inner = 16u;
+
+  vm::thread_pool_t pool(4u);
+  for (auto round = 0u; round < rounds; ++round) {
+    std::atomic<std::size_t> ran = 0u;
+    for (auto idx = 0u; idx < outer; ++idx)
+      pool.submit([&](std::size_t) {
+        for (auto sub = 0u; sub < inner; ++sub)
+          pool.submit([&](std::size_t) { ++ran; });
+        ++ran;
+      });
+
+    pool.wait();
+    VMEMU_CHECK(ran == outer * inner + outer);
+  }
+
+  return true;
+}
+
+// every worker index handed to a task is in range...
+VMEMU_TEST(thread_pool_worker_idx) {
+  vm::thread_pool_t pool(3u);
+  std::atomic<bool> in_range = true;
+
+  for (auto idx = 0u; idx < 1000u; ++idx)
+    pool.submit([&](std::size_t worker_idx) {
+      if (worker_idx >= pool.size()) in_range = false;
+    });
+
+  pool.wait();
+  VMEMU_CHECK(pool.size() == 3u);
+  VMEMU_CHECK(in_range);
+  return true;
+}
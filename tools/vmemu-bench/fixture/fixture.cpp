@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <cstring>
+#include <fixture.hpp>
+#include <initializer_list>
+#include <numeric>
+#include <random>
+
+namespace bench {
+static constexpr auto image_base = 0x140000000ull;
+static constexpr auto file_align = 0x200u, section_align = 0x1000u;
+static constexpr auto headers_size = 0x400u;
+
+// virtual registers used by the generated bytecode, as byte offsets from rsp
+// like VMProtect encodes them... 0 holds the relocation delta, 1 to 16 the
+// rest of what vm enter pushed and 1 to 12 are handed from block to block...
+static constexpr std::uint8_t vreg_delta = 0u, vreg_tmp = 19u * 8u,
+                              vreg_junk = 20u * 8u, vreg_flags = 21u * 8u,
+                              vreg_next = 22u * 8u, vreg_off = 23u * 8u;
+
+enum class kind_t : std::uint8_t {
+  sreg,
+  lreg,
+  lconst,
+  add,
+  pushvsp,
+  read,
+  jmp,
+  vmexit,
+  cnt
+};
+
+/// <summary>
+/// a generated vm handler...
+/// </summary>
+struct hndlr_t {
+  kind_t kind;
+  std::uint32_t rva = 0u;
+
+  /// <summary>
+  /// keys of the byte and qword operand decryption of this copy...
+  /// </summary>
+  std::uint8_t key_b = 0u;
+  std::uint32_t key_q = 0u;
+
+  /// <summary>
+  /// handler table slots pointing at this copy...
+  /// </summary>
+  std::vector<std::uint8_t> slots = {};
+};
+
+/// <summary>
+/// a virtual instruction of the generated bytecode...
+/// </summary>
+struct vop_t {
+  kind_t kind;
+  std::uint64_t imm;
+
+  /// <summary>
+  /// if not -1 imm is the image based address of this block...
+  /// </summary>
+  int target = -1;
+};
+
+class code_t {
+ public:
+  void put(std::initializer_list<std::uint8_t> bytes) {
+    m_data.insert(m_data.end(), bytes);
+  }
+
+  void put32(std::uint32_t val) {
+    for (auto idx = 0u; idx < 4u; ++idx) m_data.push_back(val >> idx * 8);
+  }
+
+  void put64(std::uint64_t val) {
+    for (auto idx = 0u; idx < 8u; ++idx) m_data.push_back(val >> idx * 8);
+  }
+
+  void patch32(std::size_t offset, std::uint32_t val) {
+    for (auto idx = 0u; idx < 4u; ++idx) m_data[offset + idx] = val >> idx * 8;
+  }
+
+  void align(std::size_t alignment, std::uint8_t fill = 0xCC) {
+    while (m_data.size() % alignment) m_data.push_back(fill);
+  }
+
+  std::size_t size() const { return m_data.size(); }
+  std::vector<std::uint8_t>& data() { return m_data; }
+
+ private:
+  std::vector<std::uint8_t> m_data;
+};
+
+class generator_t {
+ public:
+  explicit generator_t(const fixture_cfg_t& cfg)
+      : m_cfg(cfg),
+        m_rng(cfg.seed),
+        m_key_op(static_cast<std::uint8_t>(m_rng())),
+        m_key_tbl(m_rng()),
+        m_key_rva(m_rng()) {}
+
+  fixture_t run();
+
+ private:
+  std::uint32_t rnd(std::uint32_t max) { return m_rng() % max; }
+
+  static std::uint64_t bswap(std::uint64_t val) {
+    std::uint64_t result = 0ull;
+    for (auto idx = 0u; idx < 8u; ++idx, val >>= 8)
+      result = result << 8 | (val & 0xFF);
+    return result;
+  }
+
+  static std::uint64_t sext(std::uint32_t val) {
+    return static_cast<std::uint64_t>(
+        static_cast<std::int64_t>(static_cast<std::int32_t>(val)));
+  }
+
+  void junk();
+  void calc_jmp();
+  void vm_enter();
+  void hndlr(hndlr_t& hndlr);
+  void fill_table();
+
+  std::vector<vop_t> gen_blk(std::uint32_t blk, std::uint32_t blk_cnt);
+  void encrypt(const std::vector<vop_t>& vops, std::uint32_t rva,
+               const std::vector<std::uint32_t>& blk_rvas);
+
+  std::size_t vop_size(const vop_t& vop) const {
+    return 1u + (vop.kind == kind_t::sreg || vop.kind == kind_t::lreg) +
+           (vop.kind == kind_t::lconst) * 8u;
+  }
+
+  const fixture_cfg_t m_cfg;
+  std::mt19937 m_rng;
+
+  /// <summary>
+  /// keys of the opcode decryption, handler table and vm entry rva's...
+  /// </summary>
+  const std::uint8_t m_key_op;
+  const std::uint32_t m_key_tbl, m_key_rva;
+
+  std::uint32_t m_text_rva = 0u, m_vmp_rva = 0u;
+  code_t m_vmp;
+  std::uint32_t m_enter_rva = 0u, m_delta_rva = 0u;
+  std::size_t m_table_disp = 0u;
+  std::vector<hndlr_t> m_hndlrs;
+};
+
+void generator_t::junk() {
+  // VMProtect style padding... nothing here touches flags or anything but
+  // r10/r11, which the vm restores on exit...
+  for (auto cnt = rnd(3u); cnt; --cnt) {
+    switch (rnd(5u)) {
+      case 0u:
+        m_vmp.put({0x49, 0xBA});  // mov r10, imm64
+        m_vmp.put64((static_cast<std::uint64_t>(m_rng()) << 32) | m_rng());
+        break;
+      case 1u:
+        m_vmp.put({0x4D, 0x89, 0xD3});  // mov r11, r10
+        break;
+      case 2u:
+        m_vmp.put({0x49, 0x0F, 0xCB});  // bswap r11
+        break;
+      case 3u:
+        m_vmp.put({0x4D, 0x8D, 0x93});  // lea r10, [r11+imm32]
+        m_vmp.put32(m_rng());
+        break;
+      default: {
+        const auto skip = static_cast<std::uint8_t>(1u + rnd(8u));
+        m_vmp.put({0xEB, skip});  // jmp over garbage
+        for (auto idx = 0u; idx < skip; ++idx)
+          m_vmp.put({static_cast<std::uint8_t>(m_rng())});
+        break;
+      }
+    }
+  }
+}
+
+void generator_t::calc_jmp() {
+  m_vmp.put({0x0F, 0xB6, 0x06});        // movzx eax, byte ptr [rsi]
+  m_vmp.put({0x48, 0x83, 0xC6, 0x01});  // add rsi, 1
+  junk();
+  m_vmp.put({0x30, 0xD8});         // xor al, bl
+  m_vmp.put({0x2C, m_key_op});     // sub al, key
+  m_vmp.put({0x30, 0xC3});         // xor bl, al
+  m_vmp.put({0x49, 0x8B, 0x14, 0xC4});  // mov rdx, [r12+rax*8]
+  junk();
+  m_vmp.put({0x48, 0x81, 0xF2});  // xor rdx, key
+  m_vmp.put32(m_key_tbl);
+  m_vmp.put({0x4C, 0x01, 0xEA});  // add rdx, r13
+  m_vmp.put({0xFF, 0xE2});        // jmp rdx
+}
+
+void generator_t::vm_enter() {
+  m_enter_rva = m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size());
+
+  // rax, rbx, rcx, rdx, rsi, rdi, rbp, r8-r15, rflags...
+  m_vmp.put({0x50, 0x53, 0x51, 0x52, 0x56, 0x57, 0x55});
+  for (std::uint8_t reg = 0u; reg < 8u; ++reg)
+    m_vmp.put({0x41, static_cast<std::uint8_t>(0x50 + reg)});
+  m_vmp.put({0x9C});
+
+  // mov rax, 0... relocated into the delta between where the image is loaded
+  // and its preferred base...
+  m_vmp.put({0x48, 0xB8});
+  m_delta_rva = m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size());
+  m_vmp.put64(0ull);
+  m_vmp.put({0x50});  // push rax
+  junk();
+
+  // the encrypted rva pushed by the vm entry is 0x90 above rsp now...
+  m_vmp.put({0x48, 0x8B, 0xB4, 0x24, 0x90, 0x00, 0x00, 0x00});  // mov rsi
+  m_vmp.put({0x48, 0x89, 0xE5});  // mov rbp, rsp
+  m_vmp.put({0x48, 0x81, 0xEC, 0x00, 0x02, 0x00, 0x00});  // sub rsp, 0x200
+  m_vmp.put({0x48, 0x83, 0xE4, 0xF0});                    // and rsp, -16
+  junk();
+  m_vmp.put({0x81, 0xF6});  // xor esi, key
+  m_vmp.put32(m_key_rva);
+
+  m_vmp.put({0x4C, 0x8D, 0x2D});  // lea r13, [rip-rva] (module base)
+  m_vmp.put32(0u - (m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size()) + 4u));
+  junk();
+  m_vmp.put({0x48, 0x89, 0xF3});  // mov rbx, rsi
+  m_vmp.put({0x4C, 0x01, 0xEE});  // add rsi, r13
+  m_vmp.put({0x4C, 0x8D, 0x25});  // lea r12, [rip+table]
+  m_table_disp = m_vmp.size();
+  m_vmp.put32(0u);
+  calc_jmp();
+}
+
+void generator_t::hndlr(hndlr_t& hndlr) {
+  hndlr.rva = m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size());
+  hndlr.key_b = static_cast<std::uint8_t>(m_rng());
+  hndlr.key_q = m_rng();
+
+  const auto byte_op = [&] {
+    m_vmp.put({0x0F, 0xB6, 0x06});        // movzx eax, byte ptr [rsi]
+    m_vmp.put({0x48, 0x83, 0xC6, 0x01});  // add rsi, 1
+    junk();
+    m_vmp.put({0x30, 0xD8});               // xor al, bl
+    m_vmp.put({0x04, hndlr.key_b});        // add al, key
+    m_vmp.put({0x30, 0xC3});               // xor bl, al
+  };
+
+  switch (hndlr.kind) {
+    case kind_t::sreg:
+      byte_op();
+      m_vmp.put({0x48, 0x8B, 0x55, 0x00});  // mov rdx, [rbp]
+      junk();
+      m_vmp.put({0x48, 0x83, 0xC5, 0x08});  // add rbp, 8
+      m_vmp.put({0x48, 0x89, 0x14, 0x04});  // mov [rsp+rax], rdx
+      break;
+    case kind_t::lreg:
+      byte_op();
+      m_vmp.put({0x48, 0x8B, 0x14, 0x04});  // mov rdx, [rsp+rax]
+      junk();
+      m_vmp.put({0x48, 0x83, 0xED, 0x08});  // sub rbp, 8
+      m_vmp.put({0x48, 0x89, 0x55, 0x00});  // mov [rbp], rdx
+      break;
+    case kind_t::lconst:
+      m_vmp.put({0x48, 0x8B, 0x06});        // mov rax, [rsi]
+      m_vmp.put({0x48, 0x83, 0xC6, 0x08});  // add rsi, 8
+      junk();
+      m_vmp.put({0x48, 0x31, 0xD8});  // xor rax, rbx
+      m_vmp.put({0x48, 0x0F, 0xC8});  // bswap rax
+      m_vmp.put({0x48, 0x05});        // add rax, key
+      m_vmp.put32(hndlr.key_q);
+      m_vmp.put({0x48, 0x31, 0xC3});  // xor rbx, rax
+      junk();
+      m_vmp.put({0x48, 0x83, 0xED, 0x08});  // sub rbp, 8
+      m_vmp.put({0x48, 0x89, 0x45, 0x00});  // mov [rbp], rax
+      break;
+    case kind_t::add:
+      m_vmp.put({0x48, 0x8B, 0x45, 0x00});  // mov rax, [rbp]
+      m_vmp.put({0x48, 0x8B, 0x55, 0x08});  // mov rdx, [rbp+8]
+      junk();
+      m_vmp.put({0x48, 0x01, 0xD0});        // add rax, rdx
+      m_vmp.put({0x48, 0x89, 0x45, 0x08});  // mov [rbp+8], rax
+      m_vmp.put({0x9C});                    // pushfq
+      m_vmp.put({0x8F, 0x45, 0x00});        // pop qword ptr [rbp]
+      break;
+    case kind_t::pushvsp:
+      m_vmp.put({0x48, 0x89, 0xE8});  // mov rax, rbp
+      junk();
+      m_vmp.put({0x48, 0x83, 0xED, 0x08});  // sub rbp, 8
+      m_vmp.put({0x48, 0x89, 0x45, 0x00});  // mov [rbp], rax
+      break;
+    case kind_t::read:
+      m_vmp.put({0x48, 0x8B, 0x45, 0x00});  // mov rax, [rbp]
+      junk();
+      m_vmp.put({0x48, 0x8B, 0x00});        // mov rax, [rax]
+      m_vmp.put({0x48, 0x89, 0x45, 0x00});  // mov [rbp], rax
+      break;
+    case kind_t::jmp:
+      m_vmp.put({0x48, 0x8B, 0x75, 0x00});  // mov rsi, [rbp]
+      m_vmp.put({0x48, 0x83, 0xC5, 0x08});  // add rbp, 8
+      junk();
+      m_vmp.put({0x48, 0x89, 0xF3});  // mov rbx, rsi
+      m_vmp.put({0x4C, 0x29, 0xEB});  // sub rbx, r13
+      break;
+    case kind_t::vmexit:
+      m_vmp.put({0x48, 0x89, 0xEC});  // mov rsp, rbp
+      junk();
+
+      // relocation delta, rflags, r15-r8, rbp, rdi, rsi, rdx, rcx, rbx, rax...
+      m_vmp.put({0x58, 0x9D});
+      for (std::uint8_t reg = 8u; reg; --reg)
+        m_vmp.put({0x41, static_cast<std::uint8_t>(0x57 + reg)});
+      m_vmp.put({0x5D, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0xC3});
+      return;
+    default:
+      return;
+  }
+
+  junk();
+  calc_jmp();
+}
+
+void generator_t::fill_table() {
+  // every copy gets at least one slot, the rest of the table points at
+  // random copies like it does in VMProtect...
+  std::vector<std::uint8_t> slots(0x100);
+  std::iota(slots.begin(), slots.end(), 0u);
+  for (auto idx = slots.size() - 1; idx; --idx)
+    std::swap(slots[idx], slots[rnd(static_cast<std::uint32_t>(idx + 1))]);
+
+  const auto cnt = static_cast<std::uint32_t>(m_hndlrs.size());
+  for (auto idx = 0u; idx < slots.size(); ++idx)
+    m_hndlrs[idx < cnt ? idx : rnd(cnt)].slots.push_back(slots[idx]);
+
+  m_vmp.align(8u);
+  const auto table_rva = m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size());
+  m_vmp.patch32(m_table_disp,
+                table_rva - (m_vmp_rva + static_cast<std::uint32_t>(
+                                             m_table_disp + 4u)));
+
+  std::vector<std::uint64_t> table(0x100);
+  for (const auto& hndlr : m_hndlrs)
+    for (const auto slot : hndlr.slots)
+      table[slot] = hndlr.rva ^ sext(m_key_tbl);
+
+  for (const auto entry : table) m_vmp.put64(entry);
+}
+
+std::vector<vop_t> generator_t::gen_blk(std::uint32_t blk,
+                                        std::uint32_t blk_cnt) {
+  std::vector<vop_t> vops;
+  const auto exit_blk = blk == blk_cnt;
+  const auto op = [&](kind_t kind, std::uint64_t imm = 0ull) {
+    vops.push_back({kind, imm});
+  };
+
+  // the first block takes over what vm enter pushed, every other block what
+  // the virtual jmp before it left on the stack (context and both branches)...
+  if (!blk) {
+    for (std::uint8_t vreg = 0u; vreg <= 16u; ++vreg)
+      op(kind_t::sreg, vreg * 8u);
+  } else {
+    for (std::uint8_t vreg = 12u; vreg; --vreg) op(kind_t::sreg, vreg * 8u);
+    op(kind_t::sreg, vreg_junk);
+    op(kind_t::sreg, vreg_junk);
+  }
+
+  if (!exit_blk)
+    for (auto idx = 0u; idx < m_cfg.work; ++idx) {
+      op(kind_t::lreg, vreg_tmp);
+      op(kind_t::lconst, (static_cast<std::uint64_t>(m_rng()) << 32) | m_rng());
+      op(kind_t::add);
+      op(kind_t::sreg, vreg_flags);
+      op(kind_t::sreg, vreg_tmp);
+    }
+
+  if (exit_blk || blk + 1 == blk_cnt) {
+    for (std::uint8_t vreg = 17u; vreg; --vreg)
+      op(kind_t::lreg, (vreg - 1) * 8u);
+    op(kind_t::vmexit);
+    return vops;
+  }
+
+  // virtual jcc... both branches are pushed as image based addresses, one of
+  // them is picked by adding an offset to the address of the first, rebased
+  // with the relocation delta and jumped to...
+  op(kind_t::lconst, 0ull);
+  op(kind_t::sreg, vreg_off);
+  vops.push_back({kind_t::lconst, 0ull, static_cast<int>(blk_cnt)});
+  vops.push_back({kind_t::lconst, 0ull, static_cast<int>(blk + 1)});
+  op(kind_t::pushvsp);
+  op(kind_t::lreg, vreg_off);
+  op(kind_t::add);
+  op(kind_t::sreg, vreg_flags);
+  op(kind_t::read);
+  op(kind_t::lreg, vreg_delta);
+  op(kind_t::add);
+  op(kind_t::sreg, vreg_flags);
+  op(kind_t::sreg, vreg_next);
+
+  for (std::uint8_t vreg = 1u; vreg <= 12u; ++vreg) op(kind_t::lreg, vreg * 8u);
+  op(kind_t::lreg, vreg_next);
+  op(kind_t::jmp);
+  return vops;
+}
+
+void generator_t::encrypt(const std::vector<vop_t>& vops, std::uint32_t rva,
+                          const std::vector<std::uint32_t>& blk_rvas) {
+  // mirrors calc jmp and the operand decryption of the handlers, the rolling
+  // key starts out as the rva of the block...
+  std::uint64_t key = rva;
+  for (const auto& vop : vops) {
+    std::vector<const hndlr_t*> copies;
+    for (const auto& hndlr : m_hndlrs)
+      if (hndlr.kind == vop.kind) copies.push_back(&hndlr);
+
+    const auto& hndlr = *copies[rnd(static_cast<std::uint32_t>(copies.size()))];
+    const auto slot =
+        hndlr.slots[rnd(static_cast<std::uint32_t>(hndlr.slots.size()))];
+    m_vmp.put({static_cast<std::uint8_t>((slot + m_key_op) ^ key)});
+    key ^= slot;
+
+    if (vop.kind == kind_t::sreg || vop.kind == kind_t::lreg) {
+      const auto val = static_cast<std::uint8_t>(vop.imm);
+      m_vmp.put({static_cast<std::uint8_t>((val - hndlr.key_b) ^ key)});
+      key ^= val;
+    } else if (vop.kind == kind_t::lconst) {
+      const auto val =
+          vop.target != -1 ? image_base + blk_rvas[vop.target] : vop.imm;
+      m_vmp.put64(bswap(val - sext(hndlr.key_q)) ^ key);
+      key ^= val;
+    }
+  }
+}
+
+static std::uint32_t align(std::size_t size, std::uint32_t alignment) {
+  return static_cast<std::uint32_t>((size + alignment - 1) & ~(alignment - 1));
+}
+
+template <class T>
+static void put(std::vector<std::uint8_t>& file, std::size_t offset, T val) {
+  for (auto idx = 0u; idx < sizeof val; ++idx)
+    file[offset + idx] = static_cast<std::uint8_t>(val >> idx * 8);
+}
+
+fixture_t generator_t::run() {
+  fixture_t fixture{};
+  fixture.image_base = image_base;
+
+  // .text holds a 16 byte stub per vm entry, .vmp0 starts after it...
+  m_text_rva = section_align;
+  m_vmp_rva = m_text_rva + align(m_cfg.entries * 16u, section_align);
+
+  vm_enter();
+  for (auto kind = 0u; kind < static_cast<std::uint32_t>(kind_t::cnt); ++kind)
+    for (auto copy = 0u; copy < std::max(m_cfg.copies, 1u); ++copy)
+      m_hndlrs.push_back({static_cast<kind_t>(kind)});
+
+  for (auto idx = m_hndlrs.size() - 1; idx; --idx)
+    std::swap(m_hndlrs[idx],
+              m_hndlrs[rnd(static_cast<std::uint32_t>(idx + 1))]);
+
+  for (auto& copy : m_hndlrs) hndlr(copy);
+  fill_table();
+
+  // the bytecode of every routine, blocks are laid out back to back and
+  // encrypted once the rva of every block is known...
+  const auto blk_cnt = std::max(m_cfg.blocks, 1u);
+  fixture.blocks = blk_cnt > 1u ? blk_cnt + 1u : 1u;
+
+  std::vector<std::uint32_t> rtn_rvas;
+  for (auto entry = 0u; entry < m_cfg.entries; ++entry) {
+    std::vector<std::vector<vop_t>> blks;
+    for (auto blk = 0u; blk < fixture.blocks; ++blk)
+      blks.push_back(gen_blk(blk, blk_cnt));
+
+    std::vector<std::uint32_t> blk_rvas;
+    auto rva = m_vmp_rva + static_cast<std::uint32_t>(m_vmp.size());
+    for (const auto& vops : blks) {
+      blk_rvas.push_back(rva);
+      for (const auto& vop : vops)
+        rva += static_cast<std::uint32_t>(vop_size(vop));
+    }
+
+    for (auto blk = 0u; blk < blks.size(); ++blk)
+      encrypt(blks[blk], blk_rvas[blk], blk_rvas);
+
+    rtn_rvas.push_back(blk_rvas[0]);
+  }
+
+  // push encrypted rva, call vm enter... the two instructions after it only
+  // matter when the binary is run natively, vmexit returns to them...
+  code_t text;
+  for (const auto rtn_rva : rtn_rvas) {
+    fixture.vm_entries.push_back(m_text_rva +
+                                 static_cast<std::uint32_t>(text.size()));
+    text.put({0x68});
+    text.put32(rtn_rva ^ m_key_rva);
+    text.put({0xE8});
+    text.put32(m_enter_rva -
+               (m_text_rva + static_cast<std::uint32_t>(text.size()) + 4u));
+    text.put({0x48, 0x8D, 0x64, 0x24, 0x08});  // lea rsp, [rsp+8]
+    text.put({0xC3});                          // ret
+  }
+
+  // a single base relocation, the relocation delta in vm enter...
+  const auto reloc_rva = m_vmp_rva + align(m_vmp.size(), section_align);
+  code_t reloc;
+  reloc.put32(m_delta_rva & ~0xFFFu);
+  reloc.put32(12u);
+  reloc.put({static_cast<std::uint8_t>(m_delta_rva & 0xFF),
+             static_cast<std::uint8_t>(0xA0 | (m_delta_rva >> 8 & 0xF)), 0x00,
+             0x00});
+
+  struct section_t {
+    const char* name;
+    std::uint32_t rva, characteristics;
+    std::vector<std::uint8_t>& data;
+  };
+
+  const section_t sections[] = {{".text", m_text_rva, 0x60000020u, text.data()},
+                                {".vmp0", m_vmp_rva, 0x60000020u, m_vmp.data()},
+                                {".reloc", reloc_rva, 0x42000040u,
+                                 reloc.data()}};
+
+  auto& file = fixture.file;
+  file.resize(headers_size);
+
+  // dos header, nt headers, file header and the PE32+ optional header...
+  constexpr auto nt = 0x40u, opt = nt + 0x18u, sec = opt + 0xF0u;
+  put<std::uint16_t>(file, 0x00, 0x5A4D);
+  put<std::uint32_t>(file, 0x3C, nt);
+  put<std::uint32_t>(file, nt, 0x4550);
+  put<std::uint16_t>(file, nt + 0x04, 0x8664);
+  put<std::uint16_t>(file, nt + 0x06, std::size(sections));
+  put<std::uint16_t>(file, nt + 0x14, 0xF0);
+  put<std::uint16_t>(file, nt + 0x16, 0x22);
+
+  put<std::uint16_t>(file, opt + 0x00, 0x20B);
+  put<std::uint32_t>(file, opt + 0x10, fixture.vm_entries[0]);
+  put<std::uint32_t>(file, opt + 0x14, m_text_rva);
+  put<std::uint64_t>(file, opt + 0x18, image_base);
+  put<std::uint32_t>(file, opt + 0x20, section_align);
+  put<std::uint32_t>(file, opt + 0x24, file_align);
+  put<std::uint16_t>(file, opt + 0x28, 6);
+  put<std::uint16_t>(file, opt + 0x30, 6);
+  put<std::uint32_t>(file, opt + 0x38, reloc_rva + section_align);
+  put<std::uint32_t>(file, opt + 0x3C, headers_size);
+  put<std::uint16_t>(file, opt + 0x44, 3);
+  put<std::uint16_t>(file, opt + 0x46, 0x8160);
+  put<std::uint64_t>(file, opt + 0x48, 0x100000);
+  put<std::uint64_t>(file, opt + 0x50, 0x1000);
+  put<std::uint64_t>(file, opt + 0x58, 0x100000);
+  put<std::uint64_t>(file, opt + 0x60, 0x1000);
+  put<std::uint32_t>(file, opt + 0x6C, 16);
+  put<std::uint32_t>(file, opt + 0x70 + 5 * 8, reloc_rva);
+  put<std::uint32_t>(file, opt + 0x74 + 5 * 8,
+                     static_cast<std::uint32_t>(reloc.size()));
+
+  for (auto idx = 0u; idx < std::size(sections); ++idx) {
+    const auto& section = sections[idx];
+    const auto hdr = sec + idx * 0x28u;
+    const auto raw = static_cast<std::uint32_t>(file.size());
+    const auto raw_size = align(section.data.size(), file_align);
+
+    std::memcpy(&file[hdr], section.name, std::strlen(section.name));
+    put<std::uint32_t>(file, hdr + 0x08,
+                       static_cast<std::uint32_t>(section.data.size()));
+    put<std::uint32_t>(file, hdr + 0x0C, section.rva);
+    put<std::uint32_t>(file, hdr + 0x10, raw_size);
+    put<std::uint32_t>(file, hdr + 0x14, raw);
+    put<std::uint32_t>(file, hdr + 0x24, section.characteristics);
+
+    file.resize(raw + raw_size);
+    std::copy(section.data.begin(), section.data.end(), file.begin() + raw);
+  }
+
+  return fixture;
+}
+
+fixture_t gen_fixture(const fixture_cfg_t& cfg) {
+  return generator_t(cfg).run();
+}
+}  // namespace bench
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bench {
+/// <summary>
+/// shape of a generated fixture binary...
+/// </summary>
+struct fixture_cfg_t {
+  /// <summary>
+  /// number of vm entries, each with its own virtual routine...
+  /// </summary>
+  std::uint32_t entries = 1u;
+
+  /// <summary>
+  /// virtual code blocks of each routine... every block but the last ends in
+  /// a virtual jcc to the next block or to an exit block shared by all of
+  /// them, the last one exits the vm...
+  /// </summary>
+  std::uint32_t blocks = 16u;
+
+  /// <summary>
+  /// LREG, LCONST, ADD, SREG, SREG sequences per block...
+  /// </summary>
+  std::uint32_t work = 8u;
+
+  /// <summary>
+  /// copies of each vm handler, each with its own operand encryption and junk
+  /// code...
+  /// </summary>
+  std::uint32_t copies = 2u;
+
+  /// <summary>
+  /// seed of the generator, the same settings always give the same binary...
+  /// </summary>
+  std::uint32_t seed = 0x1337u;
+};
+
+/// <summary>
+/// a generated binary... a PE64 with the entry stubs in .text and the vm
+/// (vm enter, handlers, encrypted handler table and encrypted bytecode) in
+/// .vmp0, the way VMProtect 3 lays it out:
+///
+/// vm entry:  push encrypted rva, call vm enter
+/// vm enter:  push every register and the relocation delta, VIP = rsi,
+///            VSP = rbp, virtual registers at rsp, rolling key in rbx
+/// handlers:  SREGQ, LREGQ, LCONSTQ, ADDQ, PUSHVSP, READQ, JMP and VMEXIT,
+///            each ending in the shared calc jmp which decrypts the next
+///            opcode and handler table entry
+///
+/// the generated code also runs natively, vmexit returns to the caller of
+/// the vm entry...
+/// </summary>
+struct fixture_t {
+  std::vector<std::uint8_t> file;
+  std::uint64_t image_base;
+
+  /// <summary>
+  /// rva of each vm entry...
+  /// </summary>
+  std::vector<std::uint32_t> vm_entries;
+
+  /// <summary>
+  /// virtual code blocks emulation of a single vm entry has to find...
+  /// </summary>
+  std::size_t blocks;
+};
+
+/// <summary>
+/// generate a fixture binary...
+/// </summary>
+/// <param name="cfg">shape of the binary...</param>
+/// <returns>the binary...</returns>
+fixture_t gen_fixture(const fixture_cfg_t& cfg);
+}  // namespace bench
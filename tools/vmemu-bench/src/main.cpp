@@ -0,0 +1,380 @@
+#include <unicorn/unicorn.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cli-parser.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fixture.hpp>
+#include <fstream>
+#include <memory>
+#include <pe_image_t.hpp>
+#include <vector>
+#include <vmemu_t.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define CODE_BASE 0x140000000ull
+
+namespace bench {
+/// <summary>
+/// what the benchmark code hook does, mirrors vm::emu_t::mode_t...
+/// </summary>
+enum class mode_t : std::uint8_t { trace, speculative };
+
+struct hook_ctx_t {
+  mode_t mode = mode_t::trace;
+  std::uint64_t traced = 0ull, speculated = 0ull;
+};
+
+static bool trace_callback(uc_engine*, uint64_t, uint32_t, hook_ctx_t* ctx) {
+  ++ctx->traced;
+  return true;
+}
+
+static bool spec_callback(uc_engine*, uint64_t, uint32_t, hook_ctx_t* ctx) {
+  ++ctx->speculated;
+  return true;
+}
+
+static bool mode_callback(uc_engine* uc, uint64_t address, uint32_t size,
+                          hook_ctx_t* ctx) {
+  return ctx->mode == mode_t::trace ? trace_callback(uc, address, size, ctx)
+                                    : spec_callback(uc, address, size, ctx);
+}
+
+/// <summary>
+/// synthetic routine... blk_cnt blocks of eight ADD RAX, 1 each ending in a
+/// JMP to the next block so that unicorn-engine has to translate blk_cnt
+/// blocks...
+/// </summary>
+static std::vector<std::uint8_t> gen_code(std::size_t blk_cnt) {
+  std::vector<std::uint8_t> code;
+  for (auto idx = 0u; idx < blk_cnt; ++idx) {
+    for (auto add = 0u; add < 8u; ++add)
+      code.insert(code.end(), {0x48, 0x83, 0xC0, 0x01});
+
+    code.insert(code.end(), {0xEB, 0x00});
+  }
+  return code;
+}
+
+/// <summary>
+/// emulate the routine runs times, every run is traced and then speculatively
+/// executed again the way vm::emu_t::legit_branch does it, switching the code
+/// hook to speculative execution and back...
+/// </summary>
+/// <param name="code">the synthetic routine...</param>
+/// <param name="runs">number of times to emulate the routine...</param>
+/// <param name="rehook">remove and add hooks instead of switching mode...</param>
+/// <returns>time spent in milliseconds or -1 on failure...</returns>
+static double run(const std::vector<std::uint8_t>& code, std::size_t runs,
+                  bool rehook) {
+  uc_engine* uc = nullptr;
+  uc_err err;
+
+  if ((err = uc_open(UC_ARCH_X86, UC_MODE_64, &uc))) {
+    std::printf("[!] uc_open err = %d\n", err);
+    return -1.0;
+  }
+
+  const auto map_size = (code.size() + 0xFFFull) & ~0xFFFull;
+  if ((err = uc_mem_map(uc, CODE_BASE, map_size, UC_PROT_ALL)) ||
+      (err = uc_mem_write(uc, CODE_BASE, code.data(), code.size()))) {
+    std::printf("[!] failed to map code... reason = %d\n", err);
+    uc_close(uc);
+    return -1.0;
+  }
+
+  hook_ctx_t ctx;
+  uc_hook code_hook;
+  const auto code_end = CODE_BASE + code.size();
+
+  if ((err = uc_hook_add(uc, &code_hook, UC_HOOK_CODE,
+                         rehook ? (void*)&trace_callback
+                                : (void*)&mode_callback,
+                         &ctx, CODE_BASE, code_end))) {
+    std::printf("[!] uc_hook_add error, reason = %d\n", err);
+    uc_close(uc);
+    return -1.0;
+  }
+
+  const auto switch_hook = [&](mode_t mode) {
+    if (rehook) {
+      uc_hook_del(uc, code_hook);
+      uc_hook_add(uc, &code_hook, UC_HOOK_CODE,
+                  mode == mode_t::trace ? (void*)&trace_callback
+                                        : (void*)&spec_callback,
+                  &ctx, CODE_BASE, code_end);
+    } else {
+      ctx.mode = mode;
+    }
+  };
+
+  const auto begin = std::chrono::high_resolution_clock::now();
+  for (auto idx = 0u; idx < runs; ++idx) {
+    if ((err = uc_emu_start(uc, CODE_BASE, code_end, 0ull, 0ull))) {
+      std::printf("[!] error starting emu... reason = %d\n", err);
+      uc_close(uc);
+      return -1.0;
+    }
+
+    switch_hook(mode_t::speculative);
+    err = uc_emu_start(uc, CODE_BASE, code_end, 0ull, 0ull);
+    switch_hook(mode_t::trace);
+
+    if (err) {
+      std::printf("[!] error starting speculative emu... reason = %d\n", err);
+      uc_close(uc);
+      return -1.0;
+    }
+  }
+
+  const auto end = std::chrono::high_resolution_clock::now();
+  uc_close(uc);
+
+  // nine instructions per block of 34 bytes, once traced and once
+  // speculatively executed...
+  const std::uint64_t expected = runs * (code.size() / 34) * 9;
+  if (ctx.traced != expected || ctx.speculated != expected) {
+    std::printf(
+        "[!] traced %" PRIu64 " and speculated %" PRIu64
+        " instructions, expected %" PRIu64 "...\n",
+        ctx.traced, ctx.speculated, expected);
+    return -1.0;
+  }
+
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+/// <summary>
+/// peak resident memory of the process in kb...
+/// </summary>
+static std::size_t peak_rss() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  return K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                 sizeof counters)
+             ? counters.PeakWorkingSetSize >> 10
+             : 0u;
+#else
+  rusage usage{};
+  return getrusage(RUSAGE_SELF, &usage) ? 0u
+                                        : static_cast<std::size_t>(
+                                              usage.ru_maxrss);
+#endif
+}
+
+/// <summary>
+/// load a fixture binary written to disk and emulate each of its vm entries
+/// runs times on a single engine which is reset in between... startup covers
+/// loading the image, vmctx init and emu_t init...
+/// </summary>
+/// <param name="fixture">the fixture...</param>
+/// <param name="path">where the fixture was written to...</param>
+/// <param name="runs">number of times each vm entry is emulated...</param>
+/// <returns>returns false if the fixture could not be emulated...</returns>
+static bool emu_fixture(const fixture_t& fixture, const std::string& path,
+                        std::size_t runs) {
+  const auto startup = std::chrono::high_resolution_clock::now();
+  vm::pe_image_t image;
+  if (!image.load(path)) {
+    std::printf("[!] failed to load fixture...\n");
+    return false;
+  }
+
+  std::vector<std::unique_ptr<vm::vmctx_t>> vmctxs;
+  for (const auto vm_entry_rva : fixture.vm_entries) {
+    vmctxs.push_back(std::make_unique<vm::vmctx_t>(
+        image.module_base(), image.image_base(), image.image_size(),
+        vm_entry_rva));
+
+    if (!vmctxs.back()->init()) {
+      std::printf("[!] failed to init vmctx of vm entry %x...\n",
+                  vm_entry_rva);
+      return false;
+    }
+  }
+
+  vm::emu_cfg_t emu_cfg;
+  emu_cfg.image = &image;
+  vm::emu_t emu(vmctxs[0].get(), emu_cfg);
+  if (!emu.init()) {
+    std::printf("[!] failed to init vm::emu_t...\n");
+    return false;
+  }
+
+  const auto begin = std::chrono::high_resolution_clock::now();
+  std::size_t hndlrs = 0u, blks = 0u;
+  for (auto run = 0u; run < runs; ++run) {
+    for (auto idx = 0u; idx < vmctxs.size(); ++idx) {
+      vm::instrs::vrtn_t vrtn;
+      if (!emu.reset(vmctxs[idx].get()) ||
+          !emu.emulate(fixture.vm_entries[idx], vrtn)) {
+        std::printf("[!] failed to emulate vm entry %x... %s\n",
+                    fixture.vm_entries[idx],
+                    vm::emu_t::status_name(emu.status()));
+        return false;
+      }
+
+      if (vrtn.m_blks.size() != fixture.blocks) {
+        std::printf("[!] vm entry %x has %zu blocks, expected %zu...\n",
+                    fixture.vm_entries[idx], vrtn.m_blks.size(),
+                    fixture.blocks);
+        return false;
+      }
+
+      blks += vrtn.m_blks.size();
+      for (const auto& vblk : vrtn.m_blks) hndlrs += vblk.m_vinstrs.size();
+    }
+  }
+
+  const auto end = std::chrono::high_resolution_clock::now();
+  const auto startup_ms =
+      std::chrono::duration<double, std::milli>(begin - startup).count();
+  const auto secs = std::chrono::duration<double>(end - begin).count();
+
+  std::printf("> startup:      %.2fms\n", startup_ms);
+  std::printf("> emulation:    %.2fms\n", secs * 1000.0);
+  std::printf("> handlers/sec: %.0f\n", hndlrs / secs);
+  std::printf("> blocks/sec:   %.0f\n", blks / secs);
+  std::printf("> peak rss:     %zukb\n", peak_rss());
+  return true;
+}
+
+/// <summary>
+/// generate a fixture binary and benchmark vm::emu_t on it, see
+/// emu_fixture...
+/// </summary>
+/// <param name="cfg">shape of the fixture...</param>
+/// <param name="path">where to write the fixture...</param>
+/// <param name="runs">number of times each vm entry is emulated...</param>
+/// <param name="keep">keep the fixture once done...</param>
+/// <returns>returns false if the fixture could not be emulated...</returns>
+static bool run_emu(const fixture_cfg_t& cfg, const std::string& path,
+                    std::size_t runs, bool keep) {
+  const auto fixture = gen_fixture(cfg);
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  if (!output.write(reinterpret_cast<const char*>(fixture.file.data()),
+                    fixture.file.size())) {
+    std::printf("[!] failed to write fixture to %s...\n", path.c_str());
+    return false;
+  }
+  output.close();
+
+  std::printf("> fixture %s, %u vm entries of %zu blocks, %zu bytes...\n",
+              path.c_str(), cfg.entries, fixture.blocks, fixture.file.size());
+
+  // the image is unloaded by now, windows does not remove mapped files...
+  const auto result = emu_fixture(fixture, path, runs);
+
+  std::error_code err;
+  if (!keep) std::filesystem::remove(path, err);
+  return result;
+}
+}  // namespace bench
+
+int __cdecl main(int argc, const char* argv[]) {
+  argparse::argument_parser_t parser("vmemu-bench", "VMEmu benchmarks");
+  parser.add_argument()
+      .name("--blocks")
+      .description("number of native blocks in the synthetic routine...");
+  parser.add_argument()
+      .name("--runs")
+      .description("number of times the synthetic routine is emulated...");
+  parser.add_argument()
+      .name("--emu")
+      .description(
+          "benchmark vm::emu_t on a generated VMProtect shaped binary instead "
+          "of the unicorn-engine hooks...");
+  parser.add_argument()
+      .name("--fixture")
+      .description("where to write the generated binary, it is kept...");
+  parser.add_argument()
+      .name("--entries")
+      .description("number of vm entries in the generated binary...");
+  parser.add_argument()
+      .name("--vblocks")
+      .description("virtual code blocks per vm entry...");
+  parser.add_argument()
+      .name("--seed")
+      .description("seed of the generated binary...");
+
+  parser.enable_help();
+  auto result = parser.parse(argc, argv);
+
+  if (result) {
+    std::printf("[!] error parsing commandline arguments... reason = %s\n",
+                result.what().c_str());
+    return -1;
+  }
+
+  if (parser.exists("help")) {
+    parser.print_help();
+    return 0;
+  }
+
+  const std::size_t blk_cnt =
+      parser.exists("blocks")
+          ? std::strtoull(parser.get<std::string>("blocks").c_str(), nullptr,
+                          10)
+          : 0x4000u;
+
+  const std::size_t runs =
+      parser.exists("runs")
+          ? std::strtoull(parser.get<std::string>("runs").c_str(), nullptr, 10)
+          : 64u;
+
+  if (parser.exists("emu")) {
+    vm::utils::init();
+    vm::logger_t::level(vm::log_level_t::warn);
+
+    bench::fixture_cfg_t cfg;
+    if (parser.exists("entries"))
+      cfg.entries = std::strtoul(parser.get<std::string>("entries").c_str(),
+                                 nullptr, 10);
+    if (parser.exists("vblocks"))
+      cfg.blocks = std::strtoul(parser.get<std::string>("vblocks").c_str(),
+                                nullptr, 10);
+    if (parser.exists("seed"))
+      cfg.seed = std::strtoul(parser.get<std::string>("seed").c_str(),
+                              nullptr, 0);
+
+    if (!cfg.entries) {
+      std::printf("[!] the fixture needs at least one vm entry...\n");
+      return -1;
+    }
+
+    const auto path =
+        parser.exists("fixture")
+            ? parser.get<std::string>("fixture")
+            : (std::filesystem::temp_directory_path() / "vmemu-fixture.exe")
+                  .string();
+
+    return bench::run_emu(cfg, path, parser.exists("runs") ? runs : 16u,
+                          parser.exists("fixture"))
+               ? 0
+               : -1;
+  }
+
+  const auto code = bench::gen_code(blk_cnt);
+  std::printf("> synthetic routine of %zu blocks, emulated %zu times...\n",
+              blk_cnt, runs);
+
+  const auto rehook_ms = bench::run(code, runs, true);
+  const auto mode_ms = bench::run(code, runs, false);
+
+  if (rehook_ms < 0.0 || mode_ms < 0.0) return -1;
+
+  std::printf("> uc_hook_del/uc_hook_add per branch check: %.2fms\n",
+              rehook_ms);
+  std::printf("> persistent hook with mode switch:         %.2fms\n", mode_ms);
+  std::printf("> speedup: %.2fx\n", rehook_ms / mode_ms);
+}
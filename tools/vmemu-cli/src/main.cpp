@@ -1,10 +1,41 @@
+#include <algorithm>
+#include <analysis_cache_t.hpp>
+#include <atomic>
+#include <batch_t.hpp>
+#include <chrono>
 #include <cli-parser.hpp>
+#include <csignal>
+#include <cstdio>
+#include <emu_pool_t.hpp>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <pe_image_t.hpp>
+#include <rtn_file_t.hpp>
+#include <server_t.hpp>
 #include <thread>
+#include <thread_pool_t.hpp>
 #include <vmemu_t.hpp>
 #include <vmlocate.hpp>
 
+// set by ctrl+c, every engine stops at the next check of its hooks...
+static std::atomic<bool> g_cancel = false;
+
+static void cancel_handler(int) { g_cancel = true; }
+
+// write the --stats report, "-" writes it to stdout...
+static bool write_stats(const std::string& path, const std::string& json) {
+  if (path == "-") {
+    vm::logger_t::get().flush();
+    std::printf("%s\n", json.c_str());
+    return true;
+  }
+
+  std::ofstream output(path, std::ios::trunc);
+  return output && (output << json << '\n');
+}
+
 int __cdecl main(int argc, const char* argv[]) {
   argparse::argument_parser_t parser("VMEmu",
                                      "VMProtect 3 VM Handler Emulator");
@@ -13,12 +44,8 @@ int __cdecl main(int argc, const char* argv[]) {
       .description("relative virtual address to a vm entry...");
   parser.add_argument()
       .name("--bin")
-      .description("path to unpacked virtualized binary...")
-      .required(true);
-  parser.add_argument()
-      .name("--out")
-      .description("output file name...")
-      .required(true);
+      .description("path to unpacked virtualized binary...");
+  parser.add_argument().name("--out").description("output file name...");
   parser.add_argument().name("--unpack").description("unpack a vmp2 binary...");
   parser.add_argument()
       .names({"-f", "--force"})
@@ -28,13 +55,99 @@ int __cdecl main(int argc, const char* argv[]) {
       .description(
           "scan for all vm enters and trace all of them... this may take a few "
           "minutes...");
+  parser.add_argument()
+      .name("--threads")
+      .description(
+          "number of worker threads used to load the binary and by --emuall, "
+          "defaults to one per hardware thread...");
+  parser.add_argument()
+      .name("--order")
+      .description(
+          "order in which virtual branches are emulated: bfs (default), dfs "
+          "or depth (most deeply nested first)...");
+  parser.add_argument()
+      .name("--native")
+      .description(
+          "run profiled vm handlers on the host instead of in unicorn-engine: "
+          "off (default), on, or check (run both and compare)...");
+  parser.add_argument()
+      .name("--blockhooks")
+      .description(
+          "hook basic blocks instead of native instructions, vm handlers are "
+          "traced on a forked engine when needed...");
+  parser.add_argument()
+      .name("--lazy")
+      .description(
+          "map the image into unicorn-engine on demand in chunks of this many "
+          "kb (4 or 64)...");
+  parser.add_argument()
+      .name("--snapbudget")
+      .description(
+          "keep the stack snapshots of pending virtual branches to this many "
+          "mb of memory, the rest is spilled to a temporary file...");
+  parser.add_argument()
+      .name("--hndlrbudget")
+      .description(
+          "give up on a vm entry once a single vm handler took this many "
+          "native instructions...");
+  parser.add_argument()
+      .name("--blkbudget")
+      .description(
+          "give up on a vm entry once a single virtual code block took this "
+          "many native instructions...");
+  parser.add_argument()
+      .name("--rtnbudget")
+      .description(
+          "give up on a vm entry once it took this many native "
+          "instructions...");
+  parser.add_argument()
+      .name("--timeout")
+      .description(
+          "give up on a vm entry once it took this many milliseconds...");
+  parser.add_argument()
+      .name("--stats")
+      .description(
+          "write performance counters as json to this file (- for stdout)... "
+          "requires a build with VMEMU_STATS...");
+  parser.add_argument()
+      .name("--log")
+      .description(
+          "log level: trace (every virtual instruction), debug (every block), "
+          "info (default), warn, error or off...");
+  parser.add_argument()
+      .name("--cache")
+      .description(
+          "directory to cache emulated vm entries and profiled vm handlers "
+          "in, entries found in it are not emulated again...");
+  parser.add_argument()
+      .name("--parspec")
+      .description(
+          "validate both branches of a virtual jcc, and the entries of a "
+          "virtual jump table, in parallel on forked engines...");
+  parser.add_argument()
+      .name("--batch")
+      .description(
+          "emulate every binary of this manifest, one per line: <binary> "
+          "<comma separated vm entry rvas|all> <output>... loading, "
+          "emulation and writing of different binaries overlap...");
+  parser.add_argument()
+      .name("--depth")
+      .description(
+          "binaries --batch loads ahead of emulation and holds between "
+          "emulation and writing, defaults to 2...");
+  parser.add_argument()
+      .name("--serve")
+      .description(
+          "run as a daemon on this unix domain socket, loaded binaries and "
+          "warm engines stay resident between requests (see server_t.hpp for "
+          "the protocol)... ctrl+c stops it...");
 
   vm::utils::init();
   parser.enable_help();
   auto result = parser.parse(argc, argv);
 
   if (result) {
-    std::printf("[!] error parsing commandline arguments... reason = %s\n",
+    VMEMU_ERROR("[!] error parsing commandline arguments... reason = %s\n",
                 result.what().c_str());
     return -1;
   }
@@ -44,81 +157,217 @@ int __cdecl main(int argc, const char* argv[]) {
     return 0;
   }
 
-  std::vector<std::uint8_t> module_data, tmp, unpacked_bin;
-  if (!vm::utils::open_binary_file(parser.get<std::string>("bin"),
-                                   module_data)) {
-    std::printf("[!] failed to open binary file...\n");
+  if (parser.exists("log")) {
+    vm::log_level_t level;
+    if (!vm::logger_t::parse(parser.get<std::string>("log"), level)) {
+      VMEMU_ERROR("[!] unknown log level... %s\n",
+                  parser.get<std::string>("log").c_str());
+      return -1;
+    }
+    vm::logger_t::level(level);
+  }
+
+  // used to load the image and by --emuall...
+  vm::thread_pool_t pool(
+      parser.exists("threads")
+          ? std::strtoul(parser.get<std::string>("threads").c_str(), nullptr,
+                         10)
+          : 0u);
+
+  vm::emu_cfg_t emu_cfg;
+  if (parser.exists("order")) {
+    const auto order = parser.get<std::string>("order");
+    if (order == "bfs")
+      emu_cfg.order = vm::worklist_t::order_t::bfs;
+    else if (order == "dfs")
+      emu_cfg.order = vm::worklist_t::order_t::dfs;
+    else if (order == "depth")
+      emu_cfg.order = vm::worklist_t::order_t::depth;
+    else {
+      VMEMU_ERROR("[!] unknown branch order... %s\n", order.c_str());
+      return -1;
+    }
+  }
+
+  emu_cfg.parallel_spec = parser.exists("parspec");
+  emu_cfg.block_hooks = parser.exists("blockhooks");
+  if (parser.exists("lazy")) {
+    const auto chunk_kb =
+        std::strtoul(parser.get<std::string>("lazy").c_str(), nullptr, 10);
+    if (!chunk_kb || chunk_kb % 4) {
+      VMEMU_ERROR("[!] lazy chunk size must be a multiple of 4kb...\n");
+      return -1;
+    }
+    emu_cfg.lazy_chunk = chunk_kb << 10;
+  }
+  if (parser.exists("snapbudget")) {
+    const auto arg = parser.get<std::string>("snapbudget");
+    char* end = nullptr;
+    const auto budget_mb = std::strtoull(arg.c_str(), &end, 10);
+    if (arg.empty() || *end || !budget_mb ||
+        budget_mb > (std::numeric_limits<std::size_t>::max() >> 20)) {
+      VMEMU_ERROR("[!] snapshot budget must be a number of mb above 0...\n");
+      return -1;
+    }
+    emu_cfg.snapshot_budget = static_cast<std::size_t>(budget_mb) << 20;
+  }
+  const auto budget = [&](const char* name) -> std::uint64_t {
+    return parser.exists(name)
+               ? std::strtoull(parser.get<std::string>(name).c_str(), nullptr,
+                               10)
+               : 0ull;
+  };
+
+  emu_cfg.hndlr_budget = budget("hndlrbudget");
+  emu_cfg.blk_budget = budget("blkbudget");
+  emu_cfg.rtn_budget = budget("rtnbudget");
+  emu_cfg.time_budget = static_cast<std::uint32_t>(budget("timeout"));
+
+  // ctrl+c stops emulation cleanly, what was emulated so far is still
+  // written...
+  emu_cfg.cancel = &g_cancel;
+  std::signal(SIGINT, &cancel_handler);
+
+  if (parser.exists("stats") && !vm::emu_stats_t::enabled)
+    VMEMU_WARN(
+        "[!] performance counters are not compiled in, rebuild with "
+        "VMEMU_STATS=ON...\n");
+
+  if (parser.exists("native")) {
+    const auto native = parser.get<std::string>("native");
+    if (native == "off")
+      emu_cfg.native = vm::native_mode_t::off;
+    else if (native == "on")
+      emu_cfg.native = vm::native_mode_t::native;
+    else if (native == "check")
+      emu_cfg.native = vm::native_mode_t::cross_check;
+    else {
+      VMEMU_ERROR("[!] unknown native mode... %s\n", native.c_str());
+      return -1;
+    }
+  }
+
+  if (parser.exists("batch")) {
+    std::vector<vm::batch_job_t> jobs;
+    if (!vm::batch_t::parse(parser.get<std::string>("batch"), jobs))
+      return -1;
+
+    vm::batch_t batch(
+        emu_cfg, pool,
+        parser.exists("depth")
+            ? std::strtoul(parser.get<std::string>("depth").c_str(), nullptr,
+                           10)
+            : 2u);
+    if (parser.exists("cache")) batch.cache(parser.get<std::string>("cache"));
+
+    VMEMU_INFO("> emulating %zu binaries with %zu worker threads...\n",
+               jobs.size(), pool.size());
+    const auto begin = std::chrono::steady_clock::now();
+    const auto results = batch.run(
+        jobs, [](const vm::batch_job_t& job, const vm::batch_result_t& result) {
+          VMEMU_INFO(
+              "> %s: loaded = %d, written = %d, emulated %zu of %zu vm "
+              "entries (%zu from the cache, %zu stopped) in %lld ms\n",
+              job.bin.c_str(), result.loaded, result.written, result.emulated,
+              result.entries, result.cached, result.stopped,
+              static_cast<long long>(result.time.count()));
+        });
+
+    const auto total = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin);
+    const auto failed =
+        std::count_if(results.begin(), results.end(),
+                      [](const vm::batch_result_t& result) {
+                        return !result.loaded || !result.written;
+                      });
+
+    VMEMU_INFO("> %zu binaries in %lld ms, %td failed...\n", jobs.size(),
+               static_cast<long long>(total.count()), failed);
+    return failed ? -1 : 0;
+  }
+
+  if (parser.exists("serve")) {
+    vm::server_t server(emu_cfg, pool);
+    if (parser.exists("cache")) server.cache(parser.get<std::string>("cache"));
+    return server.run(parser.get<std::string>("serve")) ? 0 : -1;
+  }
+
+  if (!parser.exists("bin") || !parser.exists("out")) {
+    VMEMU_ERROR(
+        "[!] --bin and --out are required without --batch or --serve...\n");
     return -1;
   }
 
-  auto img = reinterpret_cast<win::image_t<>*>(module_data.data());
-  auto image_size = img->get_nt_headers()->optional_header.size_image;
-  const auto image_base = img->get_nt_headers()->optional_header.image_base;
-
-  // page align the vector allocation so that unicorn-engine is happy girl...
-  tmp.resize(image_size + PAGE_4KB);
-  const std::uintptr_t module_base =
-      reinterpret_cast<std::uintptr_t>(tmp.data()) +
-      (PAGE_4KB - (reinterpret_cast<std::uintptr_t>(tmp.data()) & 0xFFFull));
-
-  std::memcpy((void*)module_base, module_data.data(), 0x1000);
-  std::for_each(img->get_nt_headers()->get_sections(),
-                img->get_nt_headers()->get_sections() +
-                    img->get_nt_headers()->file_header.num_sections,
-                [&](const auto& section_header) {
-                  std::memcpy(
-                      (void*)(module_base + section_header.virtual_address),
-                      module_data.data() + section_header.ptr_raw_data,
-                      section_header.size_raw_data);
-                });
-
-  auto win_img = reinterpret_cast<win::image_t<>*>(module_base);
-
-  auto basereloc_dir =
-      win_img->get_directory(win::directory_id::directory_entry_basereloc);
-
-  auto reloc_dir = reinterpret_cast<win::reloc_directory_t*>(
-      basereloc_dir->rva + module_base);
-
-  win::reloc_block_t* reloc_block = &reloc_dir->first_block;
-
-  // apply relocations to all sections...
-  while (reloc_block->base_rva && reloc_block->size_block) {
-    std::for_each(reloc_block->begin(), reloc_block->end(),
-                  [&](win::reloc_entry_t& entry) {
-                    switch (entry.type) {
-                      case win::reloc_type_id::rel_based_dir64: {
-                        auto reloc_at = reinterpret_cast<std::uintptr_t*>(
-                            entry.offset + reloc_block->base_rva + module_base);
-                        *reloc_at = module_base + ((*reloc_at) - image_base);
-                        break;
-                      }
-                      default:
-                        break;
-                    }
-                  });
-
-    reloc_block = reloc_block->next();
+  vm::pe_image_t image;
+  if (!image.load(parser.get<std::string>("bin"), &pool)) {
+    VMEMU_ERROR("[!] failed to open binary file...\n");
+    return -1;
   }
 
-  std::printf("> image base = %p, image size = %p, module base = %p\n",
-              image_base, image_size, module_base);
+  const auto module_base = image.module_base();
+  const auto image_base = image.image_base();
+  const auto image_size = image.image_size();
+
+  VMEMU_INFO(
+      "> image base = 0x%llx, image size = 0x%llx, module base = 0x%llx\n",
+      static_cast<unsigned long long>(image_base),
+      static_cast<unsigned long long>(image_size),
+      static_cast<unsigned long long>(module_base));
 
   if (!image_base || !image_size || !module_base) {
-    std::printf("[!] failed to open binary on disk...\n");
+    VMEMU_ERROR("[!] failed to open binary on disk...\n");
     return -1;
   }
 
+  emu_cfg.image = &image;
+
+  // results are cached per binary, vm handlers profiled by an earlier run are
+  // trusted right away...
+  std::optional<vm::analysis_cache_t> cache;
+  std::vector<vm::hndlr_profile_t> profiles;
+  if (parser.exists("cache")) {
+    cache.emplace();
+    if (!cache->open(parser.get<std::string>("cache"), image, &pool)) {
+      VMEMU_ERROR("[!] failed to open cache directory...\n");
+      return -1;
+    }
+
+    if (cache->load_hndlrs(profiles)) emu_cfg.profiles = &profiles;
+    VMEMU_INFO("> binary hash = %016llx, %zu cached vm handler profiles...\n",
+               static_cast<unsigned long long>(cache->hash()),
+               profiles.size());
+  }
+
   if (parser.exists("vmentry")) {
     const auto vm_entries = vm::locate::get_vm_entries(module_base, image_size);
-    std::printf("> number of vm entries = %d\n", vm_entries.size());
+    VMEMU_INFO("> number of vm entries = %zu\n", vm_entries.size());
 
     const auto vm_entry_rva =
         std::strtoull(parser.get<std::string>("vmentry").c_str(), nullptr, 16);
 
+    vm::instrs::vrtn_t virt_rtn;
+    if (cache && cache->load_rtn(vm_entry_rva, virt_rtn)) {
+      VMEMU_INFO("> vm entry rva = 0x%llx loaded from the cache...\n",
+                 vm_entry_rva);
+
+      vm::rtn_writer_t writer;
+      if (!writer.open(parser.get<std::string>("out"), module_base,
+                       image_base)) {
+        VMEMU_ERROR("[!] failed to open output file...\n");
+        return -1;
+      }
+
+      writer.add_rtn(virt_rtn);
+      if (!writer.close()) {
+        VMEMU_ERROR("[!] failed to write output file...\n");
+        return -1;
+      }
+      return 0;
+    }
+
     vm::vmctx_t vmctx(module_base, image_base, image_size, vm_entry_rva);
     if (!vmctx.init()) {
-      std::printf(
+      VMEMU_ERROR(
           "[!] failed to init vmctx... this can be for many reasons..."
           " try validating your vm entry rva... make sure the binary is "
           "unpacked and is"
@@ -126,16 +375,237 @@ int __cdecl main(int argc, const char* argv[]) {
       return -1;
     }
 
-    vm::emu_t emu(&vmctx);
+    vm::emu_t emu(&vmctx, emu_cfg);
     if (!emu.init()) {
-      std::printf(
+      VMEMU_ERROR(
           "[!] failed to init vm::emu_t... read above in the console for the "
           "reason...\n");
       return -1;
     }
 
-    // TODO: rewrite this... using it to define profiles atm...
-    vm::instrs::vrtn_t virt_rtn;
-    emu.emulate(vm_entry_rva, virt_rtn);
+    vm::rtn_writer_t writer;
+    if (!writer.open(parser.get<std::string>("out"), module_base,
+                     image_base)) {
+      VMEMU_ERROR("[!] failed to open output file...\n");
+      return -1;
+    }
+
+    // blocks are written out as soon as they are emulated...
+    vm::rtn_writer_t cache_writer;
+    const bool caching = cache && cache->begin_rtn(vm_entry_rva, cache_writer);
+    const auto cache_id = caching ? cache_writer.begin_rtn(vm_entry_rva) : 0u;
+    const auto rtn_id = writer.begin_rtn(vm_entry_rva);
+    const auto emulated = emu.emulate(
+        vm_entry_rva, virt_rtn,
+        [&](const vm::instrs::vrtn_t&, const vm::instrs::vblk_t& vblk) {
+          writer.add_blk(rtn_id, vblk);
+          if (caching) cache_writer.add_blk(cache_id, vblk);
+        });
+
+    if (caching) {
+      if (emulated) cache_writer.end_rtn(cache_id);
+      cache->commit_rtn(vm_entry_rva, cache_writer, emulated);
+
+      std::vector<vm::hndlr_profile_t> learned;
+      emu.profiles(learned);
+      if (!cache->store_hndlrs(learned))
+        VMEMU_WARN("[!] failed to cache vm handler profiles...\n");
+    }
+
+    // a routine stopped by a budget or ctrl+c is written with the blocks
+    // emulated so far, one that failed is not...
+    const auto stopped =
+        !emulated && emu.status() != vm::emu_status_t::error;
+    if (emulated || stopped) writer.end_rtn(rtn_id);
+
+    if (!writer.close()) {
+      VMEMU_ERROR("[!] failed to write output file...\n");
+      return -1;
+    }
+
+    if (!emulated) {
+      VMEMU_ERROR("[!] failed to emulate vm entry... %s%s\n",
+                  vm::emu_t::status_name(emu.status()),
+                  stopped ? ", the blocks emulated so far are written" : "");
+      return -1;
+    }
+
+    if (parser.exists("stats") &&
+        !write_stats(parser.get<std::string>("stats"), emu.stats().json())) {
+      VMEMU_ERROR("[!] failed to write stats...\n");
+      return -1;
+    }
+  } else if (parser.exists("emuall")) {
+    const auto vm_entries = vm::locate::get_vm_entries(module_base, image_size);
+    VMEMU_INFO("> number of vm entries = %zu\n", vm_entries.size());
+
+    struct entry_result_t {
+      bool success, cached;
+      vm::emu_status_t status;
+      std::chrono::microseconds time;
+      vm::instrs::vrtn_t rtn;
+      vm::working_set_t ws;
+      vm::emu_stats_t stats;
+    };
+
+    vm::rtn_writer_t writer;
+    if (!writer.open(parser.get<std::string>("out"), module_base,
+                     image_base)) {
+      VMEMU_ERROR("[!] failed to open output file...\n");
+      return -1;
+    }
+
+    // every worker emulates with its own unicorn-engine, the relocated image,
+    // its decoded instructions and profiled vm handlers are shared by all of
+    // them... engines are reset and reused for the next entry a worker picks
+    // up...
+    vm::decode_cache_t decode_cache(module_base, image_size);
+    vm::hndlr_kb_t hndlr_kb;
+    std::vector<entry_result_t> results(vm_entries.size());
+
+    auto cfg = emu_cfg;
+    cfg.decode_cache = &decode_cache;
+    cfg.hndlr_kb = &hndlr_kb;
+    vm::emu_pool_t engines(pool.size(), cfg);
+
+    VMEMU_INFO("> emulating with %zu worker threads...\n", pool.size());
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (auto idx = 0u; idx < vm_entries.size(); ++idx) {
+      pool.submit([&, idx](std::size_t worker_idx) {
+        const auto entry_begin = std::chrono::steady_clock::now();
+        const auto vm_entry_rva = vm_entries[idx].rva;
+        auto& result = results[idx];
+
+        // entries still queued once cancelled are not even started...
+        if (g_cancel) {
+          result.status = vm::emu_status_t::cancelled;
+          return;
+        }
+
+        if (cache && cache->load_rtn(vm_entry_rva, result.rtn)) {
+          writer.add_rtn(result.rtn);
+          result.success = result.cached = true;
+          result.time = std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - entry_begin);
+          return;
+        }
+
+        vm::vmctx_t vmctx(module_base, image_base, image_size, vm_entry_rva);
+        if (!vmctx.init()) {
+          VMEMU_ERROR("[!] failed to init vmctx for vm entry rva = 0x%x...\n",
+                      vm_entry_rva);
+          result.status = vm::emu_status_t::error;
+          return;
+        }
+
+        const auto emu = engines.get(worker_idx, &vmctx);
+        if (!emu) {
+          VMEMU_ERROR(
+              "[!] failed to init vm::emu_t for vm entry rva = 0x%x...\n",
+              vm_entry_rva);
+          result.status = vm::emu_status_t::error;
+          return;
+        }
+
+        // routines of entries that fail to emulate are left open and thus
+        // never make it into the routine table of the file, those stopped by
+        // a budget or ctrl+c are written with the blocks emulated so far...
+        const auto stats_before = emu->stats();
+        vm::rtn_writer_t cache_writer;
+        const bool caching =
+            cache && cache->begin_rtn(vm_entry_rva, cache_writer);
+        const auto cache_id =
+            caching ? cache_writer.begin_rtn(vm_entry_rva) : 0u;
+        const auto rtn_id = writer.begin_rtn(vm_entry_rva);
+        result.success = emu->emulate(
+            vm_entry_rva, result.rtn,
+            [&](const vm::instrs::vrtn_t&, const vm::instrs::vblk_t& vblk) {
+              writer.add_blk(rtn_id, vblk);
+              if (caching) cache_writer.add_blk(cache_id, vblk);
+            });
+
+        result.status = emu->status();
+        if (result.success || result.status != vm::emu_status_t::error)
+          writer.end_rtn(rtn_id);
+        if (caching) {
+          if (result.success) cache_writer.end_rtn(cache_id);
+          cache->commit_rtn(vm_entry_rva, cache_writer, result.success);
+        }
+        result.ws = emu->working_set();
+        result.stats = emu->stats();
+        result.stats -= stats_before;
+        result.time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - entry_begin);
+      });
+    }
+
+    pool.wait();
+    const auto total = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin);
+
+    for (auto idx = 0u; idx < vm_entries.size(); ++idx)
+      VMEMU_INFO(
+          "> vm entry rva = 0x%x, success = %d (%s), blocks = %zu, time = "
+          "%lld us, image chunks = %zu\n",
+          vm_entries[idx].rva, results[idx].success,
+          vm::emu_t::status_name(results[idx].status),
+          results[idx].rtn.m_blks.size(),
+          static_cast<long long>(results[idx].time.count()),
+          results[idx].ws.chunks);
+
+    VMEMU_INFO("> emulated %zu vm entries in %lld ms, %td from the cache...\n",
+               vm_entries.size(), static_cast<long long>(total.count()),
+               std::count_if(results.begin(), results.end(),
+                             [](const entry_result_t& result) {
+                               return result.cached;
+                             }));
+
+    if (const auto stopped = std::count_if(
+            results.begin(), results.end(),
+            [](const entry_result_t& result) {
+              return result.status != vm::emu_status_t::ok &&
+                     result.status != vm::emu_status_t::error;
+            }))
+      VMEMU_WARN(
+          "> %td vm entries ran out of budget or were cancelled, their "
+          "routines are written as far as they were emulated...\n",
+          stopped);
+
+    VMEMU_INFO("> %zu vm handlers in the knowledge base...\n", hndlr_kb.size());
+
+    // profiles of every engine go back into the cache for the next run...
+    if (cache) {
+      std::vector<vm::hndlr_profile_t> learned;
+      hndlr_kb.trusted(learned);
+
+      if (!cache->store_hndlrs(learned))
+        VMEMU_WARN("[!] failed to cache vm handler profiles...\n");
+    }
+
+    if (!writer.close()) {
+      VMEMU_ERROR("[!] failed to write output file...\n");
+      return -1;
+    }
+
+    if (parser.exists("stats")) {
+      vm::emu_stats_t total;
+      std::string entries;
+      char rva[32];
+
+      for (auto idx = 0u; idx < vm_entries.size(); ++idx) {
+        total += results[idx].stats;
+        std::snprintf(rva, sizeof rva, "\"0x%x\":", vm_entries[idx].rva);
+        entries += (idx ? "," : "") + std::string(rva) +
+                   results[idx].stats.json();
+      }
+
+      if (!write_stats(parser.get<std::string>("stats"),
+                       "{\"total\":" + total.json() + ",\"entries\":{" +
+                           entries + "}}")) {
+        VMEMU_ERROR("[!] failed to write stats...\n");
+        return -1;
+      }
+    }
   }
 }
\ No newline at end of file